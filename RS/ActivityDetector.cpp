@@ -0,0 +1,134 @@
+#include "ActivityDetector.h"
+
+#include <iostream>
+#include <algorithm>
+
+ActivityDetector::ActivityDetector() {
+}
+
+ActivityDetector::ActivityDetector(ActivityGate* gate, string indexFilename, float preRollSeconds, float postRollSeconds,
+								   float activityThreshold, int depthDeltaMm, float depthScale, int colorDelta) {
+	this->gate = gate;
+	this->index.setFile(indexFilename);
+	this->preRollMs = preRollSeconds * 1000.0;
+	this->postRollMs = postRollSeconds * 1000.0;
+	this->activityThreshold = activityThreshold;
+	this->depthDelta = max(1, static_cast<int>(depthDeltaMm * 0.001f / depthScale));
+	this->colorDelta = colorDelta;
+}
+
+// Fraction of pixels, valid in both frames, whose depth changed by more than depthDelta.
+float ActivityDetector::depthChange(const rs2::depth_frame& depthFrame) {
+	cv::Mat depthImage(cv::Size(depthFrame.get_width(), depthFrame.get_height()), CV_16UC1,
+					   (void*)depthFrame.get_data(), depthFrame.get_stride_in_bytes());
+	cv::resize(depthImage, this->depthSmall, cv::Size(depthImage.cols / this->downscale, depthImage.rows / this->downscale),
+			   0, 0, cv::INTER_NEAREST);
+
+	if (this->depthReference.empty() || this->depthReference.size() != this->depthSmall.size()) {
+		this->depthSmall.copyTo(this->depthReference);
+		return 0.0f;
+	}
+
+	cv::absdiff(this->depthSmall, this->depthReference, this->difference);
+	cv::min(this->depthSmall, this->depthReference, this->validMask);
+	this->validMask = this->validMask > 0;
+	this->changedMask = (this->difference > this->depthDelta) & this->validMask;
+
+	int valid = cv::countNonZero(this->validMask);
+	if (valid == 0) {
+		return 0.0f;
+	}
+	return static_cast<float>(cv::countNonZero(this->changedMask)) / valid;
+}
+
+// Fraction of pixels whose brightness changed by more than colorDelta.
+float ActivityDetector::colorChange(const rs2::video_frame& colorFrame) {
+	cv::Mat colorImage(cv::Size(colorFrame.get_width(), colorFrame.get_height()), CV_8UC3,
+					   (void*)colorFrame.get_data(), colorFrame.get_stride_in_bytes());
+	cv::resize(colorImage, this->colorSmall, cv::Size(colorImage.cols / this->downscale, colorImage.rows / this->downscale),
+			   0, 0, cv::INTER_AREA);
+	cv::cvtColor(this->colorSmall, this->colorGray, cv::COLOR_BGR2GRAY);
+
+	if (this->colorReference.empty() || this->colorReference.size() != this->colorGray.size()) {
+		this->colorGray.copyTo(this->colorReference);
+		return 0.0f;
+	}
+
+	cv::absdiff(this->colorGray, this->colorReference, this->difference);
+	this->changedMask = this->difference > this->colorDelta;
+
+	return static_cast<float>(cv::countNonZero(this->changedMask)) / static_cast<float>(this->colorGray.total());
+}
+
+void ActivityDetector::update(const rs2::frameset& frameSet) {
+	rs2::depth_frame depthFrame = frameSet.get_depth_frame();
+	rs2::video_frame colorFrame = frameSet.get_color_frame();
+
+	if (!depthFrame && !colorFrame) {
+		return;
+	}
+
+	double timestamp = depthFrame ? depthFrame.get_timestamp() : colorFrame.get_timestamp();
+	if (this->sessionStart < 0.0) {
+		this->sessionStart = timestamp;
+	}
+
+	float depthScore = depthFrame ? this->depthChange(depthFrame) : 0.0f;
+	float colorScore = colorFrame ? this->colorChange(colorFrame) : 0.0f;
+	this->lastScore = max(depthScore, colorScore);
+
+	// Compare against a reference half a second old, slow motion hardly shows between consecutive frames.
+	this->framesSinceReference++;
+	if (this->framesSinceReference >= this->referenceInterval) {
+		this->depthSmall.copyTo(this->depthReference);
+		this->colorGray.copyTo(this->colorReference);
+		this->framesSinceReference = 0;
+	}
+
+	if (this->lastScore > this->activityThreshold) {
+		if (!this->active) {
+			this->active = true;
+			this->intervalStart = timestamp;
+			std::cout << "Activity started at " << (timestamp - this->sessionStart) / 1000.0 << " seconds." << endl;
+		}
+		this->lastActivity = timestamp;
+
+		if (this->gate != nullptr) {
+			this->gate->activeUntil = timestamp + this->postRollMs;
+		}
+	}
+	else if (this->active && timestamp > this->lastActivity + this->postRollMs) {
+		this->closeInterval(this->lastActivity + this->postRollMs);
+	}
+}
+
+void ActivityDetector::closeInterval(double end) {
+	this->active = false;
+
+	double recordedFrom = max(this->sessionStart, this->intervalStart - this->preRollMs);
+	std::cout << "Activity ended at " << (end - this->sessionStart) / 1000.0 << " seconds." << endl;
+
+	MetadataRecord record = {
+		{ "start_s", SessionMetadata::number((this->intervalStart - this->sessionStart) / 1000.0) },
+		{ "end_s", SessionMetadata::number((end - this->sessionStart) / 1000.0) },
+		{ "recorded_from_s", SessionMetadata::number((recordedFrom - this->sessionStart) / 1000.0) },
+		{ "start_timestamp_ms", SessionMetadata::number(this->intervalStart) },
+		{ "end_timestamp_ms", SessionMetadata::number(end) }
+	};
+	this->index.appendRecord("active_intervals", record);
+}
+
+void ActivityDetector::finish() {
+	if (this->active) {
+		this->closeInterval(this->lastActivity + this->postRollMs);
+	}
+	this->index.setField("session_start_timestamp_ms", SessionMetadata::number(this->sessionStart));
+}
+
+bool ActivityDetector::isActive() const {
+	return this->active;
+}
+
+float ActivityDetector::score() const {
+	return this->lastScore;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "ActivityGate.h"
+#include "SessionMetadata.h"
+
+#ifndef ACTIVITYDETECTOR_H
+#define ACTIVITYDETECTOR_H
+
+using namespace std;
+
+/*
+Decides whether anything moves in the scene from heavily downscaled depth
+and color frames, compared with a reference taken half a second earlier.
+The work is a handful of OpenCV calls (resize, absdiff, compare,
+countNonZero) which run on OpenCV's SIMD kernels, on a few thousand pixels.
+Active intervals, including post-roll, are written to activity_index.json.
+*/
+class ActivityDetector
+{
+	private:
+		ActivityGate* gate = nullptr;
+		SessionMetadata index;
+
+		int downscale = 8;
+		int referenceInterval = 15;
+		float activityThreshold = 0.01f;
+		int depthDelta = 15;				// In depth units.
+		int colorDelta = 12;
+		double postRollMs = 5000.0;
+		double preRollMs = 2000.0;
+
+		cv::Mat depthSmall, depthReference;
+		cv::Mat colorSmall, colorGray, colorReference;
+		cv::Mat difference, validMask, changedMask;
+		int framesSinceReference = 0;
+
+		bool active = false;
+		double intervalStart = 0.0;
+		double lastActivity = 0.0;
+		double sessionStart = -1.0;
+		float lastScore = 0.0f;
+
+		float depthChange(const rs2::depth_frame& depthFrame);
+		float colorChange(const rs2::video_frame& colorFrame);
+		void closeInterval(double end);
+
+	public:
+		ActivityDetector();
+		ActivityDetector(ActivityGate* gate, string indexFilename, float preRollSeconds, float postRollSeconds,
+						 float activityThreshold, int depthDeltaMm, float depthScale, int colorDelta);
+		void update(const rs2::frameset& frameSet);
+		void finish();
+		bool isActive() const;
+		float score() const;
+};
+
+#endif // !
@@ -0,0 +1,20 @@
+#pragma once
+#include <atomic>
+
+#ifndef ACTIVITYGATE_H
+#define ACTIVITYGATE_H
+
+/*
+Shared between the activity detector on the capture thread and the writers.
+The detector moves activeUntil forward while the scene moves, writers encode
+frames whose sensor timestamp falls before it and hold the rest as pre-roll.
+*/
+struct ActivityGate {
+	std::atomic<double> activeUntil{ -1.0 };	// Sensor timestamp in milliseconds.
+
+	bool isLive(double timestamp) const {
+		return timestamp <= this->activeUntil.load();
+	}
+};
+
+#endif // !
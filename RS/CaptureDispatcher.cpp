@@ -0,0 +1,68 @@
+#include "CaptureDispatcher.h"
+
+#include <iostream>
+
+CaptureDispatcher::CaptureDispatcher() : latestFrames(1) {
+}
+
+// Runs on the SDK's thread for every frameset.
+void CaptureDispatcher::dispatch(const rs2::frame& frame) {
+	rs2::frameset frameSet = frame.as<rs2::frameset>();
+	if (!frameSet) {
+		return;
+	}
+
+	// The callback thread belongs to the SDK, it is placed with the first frameset it delivers.
+	if (this->placementPending.exchange(false)) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	this->received++;
+	this->latestFrames.enqueue(frameSet);
+
+	std::lock_guard<std::mutex> guard(this->handlerLock);
+	if (!this->handler) {
+		return;
+	}
+
+	try {
+		this->handler(frameSet);
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+	}
+}
+
+void CaptureDispatcher::setHandler(std::function<void(const rs2::frameset&)> handler) {
+	std::lock_guard<std::mutex> guard(this->handlerLock);
+	this->handler = handler;
+}
+
+// Returns once a handler that is running has finished, no frameset reaches it afterwards.
+void CaptureDispatcher::clearHandler() {
+	std::lock_guard<std::mutex> guard(this->handlerLock);
+	this->handler = nullptr;
+}
+
+void CaptureDispatcher::setPlacement(const ThreadPlacement& placement) {
+	this->placement = placement;
+	this->placementPending = placement.isSet();
+}
+
+// Before the pipeline starts again, its callback thread will be a new one.
+void CaptureDispatcher::rearmPlacement() {
+	this->placementPending = this->placement.isSet();
+}
+
+// The newest frameset, or an empty one when none arrived within timeoutMs.
+rs2::frameset CaptureDispatcher::waitForFrames(unsigned int timeoutMs) {
+	rs2::frameset frameSet;
+	if (!this->latestFrames.try_wait_for_frame(&frameSet, timeoutMs)) {
+		return rs2::frameset();
+	}
+	return frameSet;
+}
+
+unsigned long long CaptureDispatcher::framesReceived() const {
+	return this->received;
+}
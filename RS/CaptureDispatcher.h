@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <librealsense2/rs.hpp>
+#include "ThreadPlacement.h"
+
+#ifndef CAPTUREDISPATCHER_H
+#define CAPTUREDISPATCHER_H
+
+using namespace std;
+
+/*
+Frame callback of the pipeline in capture_mode = callback. Every frameset
+goes to the recording handler right on the SDK's thread, which should only
+pass references on to the writer queues. The UI thread picks up the newest
+frameset from a one slot queue whenever it gets to it, so a slow preview
+drops preview frames instead of stalling the capture.
+*/
+class CaptureDispatcher
+{
+	private:
+		rs2::frame_queue latestFrames;
+		std::function<void(const rs2::frameset&)> handler;
+		std::mutex handlerLock;
+		std::atomic<unsigned long long> received{ 0 };
+
+		ThreadPlacement placement;
+		std::atomic<bool> placementPending{ false };
+
+	public:
+		CaptureDispatcher();
+		void dispatch(const rs2::frame& frame);
+		void setHandler(std::function<void(const rs2::frameset&)> handler);
+		void clearHandler();
+		void setPlacement(const ThreadPlacement& placement);
+		void rearmPlacement();
+		rs2::frameset waitForFrames(unsigned int timeoutMs);
+		unsigned long long framesReceived() const;
+};
+
+#endif // !
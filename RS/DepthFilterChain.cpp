@@ -0,0 +1,131 @@
+#include "DepthFilterChain.h"
+
+#include <iostream>
+#include <fstream>
+
+static DepthFilterSettings depthRange(float minDepth, float maxDepth) {
+	DepthFilterSettings settings;
+	settings.minDepth = minDepth;
+	settings.maxDepth = maxDepth;
+	return settings;
+}
+
+DepthFilterChain::DepthFilterChain(float minDepth, float maxDepth) : DepthFilterChain(depthRange(minDepth, maxDepth)) {
+}
+
+DepthFilterChain::DepthFilterChain(const DepthFilterSettings& settings) {
+	this->settings = settings;
+
+	// filter settings
+	this->thr_filter.set_option(RS2_OPTION_MIN_DISTANCE, settings.minDepth);
+	this->thr_filter.set_option(RS2_OPTION_MAX_DISTANCE, settings.maxDepth);
+	this->spat_filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, settings.spatialMagnitude);
+	this->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, settings.spatialAlpha);
+	this->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, settings.spatialDelta);
+	this->spat_filter.set_option(RS2_OPTION_HOLES_FILL, settings.spatialHolesFill);
+	this->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, settings.temporalAlpha);
+	this->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, settings.temporalDelta);
+	this->temp_filter.set_option(RS2_OPTION_HOLES_FILL, settings.temporalPersistence);		// Persistency index
+	this->color_filter.set_option(RS2_OPTION_HISTOGRAM_EQUALIZATION_ENABLED, 0);
+	this->color_filter.set_option(RS2_OPTION_COLOR_SCHEME, 9.0f);		// Hue colorization
+	this->color_filter.set_option(RS2_OPTION_MAX_DISTANCE, settings.maxDepth);
+	this->color_filter.set_option(RS2_OPTION_MIN_DISTANCE, settings.minDepth);
+}
+
+// Filtered depth, before colorization.
+rs2::frame DepthFilterChain::filter(rs2::frame frame) {
+	frame = this->thr_filter.process(frame);
+	frame = this->depth_to_disparity.process(frame);
+	if (this->settings.spatial) {
+		frame = this->spat_filter.process(frame);
+	}
+	if (this->settings.temporal) {
+		frame = this->temp_filter.process(frame);
+	}
+	return this->disparity_to_depth.process(frame);
+}
+
+rs2::frame DepthFilterChain::colorize(rs2::frame frame) {
+	return this->color_filter.process(frame);
+}
+
+rs2::frame DepthFilterChain::process(rs2::frame frame) {
+	return this->colorize(this->filter(frame));
+}
+
+static string trim(const string& s) {
+	size_t first = s.find_first_not_of(" \t\r");
+	if (first == string::npos) {
+		return "";
+	}
+	size_t last = s.find_last_not_of(" \t\r");
+	return s.substr(first, last - first + 1);
+}
+
+static bool parseBool(const string& value) {
+	return value == "1" || value == "true" || value == "on" || value == "yes";
+}
+
+static bool applySetting(DepthFilterSettings& settings, const string& key, const string& value) {
+	if (key == "min_depth_m") settings.minDepth = stof(value);
+	else if (key == "max_depth_m") settings.maxDepth = stof(value);
+	else if (key == "spatial") settings.spatial = parseBool(value);
+	else if (key == "spatial_magnitude") settings.spatialMagnitude = stof(value);
+	else if (key == "spatial_alpha") settings.spatialAlpha = stof(value);
+	else if (key == "spatial_delta") settings.spatialDelta = stof(value);
+	else if (key == "spatial_holes_fill") settings.spatialHolesFill = stof(value);
+	else if (key == "temporal") settings.temporal = parseBool(value);
+	else if (key == "temporal_alpha") settings.temporalAlpha = stof(value);
+	else if (key == "temporal_delta") settings.temporalDelta = stof(value);
+	else if (key == "temporal_persistence") settings.temporalPersistence = stof(value);
+	else if (key == "stereo_baseline_mm") settings.stereoBaselineMm = stof(value);
+	else return false;
+
+	return true;
+}
+
+/*
+Same "key = value" format as recorder_options.cfg. Returns false when the
+file does not exist, in which case the settings are left untouched.
+*/
+bool loadDepthFilterSettings(const string& filename, DepthFilterSettings& settings) {
+	ifstream settingsFile(filename);
+	if (!settingsFile.is_open()) {
+		return false;
+	}
+
+	string line;
+	int lineNumber = 0;
+
+	while (getline(settingsFile, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != string::npos) {
+			line = line.substr(0, comment);
+		}
+
+		size_t separator = line.find('=');
+		if (trim(line).empty()) {
+			continue;
+		}
+		if (separator == string::npos) {
+			std::cerr << filename << ":" << lineNumber << " is not a key = value pair." << endl;
+			continue;
+		}
+
+		string key = trim(line.substr(0, separator));
+		string value = trim(line.substr(separator + 1));
+
+		try {
+			if (!applySetting(settings, key, value)) {
+				std::cerr << filename << ":" << lineNumber << " unknown filter setting " << key << "." << endl;
+			}
+		}
+		catch (const std::exception&) {
+			std::cerr << filename << ":" << lineNumber << " invalid value for " << key << "." << endl;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <librealsense2/rs.hpp>
+
+#ifndef DEPTHFILTERCHAIN_H
+#define DEPTHFILTERCHAIN_H
+
+using namespace std;
+
+/*
+Filter parameters, the defaults are the SDK's and the ones the recorder
+always used. A "key = value" file (see loadDepthFilterSettings) overrides
+them for offline re-processing.
+*/
+struct DepthFilterSettings {
+	float minDepth = 0.19f;
+	float maxDepth = 7.0f;
+	bool spatial = true;
+	float spatialMagnitude = 2.0f;
+	float spatialAlpha = 0.5f;
+	float spatialDelta = 20.0f;
+	float spatialHolesFill = 0.0f;
+	bool temporal = true;
+	float temporalAlpha = 0.4f;
+	float temporalDelta = 20.0f;
+	float temporalPersistence = 3.0f;
+	float stereoBaselineMm = 50.0f;		// Of replayed depth, the disparity transform needs it (D435: 50, D415: 55).
+};
+
+bool loadDepthFilterSettings(const string& filename, DepthFilterSettings& settings);
+
+/*
+Turns a depth frame into the hue colorized image the depth videos hold:
+threshold, spatial and temporal filtering in disparity space, colorizer.
+The temporal filter keeps state, so a chain serves one stream in order.
+Its filters each give their frames a stream profile of their own, and the
+temporal filter starts over whenever the profile of its input changes, so
+every step of filter stays on the one chain. colorize carries nothing from
+one frame to the next, frames can go through it on separate chains at once.
+*/
+class DepthFilterChain
+{
+	private:
+		DepthFilterSettings settings;
+
+		rs2::threshold_filter thr_filter;   // Threshold  - removes values outside recommended range
+		rs2::spatial_filter spat_filter;    // Spatial    - edge-preserving spatial smoothing
+		rs2::temporal_filter temp_filter;   // Temporal   - reduces temporal noise
+
+		rs2::disparity_transform depth_to_disparity = rs2::disparity_transform(true);
+		rs2::disparity_transform disparity_to_depth = rs2::disparity_transform(false);
+		rs2::colorizer color_filter;
+
+	public:
+		DepthFilterChain(float minDepth, float maxDepth);
+		DepthFilterChain(const DepthFilterSettings& settings);
+		rs2::frame filter(rs2::frame frame);
+		rs2::frame colorize(rs2::frame frame);
+		rs2::frame process(rs2::frame frame);
+};
+
+#endif // !
@@ -0,0 +1,190 @@
+#include "DepthQualityMonitor.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Frames between checks of the time per frame against the budget.
+static const int costWindow = 30;
+
+DepthQualityMonitor::DepthQualityMonitor() {
+}
+
+void DepthQualityMonitor::configure(int stride, double budgetMicroseconds, float intervalSeconds, float depthScale, float minDepth, float maxDepth) {
+	this->stride = max(1, stride);
+	this->budgetMicroseconds = budgetMicroseconds;
+	this->intervalSeconds = max(1.0f, intervalSeconds);
+	this->depthScale = depthScale > 0.0f ? depthScale : 0.001f;
+	this->minUnits = static_cast<uint16_t>(min(65535.0f, max(0.0f, minDepth / this->depthScale)));
+	this->maxUnits = static_cast<uint16_t>(min(65535.0f, max(0.0f, maxDepth / this->depthScale)));
+	this->reset();
+}
+
+// Every session starts from an empty grid and empty averages, the stride stays where the budget put it.
+void DepthQualityMonitor::reset() {
+	this->width = 0;
+	this->height = 0;
+	this->latest = DepthQuality();
+	this->interval = DepthQuality();
+	this->session = DepthQuality();
+	this->worstFillRate = 1.0;
+	this->intervalStart = -1.0;
+	this->costMicroseconds = 0.0;
+	this->sessionCostMicroseconds = 0.0;
+	this->costFrames = 0;
+}
+
+void DepthQualityMonitor::resizeGrid(int frameWidth, int frameHeight) {
+	this->width = (frameWidth + this->stride - 1) / this->stride;
+	this->height = (frameHeight + this->stride - 1) / this->stride;
+	size_t points = static_cast<size_t>(this->width) * this->height;
+	this->mean.assign(points, 0.0f);
+	this->variance.assign(points, 0.0f);
+	this->history.assign(points, 0);
+}
+
+void DepthQualityMonitor::accumulate(DepthQuality& total, const DepthQuality& frame) {
+	total.fillRate += frame.fillRate;
+	total.outOfRange += frame.outOfRange;
+	total.temporalNoiseMm += frame.temporalNoiseMm;
+	total.frames++;
+}
+
+DepthQuality DepthQualityMonitor::average(const DepthQuality& total) {
+	DepthQuality averaged = total;
+	if (total.frames > 0) {
+		averaged.fillRate /= total.frames;
+		averaged.outOfRange /= total.frames;
+		averaged.temporalNoiseMm /= total.frames;
+	}
+	return averaged;
+}
+
+/*
+One pass over the grid. metadata, when given, gets a "depth_quality" record
+at the end of every interval.
+*/
+void DepthQualityMonitor::update(const rs2::depth_frame& frame, SessionMetadata* metadata) {
+	if (!frame) {
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	int frameWidth = frame.get_width();
+	int frameHeight = frame.get_height();
+	if (this->width != (frameWidth + this->stride - 1) / this->stride || this->height != (frameHeight + this->stride - 1) / this->stride) {
+		this->resizeGrid(frameWidth, frameHeight);
+	}
+
+	const uint16_t* pixels = reinterpret_cast<const uint16_t*>(frame.get_data());
+	int rowPixels = frame.get_stride_in_bytes() / static_cast<int>(sizeof(uint16_t));
+	int settledFrames = static_cast<int>(std::ceil(1.0f / this->noiseWeight));
+	float weight = this->noiseWeight;
+
+	long long sampled = 0, filled = 0, outOfRange = 0, settled = 0;
+	double deviationSum = 0.0;
+	size_t point = 0;
+
+	for (int y = 0; y < frameHeight; y += this->stride) {
+		const uint16_t* row = pixels + static_cast<size_t>(y) * rowPixels;
+		for (int x = 0; x < frameWidth; x += this->stride, ++point) {
+			uint16_t depth = row[x];
+			sampled++;
+			if (depth == 0) {
+				this->history[point] = 0;
+				continue;
+			}
+			filled++;
+			if (depth < this->minUnits || depth > this->maxUnits) {
+				outOfRange++;
+			}
+
+			float value = static_cast<float>(depth);
+			if (this->history[point] == 0) {
+				this->mean[point] = value;
+				this->variance[point] = 0.0f;
+			}
+			else {
+				float difference = value - this->mean[point];
+				float increment = weight * difference;
+				this->mean[point] += increment;
+				this->variance[point] = (1.0f - weight) * (this->variance[point] + difference * increment);
+			}
+			if (this->history[point] < 65535) {
+				this->history[point]++;
+			}
+			if (this->history[point] >= settledFrames) {
+				deviationSum += std::sqrt(this->variance[point]);
+				settled++;
+			}
+		}
+	}
+
+	this->latest.fillRate = sampled > 0 ? static_cast<double>(filled) / sampled : 0.0;
+	this->latest.outOfRange = filled > 0 ? static_cast<double>(outOfRange) / filled : 0.0;
+	this->latest.temporalNoiseMm = settled > 0 ? deviationSum / settled * this->depthScale * 1000.0 : 0.0;
+	this->latest.frames = 1;
+	accumulate(this->interval, this->latest);
+	accumulate(this->session, this->latest);
+	this->worstFillRate = min(this->worstFillRate, this->latest.fillRate);
+
+	// The interval record below rewrites session_metadata.json, the budget only covers the pass over the grid.
+	double cost = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	this->costMicroseconds += cost;
+	this->sessionCostMicroseconds += cost;
+	if (++this->costFrames >= costWindow) {
+		// A coarser grid from the next frame on, its points start their history over.
+		if (this->costMicroseconds / this->costFrames > this->budgetMicroseconds && this->stride < this->maxStride) {
+			this->stride *= 2;
+			std::cout << "Depth quality over its budget of " << this->budgetMicroseconds << " us, sampling every " << this->stride << " pixels." << endl;
+		}
+		this->costMicroseconds = 0.0;
+		this->costFrames = 0;
+	}
+
+	double timestamp = frame.get_timestamp();
+	if (this->intervalStart < 0.0) {
+		this->intervalStart = timestamp;
+	}
+	if (timestamp - this->intervalStart >= this->intervalSeconds * 1000.0) {
+		DepthQuality averaged = average(this->interval);
+		if (metadata != nullptr) {
+			metadata->appendRecord("depth_quality", { { "timestamp_ms", SessionMetadata::number(this->intervalStart) },
+													  { "frames", SessionMetadata::number(static_cast<double>(averaged.frames)) },
+													  { "fill_rate", SessionMetadata::number(averaged.fillRate) },
+													  { "out_of_range", SessionMetadata::number(averaged.outOfRange) },
+													  { "temporal_noise_mm", SessionMetadata::number(averaged.temporalNoiseMm) } });
+		}
+		this->interval = DepthQuality();
+		this->intervalStart = timestamp;
+	}
+}
+
+const DepthQuality& DepthQualityMonitor::current() const {
+	return this->latest;
+}
+
+string DepthQualityMonitor::describe() const {
+	ostringstream text;
+	text << std::fixed << std::setprecision(0)
+		 << "Depth fill " << this->latest.fillRate * 100.0 << "%, out of range " << this->latest.outOfRange * 100.0 << "%, noise "
+		 << std::setprecision(1) << this->latest.temporalNoiseMm << " mm";
+	return text.str();
+}
+
+void DepthQualityMonitor::report(SessionMetadata& metadata) const {
+	if (this->session.frames == 0) {
+		return;
+	}
+	DepthQuality averaged = average(this->session);
+	metadata.setField("depth_quality_frames", SessionMetadata::number(static_cast<double>(averaged.frames)));
+	metadata.setField("depth_quality_fill_rate", SessionMetadata::number(averaged.fillRate));
+	metadata.setField("depth_quality_worst_fill_rate", SessionMetadata::number(this->worstFillRate));
+	metadata.setField("depth_quality_out_of_range", SessionMetadata::number(averaged.outOfRange));
+	metadata.setField("depth_quality_temporal_noise_mm", SessionMetadata::number(averaged.temporalNoiseMm));
+	metadata.setField("depth_quality_stride", SessionMetadata::number(this->stride));
+	metadata.setField("depth_quality_us_per_frame", SessionMetadata::number(this->sessionCostMicroseconds / averaged.frames));
+}
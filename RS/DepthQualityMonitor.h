@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <librealsense2/rs.hpp>
+#include "SessionMetadata.h"
+
+#ifndef DEPTHQUALITYMONITOR_H
+#define DEPTHQUALITYMONITOR_H
+
+using namespace std;
+
+// Averages over one reporting interval, or over the session.
+struct DepthQuality {
+	double fillRate = 0.0;				// Share of sampled pixels with depth.
+	double outOfRange = 0.0;			// Share of those with depth outside minDepth to maxDepth.
+	double temporalNoiseMm = 0.0;		// Mean standard deviation over time of the settled grid points.
+	long long frames = 0;
+};
+
+/*
+Depth quality of the raw Z16 frames while recording, from every stride-th
+pixel of every stride-th row. Each grid point keeps an exponentially
+weighted mean and variance of its depth, about the last 1 / noiseWeight
+frames; points count towards the temporal noise once they have had depth
+that long, a point losing depth starts over. In a still scene the noise is
+the sensor's own, movement adds to it.
+
+The time per frame is measured, and while it stays above the budget the
+stride doubles, so the monitor never costs the preview loop more than it
+was given.
+*/
+class DepthQualityMonitor
+{
+	private:
+		int stride = 8;
+		int maxStride = 64;
+		double budgetMicroseconds = 500.0;
+		float intervalSeconds = 10.0f;
+		float noiseWeight = 0.1f;
+		float depthScale = 0.001f;
+		uint16_t minUnits = 0;
+		uint16_t maxUnits = 0;
+
+		// Per grid point, row major at the current stride.
+		int width = 0;
+		int height = 0;
+		vector<float> mean;
+		vector<float> variance;
+		vector<uint16_t> history;
+
+		DepthQuality latest;
+		DepthQuality interval;
+		DepthQuality session;
+		double worstFillRate = 1.0;
+		double intervalStart = -1.0;			// Frame timestamp in ms.
+
+		double costMicroseconds = 0.0;
+		double sessionCostMicroseconds = 0.0;
+		int costFrames = 0;
+
+		void resizeGrid(int frameWidth, int frameHeight);
+		static void accumulate(DepthQuality& total, const DepthQuality& frame);
+		static DepthQuality average(const DepthQuality& total);
+
+	public:
+		DepthQualityMonitor();
+		void configure(int stride, double budgetMicroseconds, float intervalSeconds, float depthScale, float minDepth, float maxDepth);
+		void reset();
+		void update(const rs2::depth_frame& frame, SessionMetadata* metadata);
+		const DepthQuality& current() const;
+		string describe() const;
+		void report(SessionMetadata& metadata) const;
+};
+
+#endif // !
@@ -0,0 +1,285 @@
+#include "DepthReprocessor.h"
+
+#include <direct.h>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+#include "Utilities.h"
+#include "ThreadPool.h"
+#include "FrameJournal.h"
+#include "PointCloudExporter.h"
+#include <opencv-3.4/modules/videoio/include/opencv2/videoio/videoio_c.h>
+
+DepthReprocessor::DepthReprocessor(string sessionDir, string filterFile, unsigned int threadCount, string container) {
+	if (!sessionDir.empty() && sessionDir.back() != '/' && sessionDir.back() != '\\') {
+		sessionDir += "/";
+	}
+	this->sessionDir = sessionDir;
+	this->outputDir = sessionDir + "reprocessed/";
+	this->container = container;
+	this->threadCount = threadCount == 0 ? max(1u, std::thread::hardware_concurrency()) : threadCount;
+
+	double value;
+	if (readJsonNumber(this->sessionDir + "session_metadata.json", "min_depth_m", value)) {
+		this->recordedMinDepth = static_cast<float>(value);
+	}
+	if (readJsonNumber(this->sessionDir + "session_metadata.json", "max_depth_m", value)) {
+		this->recordedMaxDepth = static_cast<float>(value);
+	}
+	if (readJsonNumber(this->sessionDir + "depth_parameters.json", "depth_scale", value)) {
+		this->depthScale = static_cast<float>(value);
+	}
+
+	// The recorded range unless the filter file says otherwise.
+	this->filters.minDepth = this->recordedMinDepth;
+	this->filters.maxDepth = this->recordedMaxDepth;
+	if (!filterFile.empty() && !loadDepthFilterSettings(filterFile, this->filters)) {
+		std::cerr << "Can't read " << filterFile << ", using the default filter settings." << endl;
+	}
+}
+
+vector<ReprocessSegment> DepthReprocessor::listSegments() {
+	vector<ReprocessSegment> segments;
+
+	for (int videoID = 1; ; ++videoID) {
+		ReprocessSegment segment;
+		segment.videoID = videoID;
+
+		string raw = this->sessionDir + "depth_raw/" + to_string(videoID) + ".rsj";
+		vector<string> colorized = { ".mp4", ".avi", ".rsj" };
+
+		if (isPathExist(raw)) {
+			segment.filename = raw;
+			segment.raw = true;
+		}
+		else {
+			for (const string& extension : colorized) {
+				string candidate = this->sessionDir + "depth/" + to_string(videoID) + extension;
+				if (isPathExist(candidate)) {
+					segment.filename = candidate;
+					break;
+				}
+			}
+		}
+
+		if (segment.filename.empty()) {
+			break;
+		}
+		segments.push_back(segment);
+	}
+
+	return segments;
+}
+
+// The filters don't use the intrinsics, but the stream needs some; the recorded ones when the size matches.
+rs2_intrinsics DepthReprocessor::intrinsicsFor(cv::Size frameSize) {
+	vector<string> candidates = { "intrinsics_color.json", "intrinsics_depth.json" };
+	for (const string& candidate : candidates) {
+		rs2_intrinsics intrinsics;
+		if (readIntrinsics(this->sessionDir + candidate, intrinsics)
+			&& intrinsics.width == frameSize.width && intrinsics.height == frameSize.height) {
+			return intrinsics;
+		}
+	}
+
+	rs2_intrinsics intrinsics = {};
+	intrinsics.width = frameSize.width;
+	intrinsics.height = frameSize.height;
+	intrinsics.ppx = frameSize.width / 2.0f;
+	intrinsics.ppy = frameSize.height / 2.0f;
+	intrinsics.fx = static_cast<float>(frameSize.width);
+	intrinsics.fy = static_cast<float>(frameSize.width);
+	intrinsics.model = RS2_DISTORTION_NONE;
+	return intrinsics;
+}
+
+void DepthReprocessor::toDepthUnits(const cv::Mat& colorized, cv::Mat& depth) const {
+	cv::Mat meters(colorized.rows, colorized.cols, CV_32FC1);
+	for (int y = 0; y < colorized.rows; ++y) {
+		decodeColorizedDepthRow(colorized.ptr<unsigned char>(y), meters.ptr<float>(y), colorized.cols, this->recordedMinDepth, this->recordedMaxDepth);
+	}
+	meters.convertTo(depth, CV_16UC1, 1.0 / this->depthScale);
+}
+
+void DepthReprocessor::processSegment(const ReprocessSegment& segment) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Input, either a journal or a video.
+	bool isJournal = segment.filename.compare(segment.filename.size() - 4, 4, ".rsj") == 0;
+	FrameJournalReader journal;
+	cv::VideoCapture capture;
+	size_t journalPosition = 0;
+	float fps = 0.0f;
+
+	if (isJournal ? !journal.open(segment.filename) : !capture.open(segment.filename)) {
+		std::cerr << "Failed to open " << segment.filename << endl;
+		return;
+	}
+	fps = isJournal ? journal.frameRate() : static_cast<float>(capture.get(cv::CAP_PROP_FPS));
+	if (fps <= 0.0f) {
+		fps = 6.0f;
+	}
+
+	cv::Mat image, depth;
+	auto readDepth = [&](double& timestamp) {
+		if (isJournal) {
+			if (journalPosition >= journal.size() || !journal.read(journalPosition, image)) {
+				return false;
+			}
+			timestamp = journal.entries()[journalPosition].timestamp;
+			journalPosition++;
+		}
+		else {
+			if (!capture.read(image)) {
+				return false;
+			}
+			timestamp = capture.get(cv::CAP_PROP_POS_MSEC);
+		}
+
+		if (segment.raw) {
+			depth = image;
+		}
+		else {
+			this->toDepthUnits(image, depth);
+		}
+		return !depth.empty() && depth.type() == CV_16UC1;
+	};
+
+	double timestamp = 0.0;
+	if (!readDepth(timestamp)) {
+		std::cerr << segment.filename << " holds no readable depth." << endl;
+		return;
+	}
+	cv::Size frameSize = depth.size();
+
+	// Output
+	string extension = this->container == "journal" ? ".rsj" : ".mp4";
+	string filename = this->outputDir + to_string(segment.videoID) + extension;
+	cv::VideoWriter writer;
+	FrameJournal journalWriter;
+	if (this->container == "journal") {
+		journalWriter.open(filename, frameSize, fps, JOURNAL_PNG, 90);
+	}
+	else {
+		writer.open(filename, CV_FOURCC('m', 'p', '4', 'v'), fps, frameSize, true);
+	}
+	if (!(this->container == "journal" ? journalWriter.isOpened() : writer.isOpened())) {
+		std::cerr << "Failed to open " << filename << " for segment " << segment.videoID << "." << endl;
+		return;
+	}
+
+	// A software device turns the images back into SDK frames for the filters.
+	rs2::software_device device;
+	rs2::software_sensor sensor = device.add_sensor("Depth");
+	sensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, this->depthScale);
+	sensor.add_read_only_option(RS2_OPTION_STEREO_BASELINE, this->filters.stereoBaselineMm);
+
+	rs2_video_stream stream = {};
+	stream.type = RS2_STREAM_DEPTH;
+	stream.index = 0;
+	stream.uid = segment.videoID;
+	stream.width = frameSize.width;
+	stream.height = frameSize.height;
+	stream.fps = static_cast<int>(fps + 0.5f);
+	stream.bpp = 2;
+	stream.fmt = RS2_FORMAT_Z16;
+	stream.intrinsics = this->intrinsicsFor(frameSize);
+	rs2::stream_profile profile = sensor.add_video_stream(stream);
+
+	rs2::frame_queue frames(1, true);
+	sensor.open(profile);
+	sensor.start(frames);
+
+	DepthFilterChain chain(this->filters);
+
+	int frameNumber = 0;
+	int written = 0;		// Frames that reached the output, a replay that timed out is skipped.
+	do {
+		// The SDK may hold on to the pixels after on_video_frame returns, so every frame gets its own copy.
+		size_t bytes = depth.total() * depth.elemSize();
+		uint16_t* pixels = new uint16_t[depth.total()];
+		if (depth.isContinuous()) {
+			std::memcpy(pixels, depth.data, bytes);
+		}
+		else {
+			cv::Mat packed(depth.size(), CV_16UC1, pixels);
+			depth.copyTo(packed);
+		}
+
+		rs2_software_video_frame softwareFrame = {};
+		softwareFrame.pixels = pixels;
+		softwareFrame.deleter = [](void* data) { delete[] static_cast<uint16_t*>(data); };
+		softwareFrame.stride = frameSize.width * 2;
+		softwareFrame.bpp = 2;
+		softwareFrame.timestamp = timestamp;
+		softwareFrame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+		softwareFrame.frame_number = frameNumber++;
+		softwareFrame.profile = profile.get();
+		softwareFrame.depth_units = this->depthScale;
+		sensor.on_video_frame(softwareFrame);
+
+		rs2::frame replayed;
+		if (!frames.try_wait_for_frame(&replayed, 1000)) {
+			std::cerr << "Replayed frame " << frameNumber << " of " << segment.filename << " never arrived." << endl;
+			continue;
+		}
+
+		cv::Mat colorized = frame_to_mat(chain.process(replayed));
+		if (this->container == "journal") {
+			journalWriter.write(colorized, timestamp);
+		}
+		else {
+			writer.write(colorized);
+		}
+		written++;
+	} while (readDepth(timestamp));
+
+	writer.release();
+	journalWriter.close();
+	sensor.stop();
+	sensor.close();
+
+	std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->framesWritten += written;
+	std::cout << "Segment " << segment.videoID << (segment.raw ? " (raw)" : "") << ": " << written << " of " << frameNumber << " frames in "
+			  << elapsed.count() << " seconds, " << written / max(elapsed.count(), 1e-3f) << " frames/s." << endl;
+}
+
+bool DepthReprocessor::run() {
+	vector<ReprocessSegment> segments = this->listSegments();
+	if (segments.empty()) {
+		std::cerr << "No depth segments found in " << this->sessionDir << endl;
+		return false;
+	}
+
+	if (!isPathExist(this->outputDir) && _mkdir(this->outputDir.c_str()) != 0) {
+		std::cerr << "Failed to create directory for:" << this->outputDir << endl;
+		return false;
+	}
+
+	std::cout << "Re-processing " << segments.size() << " depth segments with " << this->threadCount << " threads, range "
+			  << this->filters.minDepth << " - " << this->filters.maxDepth << " m." << endl;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	double startCpu = processCpuSeconds();
+
+	{
+		ThreadPool pool(this->threadCount, this->threadCount);
+		for (const ReprocessSegment& segment : segments) {
+			pool.submit([this, segment]() { this->processSegment(segment); });
+		}
+		pool.wait();
+	}
+
+	std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+	double cpuSeconds = processCpuSeconds() - startCpu;
+	float wall = max(elapsed.count(), 1e-3f);
+
+	std::cout << "Re-processed " << this->framesWritten << " frames in " << wall << " seconds: "
+			  << this->framesWritten / wall << " frames/s, " << this->framesWritten / wall / this->threadCount << " frames/s per thread, "
+			  << (cpuSeconds > 0.0 ? this->framesWritten / cpuSeconds : 0.0) << " frames per CPU second." << endl;
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "DepthFilterChain.h"
+
+#ifndef DEPTHREPROCESSOR_H
+#define DEPTHREPROCESSOR_H
+
+using namespace std;
+
+struct ReprocessSegment {
+	int videoID = 0;
+	string filename;
+	bool raw = false;				// depth_raw/N.rsj, otherwise colorized depth that is decoded first.
+};
+
+/*
+Offline tool that runs the depth of a recorded session through the filter
+chain again, with other settings, and writes <session>/reprocessed/N.mp4
+(or N.rsj). Frames are replayed through a software device so the very same
+SDK filters run. Segments are independent tasks on a thread pool, each
+with its own chain, so the temporal filter sees the frames of its segment
+in order (it starts cold at every segment, unlike during recording).
+Unfiltered depth_raw/ segments are used when the session has them,
+otherwise the colorized depth is decoded back to depth first.
+*/
+class DepthReprocessor
+{
+	private:
+		string sessionDir;
+		string outputDir;
+		string container;
+		unsigned int threadCount;
+		DepthFilterSettings filters;
+
+		// Of the recording, needed to decode colorized depth.
+		float recordedMinDepth = 0.19f;
+		float recordedMaxDepth = 7.0f;
+		float depthScale = 0.001f;
+
+		std::mutex lock;
+		unsigned long long framesWritten = 0;
+
+		vector<ReprocessSegment> listSegments();
+		rs2_intrinsics intrinsicsFor(cv::Size frameSize);
+		void toDepthUnits(const cv::Mat& colorized, cv::Mat& depth) const;
+		void processSegment(const ReprocessSegment& segment);
+
+	public:
+		DepthReprocessor(string sessionDir, string filterFile, unsigned int threadCount, string container);
+		bool run();
+};
+
+#endif // !
@@ -0,0 +1,111 @@
+#include "ExposureSettler.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include "Utilities.h"
+
+ExposureSettler::ExposureSettler() {
+}
+
+ExposureSettler::ExposureSettler(const RecorderOptions& options) {
+	this->window = max(2, options.exposureSettleWindow);
+	this->exposureTolerance = options.exposureTolerance;
+	this->brightnessTolerance = options.brightnessTolerance;
+	this->timeoutSeconds = options.exposureSettleTimeout;
+}
+
+void ExposureSettler::push(deque<double>& values, double value) {
+	values.push_back(value);
+	while (values.size() > static_cast<size_t>(this->window)) {
+		values.pop_front();
+	}
+}
+
+// Stable when the spread of a full window is within the relative tolerance of its mean, or within the absolute one.
+bool ExposureSettler::isStable(const deque<double>& values, double relativeTolerance, double absoluteTolerance) const {
+	if (values.size() < static_cast<size_t>(this->window)) {
+		return false;
+	}
+
+	auto range = std::minmax_element(values.begin(), values.end());
+	double spread = *range.second - *range.first;
+	double mean = 0.0;
+	for (double value : values) {
+		mean += value;
+	}
+	mean /= values.size();
+
+	return spread <= absoluteTolerance || spread <= relativeTolerance * mean;
+}
+
+double ExposureSettler::brightness(const rs2::video_frame& colorFrame) {
+	cv::Mat colorImage(cv::Size(colorFrame.get_width(), colorFrame.get_height()), CV_8UC3,
+					   (void*)colorFrame.get_data(), colorFrame.get_stride_in_bytes());
+	cv::resize(colorImage, this->small, cv::Size(colorImage.cols / 8, colorImage.rows / 8), 0, 0, cv::INTER_AREA);
+	cv::cvtColor(this->small, this->gray, cv::COLOR_BGR2GRAY);
+	return cv::mean(this->gray)[0];
+}
+
+SettleResult ExposureSettler::settle(rs2::pipeline& pipeline, bool followColor, bool followDepth) {
+	return this->settle([&pipeline]() { return pipeline.wait_for_frames(10000); }, followColor, followDepth);
+}
+
+// nextFrameset may return an empty frameset when nothing arrived in time.
+SettleResult ExposureSettler::settle(std::function<rs2::frameset()> nextFrameset, bool followColor, bool followDepth) {
+	SettleResult result;
+	this->colorExposures.clear();
+	this->depthExposures.clear();
+	this->brightnesses.clear();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	while (true) {
+		std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - start;
+		result.seconds = elapsed.count();
+
+		if (result.seconds >= this->timeoutSeconds) {
+			std::cout << "Exposure did not settle within " << this->timeoutSeconds << " seconds, recording anyway." << endl;
+			break;
+		}
+
+		try {
+			rs2::frameset frameSet = nextFrameset();
+			if (!frameSet) {
+				continue;
+			}
+			result.frames++;
+
+			rs2::video_frame colorFrame = frameSet.get_color_frame();
+			rs2::depth_frame depthFrame = frameSet.get_depth_frame();
+
+			if (followColor && colorFrame) {
+				result.colorExposure = static_cast<double>(get_exposure_time(colorFrame));
+				result.colorBrightness = this->brightness(colorFrame);
+				this->push(this->colorExposures, result.colorExposure);
+				this->push(this->brightnesses, result.colorBrightness);
+			}
+			if (followDepth && depthFrame) {
+				result.depthExposure = static_cast<double>(get_exposure_time(depthFrame));
+				this->push(this->depthExposures, result.depthExposure);
+			}
+		}
+		catch (const rs2::error& e) {
+			std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+			continue;
+		}
+
+		bool colorSettled = !followColor || (this->isStable(this->colorExposures, this->exposureTolerance, 1.0) &&
+											 this->isStable(this->brightnesses, 0.0, this->brightnessTolerance));
+		bool depthSettled = !followDepth || this->isStable(this->depthExposures, this->exposureTolerance, 1.0);
+
+		if (colorSettled && depthSettled) {
+			result.converged = true;
+			std::cout << "Exposure settled after " << result.seconds << " seconds (" << result.frames << " framesets)." << endl;
+			break;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <functional>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "RecorderOptions.h"
+
+#ifndef EXPOSURESETTLER_H
+#define EXPOSURESETTLER_H
+
+using namespace std;
+
+struct SettleResult {
+	bool converged = false;
+	float seconds = 0.0f;
+	int frames = 0;
+	double colorExposure = 0.0;		// Microseconds, 0 when the camera doesn't report it.
+	double depthExposure = 0.0;
+	double colorBrightness = 0.0;	// Mean gray level of the color frame.
+};
+
+/*
+Streams frames until auto-exposure has settled, instead of waiting a fixed
+time. A sensor counts as settled once its reported exposure, and for color
+also the mean brightness, stayed within a tolerance over the last window of
+frames. The depth stream carries no image brightness, so only its exposure
+is followed.
+*/
+class ExposureSettler
+{
+	private:
+		int window = 15;
+		double exposureTolerance = 0.02;
+		double brightnessTolerance = 2.0;
+		float timeoutSeconds = 10.0f;
+
+		deque<double> colorExposures, depthExposures, brightnesses;
+		cv::Mat small, gray;
+
+		void push(deque<double>& values, double value);
+		bool isStable(const deque<double>& values, double relativeTolerance, double absoluteTolerance) const;
+		double brightness(const rs2::video_frame& colorFrame);
+
+	public:
+		ExposureSettler();
+		ExposureSettler(const RecorderOptions& options);
+		SettleResult settle(rs2::pipeline& pipeline, bool followColor, bool followDepth);
+		SettleResult settle(std::function<rs2::frameset()> nextFrameset, bool followColor, bool followDepth);
+};
+
+#endif // !
@@ -0,0 +1,221 @@
+#include "FrameJournal.h"
+
+#include <iostream>
+#include <algorithm>
+
+FrameJournal::FrameJournal() {
+}
+
+bool FrameJournal::open(const string& filename, cv::Size resolution, float fps, JournalCodec codec, int quality) {
+	this->close();
+
+	this->output.open(filename, std::ios::binary | std::ios::trunc);
+	if (!this->output.is_open()) {
+		std::cerr << "Failed to open journal " << filename << endl;
+		return false;
+	}
+
+	this->codec = codec;
+	this->quality = quality;
+	this->frameCount = 0;
+	this->flushInterval = max(1, static_cast<int>(fps));
+
+	int32_t width = resolution.width, height = resolution.height;
+	this->output.write("RSJ1", 4);
+	this->output.write(reinterpret_cast<const char*>(&width), sizeof(width));
+	this->output.write(reinterpret_cast<const char*>(&height), sizeof(height));
+	this->output.write(reinterpret_cast<const char*>(&fps), sizeof(fps));
+	this->output.write(reinterpret_cast<const char*>(&this->codec), sizeof(this->codec));
+	this->output.flush();
+	return true;
+}
+
+bool FrameJournal::isOpened() const {
+	return this->output.is_open();
+}
+
+void FrameJournal::write(const cv::Mat& image, double timestamp) {
+	if (!this->output.is_open()) {
+		return;
+	}
+
+	if (this->codec == JOURNAL_PNG) {
+		cv::imencode(".png", image, this->encoded, { cv::IMWRITE_PNG_COMPRESSION, 1 });
+	}
+	else {
+		cv::imencode(".jpg", image, this->encoded, { cv::IMWRITE_JPEG_QUALITY, this->quality });
+	}
+
+	uint32_t size = static_cast<uint32_t>(this->encoded.size());
+	uint32_t checksum = crc32Checksum(this->encoded.data(), this->encoded.size());
+
+	this->output.write("FRAM", 4);
+	this->output.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	this->output.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+	this->output.write(reinterpret_cast<const char*>(&this->frameCount), sizeof(this->frameCount));
+	this->output.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+	this->output.write(reinterpret_cast<const char*>(this->encoded.data()), size);
+	this->frameCount++;
+
+	// Hand the data to the OS about once a second, a crash of the process then loses at most that much.
+	if (this->frameCount % this->flushInterval == 0) {
+		this->output.flush();
+	}
+}
+
+void FrameJournal::close() {
+	if (!this->output.is_open()) {
+		return;
+	}
+
+	this->output.write("DONE", 4);
+	this->output.write(reinterpret_cast<const char*>(&this->frameCount), sizeof(this->frameCount));
+	this->output.close();
+}
+
+
+FrameJournalReader::FrameJournalReader() {
+}
+
+bool FrameJournalReader::open(const string& filename) {
+	this->index.clear();
+	this->closed = false;
+
+	this->input.open(filename, std::ios::binary);
+	if (!this->input.is_open()) {
+		return false;
+	}
+
+	this->input.seekg(0, std::ios::end);
+	this->fileBytes = static_cast<uint64_t>(this->input.tellg());
+	this->input.seekg(0, std::ios::beg);
+
+	char magic[4];
+	int32_t width = 0, height = 0;
+	this->input.read(magic, 4);
+	this->input.read(reinterpret_cast<char*>(&width), sizeof(width));
+	this->input.read(reinterpret_cast<char*>(&height), sizeof(height));
+	this->input.read(reinterpret_cast<char*>(&this->fps), sizeof(this->fps));
+	this->input.read(reinterpret_cast<char*>(&this->codec), sizeof(this->codec));
+
+	if (!this->input || string(magic, 4) != "RSJ1") {
+		std::cerr << filename << " is not a frame journal." << endl;
+		return false;
+	}
+	this->resolution = cv::Size(width, height);
+	this->validBytes = static_cast<uint64_t>(this->input.tellg());
+
+	while (true) {
+		if (!this->input.read(magic, 4)) {
+			break;
+		}
+
+		if (string(magic, 4) == "DONE") {
+			uint32_t count = 0;
+			this->closed = this->input.read(reinterpret_cast<char*>(&count), sizeof(count)) && count == this->index.size();
+			if (this->closed) {
+				this->validBytes = static_cast<uint64_t>(this->input.tellg());
+			}
+			break;
+		}
+		if (string(magic, 4) != "FRAM") {
+			break;
+		}
+
+		JournalEntry entry;
+		uint32_t checksum = 0;
+		this->input.read(reinterpret_cast<char*>(&entry.size), sizeof(entry.size));
+		this->input.read(reinterpret_cast<char*>(&entry.timestamp), sizeof(entry.timestamp));
+		this->input.read(reinterpret_cast<char*>(&entry.frameIndex), sizeof(entry.frameIndex));
+		this->input.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
+		if (!this->input) {
+			break;
+		}
+
+		entry.offset = static_cast<uint64_t>(this->input.tellg());
+		if (entry.offset + entry.size > this->fileBytes) {
+			break;
+		}
+
+		this->payload.resize(entry.size);
+		if (!this->input.read(reinterpret_cast<char*>(this->payload.data()), entry.size) ||
+			crc32Checksum(this->payload.data(), this->payload.size()) != checksum) {
+			break;
+		}
+
+		this->index.push_back(entry);
+		this->validBytes = entry.offset + entry.size;
+	}
+
+	this->input.clear();
+	return true;
+}
+
+bool FrameJournalReader::read(size_t position, cv::Mat& image) {
+	if (position >= this->index.size()) {
+		return false;
+	}
+
+	const JournalEntry& entry = this->index[position];
+	this->payload.resize(entry.size);
+	this->input.seekg(static_cast<std::streamoff>(entry.offset), std::ios::beg);
+	if (!this->input.read(reinterpret_cast<char*>(this->payload.data()), entry.size)) {
+		this->input.clear();
+		return false;
+	}
+
+	// Raw depth is a 16 bit PNG and stays 16 bit.
+	image = cv::imdecode(this->payload, cv::IMREAD_UNCHANGED);
+	return !image.empty();
+}
+
+size_t FrameJournalReader::size() const {
+	return this->index.size();
+}
+
+const vector<JournalEntry>& FrameJournalReader::entries() const {
+	return this->index;
+}
+
+cv::Size FrameJournalReader::frameSize() const {
+	return this->resolution;
+}
+
+float FrameJournalReader::frameRate() const {
+	return this->fps;
+}
+
+bool FrameJournalReader::finalised() const {
+	return this->closed;
+}
+
+uint64_t FrameJournalReader::readableBytes() const {
+	return this->validBytes;
+}
+
+uint64_t FrameJournalReader::totalBytes() const {
+	return this->fileBytes;
+}
+
+static vector<uint32_t> crcTable() {
+	vector<uint32_t> table(256);
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t value = i;
+		for (int bit = 0; bit < 8; ++bit) {
+			value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+		}
+		table[i] = value;
+	}
+	return table;
+}
+
+// Standard CRC-32 (IEEE 802.3), as used by zip and PNG.
+uint32_t crc32Checksum(const unsigned char* data, size_t length) {
+	static const vector<uint32_t> table = crcTable();	// Initialised once, also with several writer threads.
+
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < length; ++i) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFu;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include "opencv2/opencv.hpp"
+
+#ifndef FRAMEJOURNAL_H
+#define FRAMEJOURNAL_H
+
+using namespace std;
+
+/*
+Append-only segment container that stays readable when the recorder dies
+mid-segment, the alternative to N.mp4 that needs its index written at the
+end. Every frame is a self-contained record, so everything up to the last
+complete record can be read back and closing a segment costs one small
+record whatever its length.
+
+N.rsj, little endian:
+	header	char[4] "RSJ1", int32 width, int32 height, float fps, uint32 codec (0 JPEG, 1 PNG, 8 or 16 bit)
+	record	char[4] "FRAM", uint32 payload size, double timestamp (ms), uint32 frame index,
+			uint32 CRC-32 of the payload, then the encoded image
+	end		char[4] "DONE", uint32 frame count, written by close()
+*/
+enum JournalCodec {
+	JOURNAL_JPEG = 0,
+	JOURNAL_PNG = 1
+};
+
+class FrameJournal
+{
+	private:
+		ofstream output;
+		uint32_t codec = JOURNAL_JPEG;
+		int quality = 90;
+		uint32_t frameCount = 0;
+		int flushInterval = 30;
+		vector<unsigned char> encoded;
+
+	public:
+		FrameJournal();
+		bool open(const string& filename, cv::Size resolution, float fps, JournalCodec codec, int quality);
+		bool isOpened() const;
+		void write(const cv::Mat& image, double timestamp);
+		void close();
+};
+
+struct JournalEntry {
+	uint64_t offset = 0;			// Of the payload.
+	uint32_t size = 0;
+	double timestamp = 0.0;
+	uint32_t frameIndex = 0;
+};
+
+/*
+Indexes a journal on open by walking the record headers and checking every
+payload's CRC, stopping at the first torn or corrupt record.
+*/
+class FrameJournalReader
+{
+	private:
+		ifstream input;
+		vector<JournalEntry> index;
+		cv::Size resolution;
+		float fps = 0.0f;
+		uint32_t codec = JOURNAL_JPEG;
+		bool closed = false;
+		uint64_t validBytes = 0;
+		uint64_t fileBytes = 0;
+		vector<unsigned char> payload;
+
+	public:
+		FrameJournalReader();
+		bool open(const string& filename);
+		bool read(size_t position, cv::Mat& image);
+		size_t size() const;
+		const vector<JournalEntry>& entries() const;
+		cv::Size frameSize() const;
+		float frameRate() const;
+		bool finalised() const;
+		uint64_t readableBytes() const;
+		uint64_t totalBytes() const;
+};
+
+uint32_t crc32Checksum(const unsigned char* data, size_t length);
+
+#endif // !
@@ -0,0 +1,97 @@
+#include "FrameRingBuffer.h"
+
+#include <iostream>
+
+FrameRingBuffer::FrameRingBuffer() {
+}
+
+FrameRingBuffer::FrameRingBuffer(float seconds, size_t budgetBytes, bool compress, int quality) {
+	this->spanMs = seconds * 1000.0;
+	this->budgetBytes = budgetBytes;
+	this->compress = compress;
+	this->quality = quality;
+}
+
+size_t FrameRingBuffer::entryBytes(const Entry& entry) {
+	return entry.encoded.empty() ? entry.image.total() * entry.image.elemSize() : entry.encoded.size();
+}
+
+void FrameRingBuffer::dropOldest() {
+	this->usedBytes -= entryBytes(this->entries.front());
+	this->entries.pop_front();
+}
+
+void FrameRingBuffer::push(double timestamp, const cv::Mat& image) {
+	Entry entry;
+	entry.timestamp = timestamp;
+
+	if (this->compress && image.depth() == CV_8U) {
+		cv::imencode(".jpg", image, entry.encoded, { cv::IMWRITE_JPEG_QUALITY, this->quality });
+	}
+	else {
+		entry.image = image.clone();
+	}
+
+	size_t size = entryBytes(entry);
+	if (this->budgetBytes > 0 && size > this->budgetBytes) {
+		this->budgetTruncated = true;
+		return;
+	}
+
+	this->usedBytes += size;
+	this->entries.push_back(std::move(entry));
+
+	while (!this->entries.empty() && this->entries.front().timestamp < timestamp - this->spanMs) {
+		this->dropOldest();
+	}
+	while (this->budgetBytes > 0 && this->usedBytes > this->budgetBytes) {
+		this->dropOldest();
+		this->budgetTruncated = true;
+	}
+}
+
+// Hands out the images oldest first and empties the buffer.
+void FrameRingBuffer::drain(const std::function<void(double, const cv::Mat&)>& write) {
+	for (const Entry& entry : this->entries) {
+		if (entry.encoded.empty()) {
+			write(entry.timestamp, entry.image);
+		}
+		else {
+			write(entry.timestamp, cv::imdecode(entry.encoded, cv::IMREAD_COLOR));
+		}
+	}
+	this->clear();
+}
+
+void FrameRingBuffer::clear() {
+	this->entries.clear();
+	this->usedBytes = 0;
+}
+
+bool FrameRingBuffer::empty() const {
+	return this->entries.empty();
+}
+
+size_t FrameRingBuffer::size() const {
+	return this->entries.size();
+}
+
+size_t FrameRingBuffer::bytes() const {
+	return this->usedBytes;
+}
+
+bool FrameRingBuffer::truncated() const {
+	return this->budgetTruncated;
+}
+
+// From the oldest image to the newest.
+float FrameRingBuffer::heldSeconds() const {
+	if (this->entries.empty()) {
+		return 0.0f;
+	}
+	return static_cast<float>((this->entries.back().timestamp - this->entries.front().timestamp) / 1000.0);
+}
+
+float FrameRingBuffer::spanSeconds() const {
+	return static_cast<float>(this->spanMs / 1000.0);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <functional>
+#include "opencv2/opencv.hpp"
+
+#ifndef FRAMERINGBUFFER_H
+#define FRAMERINGBUFFER_H
+
+using namespace std;
+
+/*
+The last few seconds of encoder input images, bounded both in time and in
+bytes. Images are deep copies (or JPEG encoded, which is about a tenth of the
+size) since SDK frames belong to a small frame pool that must not be held.
+When the budget is reached the oldest images are dropped first, and
+truncated() tells from then on that the buffer holds less than its span.
+*/
+class FrameRingBuffer
+{
+	private:
+		struct Entry {
+			double timestamp;
+			cv::Mat image;
+			vector<unsigned char> encoded;
+		};
+
+		deque<Entry> entries;
+		double spanMs = 2000.0;
+		size_t budgetBytes = 0;
+		size_t usedBytes = 0;
+		bool compress = false;
+		int quality = 90;
+		bool budgetTruncated = false;
+
+		static size_t entryBytes(const Entry& entry);
+		void dropOldest();
+
+	public:
+		FrameRingBuffer();
+		FrameRingBuffer(float seconds, size_t budgetBytes, bool compress, int quality);
+		void push(double timestamp, const cv::Mat& image);
+		void drain(const std::function<void(double, const cv::Mat&)>& write);
+		void clear();
+		bool empty() const;
+		size_t size() const;
+		size_t bytes() const;
+		bool truncated() const;
+		float heldSeconds() const;
+		float spanSeconds() const;
+};
+
+#endif // !
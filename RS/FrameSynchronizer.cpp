@@ -0,0 +1,133 @@
+#include "FrameSynchronizer.h"
+
+#include <iostream>
+#include <cmath>
+
+FrameSynchronizer::FrameSynchronizer(string colorDirectory, float toleranceMs, float retainSeconds, SessionMetadata* metadata) {
+	this->colorDirectory = colorDirectory;
+	this->toleranceMs = toleranceMs;
+	this->retainMs = retainSeconds * 1000.0;
+	this->metadata = metadata;
+}
+
+// Called by the writer threads for every frame they put into a segment.
+void FrameSynchronizer::report(const string& stream, int segment, uint32_t index, double timestamp) {
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	SegmentFrame frame;
+	frame.segment = segment;
+	frame.index = index;
+	frame.timestamp = timestamp;
+
+	if (stream == "depth") {
+		this->pendingDepth.push_back(frame);
+	}
+	else {
+		this->colorFrames.push_back(frame);
+		while (!this->colorFrames.empty() && this->colorFrames.front().timestamp < timestamp - this->retainMs) {
+			this->colorFrames.pop_front();
+		}
+	}
+
+	this->resolve(false);
+}
+
+// A depth frame is settled once color has passed it by more than the tolerance, or at the end.
+void FrameSynchronizer::resolve(bool everything) {
+	while (!this->pendingDepth.empty()) {
+		const SegmentFrame& depth = this->pendingDepth.front();
+
+		if (!everything && (this->colorFrames.empty() || this->colorFrames.back().timestamp <= depth.timestamp + this->toleranceMs)) {
+			return;
+		}
+
+		const SegmentFrame* closest = nullptr;
+		for (const SegmentFrame& color : this->colorFrames) {
+			if (closest == nullptr || std::fabs(color.timestamp - depth.timestamp) < std::fabs(closest->timestamp - depth.timestamp)) {
+				closest = &color;
+			}
+			else if (color.timestamp > depth.timestamp) {
+				break;
+			}
+		}
+
+		if (closest != nullptr && std::fabs(closest->timestamp - depth.timestamp) <= this->toleranceMs) {
+			this->writePair(*closest, depth);
+		}
+		else {
+			this->unmatched++;
+		}
+		this->pendingDepth.pop_front();
+	}
+}
+
+void FrameSynchronizer::writePair(const SegmentFrame& color, const SegmentFrame& depth) {
+	if (!this->pairsFile.is_open() || this->pairsSegment != color.segment) {
+		this->pairsFile.close();
+		this->pairsSegment = color.segment;
+
+		string filename = this->colorDirectory + to_string(color.segment) + ".pairs";
+		bool exists = std::ifstream(filename).good();
+		this->pairsFile.open(filename, std::ios::binary | std::ios::app);
+		if (!exists) {
+			uint32_t version = 1;
+			this->pairsFile.write("RSPI", 4);
+			this->pairsFile.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		}
+	}
+
+	FramePair pair;
+	pair.colorIndex = color.index;
+	pair.depthSegment = static_cast<uint32_t>(depth.segment);
+	pair.depthIndex = depth.index;
+	pair.deltaMs = static_cast<float>(depth.timestamp - color.timestamp);
+	pair.colorTimestamp = color.timestamp;
+
+	this->pairsFile.write(reinterpret_cast<const char*>(&pair.colorIndex), sizeof(pair.colorIndex));
+	this->pairsFile.write(reinterpret_cast<const char*>(&pair.depthSegment), sizeof(pair.depthSegment));
+	this->pairsFile.write(reinterpret_cast<const char*>(&pair.depthIndex), sizeof(pair.depthIndex));
+	this->pairsFile.write(reinterpret_cast<const char*>(&pair.deltaMs), sizeof(pair.deltaMs));
+	this->pairsFile.write(reinterpret_cast<const char*>(&pair.colorTimestamp), sizeof(pair.colorTimestamp));
+
+	this->paired++;
+	this->absoluteDeltaSum += std::fabs(pair.deltaMs);
+}
+
+void FrameSynchronizer::finish() {
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	this->resolve(true);
+	this->pairsFile.close();
+
+	std::cout << "Paired " << this->paired << " depth frames with color, " << this->unmatched << " without a match." << endl;
+
+	if (this->metadata != nullptr) {
+		this->metadata->setField("paired_depth_frames", SessionMetadata::number(static_cast<double>(this->paired)));
+		this->metadata->setField("unpaired_depth_frames", SessionMetadata::number(static_cast<double>(this->unmatched)));
+		this->metadata->setField("pairing_tolerance_ms", SessionMetadata::number(this->toleranceMs));
+		if (this->paired > 0) {
+			this->metadata->setField("mean_pairing_delta_ms", SessionMetadata::number(this->absoluteDeltaSum / this->paired));
+		}
+	}
+}
+
+bool FrameSynchronizer::loadPairs(const string& filename, vector<FramePair>& pairs) {
+	ifstream input(filename, std::ios::binary);
+	char magic[4];
+	uint32_t version = 0;
+	input.read(magic, 4);
+	input.read(reinterpret_cast<char*>(&version), sizeof(version));
+	if (!input || string(magic, 4) != "RSPI") {
+		return false;
+	}
+
+	FramePair pair;
+	while (input.read(reinterpret_cast<char*>(&pair.colorIndex), sizeof(pair.colorIndex)) &&
+		   input.read(reinterpret_cast<char*>(&pair.depthSegment), sizeof(pair.depthSegment)) &&
+		   input.read(reinterpret_cast<char*>(&pair.depthIndex), sizeof(pair.depthIndex)) &&
+		   input.read(reinterpret_cast<char*>(&pair.deltaMs), sizeof(pair.deltaMs)) &&
+		   input.read(reinterpret_cast<char*>(&pair.colorTimestamp), sizeof(pair.colorTimestamp))) {
+		pairs.push_back(pair);
+	}
+	return true;
+}
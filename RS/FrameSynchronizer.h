@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+#include "SessionMetadata.h"
+
+#ifndef FRAMESYNCHRONIZER_H
+#define FRAMESYNCHRONIZER_H
+
+using namespace std;
+
+struct SegmentFrame {
+	int segment = 0;
+	uint32_t index = 0;				// Position in the segment file.
+	double timestamp = 0.0;			// Sensor timestamp in milliseconds.
+};
+
+struct FramePair {
+	uint32_t colorIndex = 0;
+	uint32_t depthSegment = 0;
+	uint32_t depthIndex = 0;
+	float deltaMs = 0.0f;			// Depth minus color timestamp.
+	double colorTimestamp = 0.0;
+};
+
+/*
+Pairs every written depth frame with the written color frame closest in
+sensor timestamp, within a tolerance. The writers report each frame as it
+goes into a segment, from their own threads, and depth waits until color
+has caught up past it.
+
+color/N.pairs, little endian: char[4] "RSPI", uint32 version, then per pair
+uint32 color index, uint32 depth segment, uint32 depth index,
+float depth - color delta (ms), double color timestamp (ms).
+Pairs go to the file of the color segment they belong to.
+*/
+class FrameSynchronizer
+{
+	private:
+		string colorDirectory;
+		SessionMetadata* metadata = nullptr;
+		double toleranceMs = 17.0;
+		double retainMs = 3000.0;
+
+		std::mutex lock;
+		deque<SegmentFrame> colorFrames;
+		deque<SegmentFrame> pendingDepth;
+
+		ofstream pairsFile;
+		int pairsSegment = 0;
+		unsigned long long paired = 0;
+		unsigned long long unmatched = 0;
+		double absoluteDeltaSum = 0.0;
+
+		void resolve(bool everything);
+		void writePair(const SegmentFrame& color, const SegmentFrame& depth);
+
+	public:
+		FrameSynchronizer(string colorDirectory, float toleranceMs, float retainSeconds, SessionMetadata* metadata);
+		void report(const string& stream, int segment, uint32_t index, double timestamp);
+		void finish();
+
+		static bool loadPairs(const string& filename, vector<FramePair>& pairs);
+};
+
+#endif // !
@@ -0,0 +1,268 @@
+#include "ImuRecorder.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+ImuRing::ImuRing() {
+}
+
+// Rounded up to a power of two so an index maps to a slot with a mask. Not while samples flow.
+void ImuRing::reset(size_t capacity) {
+	size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	this->slots.assign(size, ImuSample());
+	this->mask = size - 1;
+	this->head = 0;
+	this->tail = 0;
+}
+
+bool ImuRing::push(const ImuSample& sample) {
+	size_t head = this->head.load(std::memory_order_relaxed);
+	size_t tail = this->tail.load(std::memory_order_acquire);
+	if (head - tail >= this->slots.size()) {
+		return false;
+	}
+	this->slots[head & this->mask] = sample;
+	this->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+size_t ImuRing::pop(ImuSample* samples, size_t count) {
+	size_t tail = this->tail.load(std::memory_order_relaxed);
+	size_t head = this->head.load(std::memory_order_acquire);
+	size_t available = min(count, head - tail);
+	for (size_t i = 0; i < available; ++i) {
+		samples[i] = this->slots[(tail + i) & this->mask];
+	}
+	this->tail.store(tail + available, std::memory_order_release);
+	return available;
+}
+
+size_t ImuRing::capacity() const {
+	return this->slots.size();
+}
+
+ImuRecorder::ImuRecorder() {
+}
+
+ImuRecorder::~ImuRecorder() {
+	this->stop();
+}
+
+bool ImuRecorder::findMotionSensor(const rs2::device& device, rs2::sensor& sensor) {
+	for (rs2::sensor candidate : device.query_sensors()) {
+		if (candidate.is<rs2::motion_sensor>()) {
+			sensor = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+Picks the gyro and accelerometer profiles closest to the requested rates,
+0 asks for the highest. Motion profiles come as MOTION_XYZ32F.
+*/
+bool ImuRecorder::start(rs2::sensor sensor, const string& filename, int gyroFps, int accelFps, size_t ringSamples, unsigned int batchMs) {
+	if (this->running) {
+		return false;
+	}
+
+	vector<rs2::stream_profile> chosen;
+	for (rs2_stream type : { RS2_STREAM_GYRO, RS2_STREAM_ACCEL }) {
+		int wanted = type == RS2_STREAM_GYRO ? gyroFps : accelFps;
+		rs2::stream_profile best;
+		bool found = false;
+		for (const rs2::stream_profile& profile : sensor.get_stream_profiles()) {
+			if (profile.stream_type() != type || profile.format() != RS2_FORMAT_MOTION_XYZ32F) {
+				continue;
+			}
+			bool better = !found || (wanted <= 0 ? profile.fps() > best.fps() : std::abs(profile.fps() - wanted) < std::abs(best.fps() - wanted));
+			if (better) {
+				best = profile;
+				found = true;
+			}
+		}
+		if (found) {
+			chosen.push_back(best);
+		}
+	}
+	if (chosen.empty()) {
+		std::cerr << "The motion sensor has no gyro or accelerometer profile." << endl;
+		return false;
+	}
+
+	this->output.open(filename, std::ios::binary | std::ios::trunc);
+	if (!this->output.is_open()) {
+		std::cerr << "Failed to open IMU file " << filename << endl;
+		return false;
+	}
+	uint32_t version = 1;
+	uint32_t recordSize = sizeof(ImuSample);
+	this->output.write("RSIM", 4);
+	this->output.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	this->output.write(reinterpret_cast<const char*>(&recordSize), sizeof(recordSize));
+
+	this->ring.reset(max<size_t>(1024, ringSamples));
+	this->batchMs = max(10u, batchMs);
+	this->gyroSamples = 0;
+	this->accelSamples = 0;
+	this->droppedSamples = 0;
+	this->timestampDomain = -1;
+	this->batches = 0;
+	this->largestBatch = 0;
+	for (int i = 0; i < 2; ++i) {
+		this->firstTimestamp[i] = -1.0;
+		this->lastTimestamp[i] = 0.0;
+	}
+
+	this->running = true;
+	this->worker = std::thread(&ImuRecorder::workerLoop, this);
+
+	try {
+		this->sensor = sensor;
+		this->sensor.open(chosen);
+		this->sensor.start([this](rs2::frame frame) { this->onFrame(frame); });
+		this->sensorStarted = true;
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+		this->stop();
+		return false;
+	}
+
+	for (const rs2::stream_profile& profile : chosen) {
+		std::cout << "Recording " << profile.stream_name() << " at " << profile.fps() << " Hz." << endl;
+	}
+	return true;
+}
+
+// The SDK's sensor thread, nothing here may block, allocate or print.
+void ImuRecorder::onFrame(const rs2::frame& frame) {
+	rs2::motion_frame motion = frame;
+	if (!motion) {
+		return;
+	}
+
+	rs2_vector data = motion.get_motion_data();
+	ImuSample sample;
+	sample.timestamp = motion.get_timestamp();
+	sample.x = data.x;
+	sample.y = data.y;
+	sample.z = data.z;
+	sample.stream = motion.get_profile().stream_type() == RS2_STREAM_GYRO ? IMU_GYRO : IMU_ACCEL;
+
+	if (!this->ring.push(sample)) {
+		this->droppedSamples++;
+		return;
+	}
+	if (this->timestampDomain < 0) {
+		this->timestampDomain = static_cast<int>(motion.get_frame_timestamp_domain());
+	}
+	(sample.stream == IMU_GYRO ? this->gyroSamples : this->accelSamples)++;
+}
+
+size_t ImuRecorder::writeBatch(vector<ImuSample>& batch) {
+	batch.resize(batch.capacity());
+	size_t count = this->ring.pop(batch.data(), batch.size());
+	if (count == 0) {
+		return 0;
+	}
+
+	this->output.write(reinterpret_cast<const char*>(batch.data()), static_cast<std::streamsize>(count * sizeof(ImuSample)));
+	for (size_t i = 0; i < count; ++i) {
+		const ImuSample& sample = batch[i];
+		if (this->firstTimestamp[sample.stream] < 0.0) {
+			this->firstTimestamp[sample.stream] = sample.timestamp;
+		}
+		this->lastTimestamp[sample.stream] = sample.timestamp;
+	}
+	this->batches++;
+	this->largestBatch = max(this->largestBatch, static_cast<long long>(count));
+	return count;
+}
+
+void ImuRecorder::workerLoop() {
+	if (this->placement.isSet()) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	vector<ImuSample> batch;
+	batch.reserve(this->ring.capacity());
+	auto lastFlush = std::chrono::steady_clock::now();
+
+	while (this->running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(this->batchMs));
+		this->writeBatch(batch);
+
+		// About once a second, so a crash loses little.
+		if (std::chrono::steady_clock::now() - lastFlush > std::chrono::seconds(1)) {
+			this->output.flush();
+			lastFlush = std::chrono::steady_clock::now();
+		}
+	}
+
+	// The sensor is stopped by now, the rest of the ring goes out.
+	while (this->writeBatch(batch) > 0) {
+	}
+}
+
+void ImuRecorder::stop() {
+	if (this->sensorStarted) {
+		try {
+			this->sensor.stop();
+			this->sensor.close();
+		}
+		catch (const rs2::error& e) {
+			std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+		}
+		this->sensorStarted = false;
+	}
+
+	if (!this->running) {
+		return;
+	}
+	this->running = false;
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	this->output.close();
+}
+
+void ImuRecorder::setPlacement(const ThreadPlacement& placement) {
+	this->placement = placement;
+}
+
+long long ImuRecorder::samples() const {
+	return this->gyroSamples + this->accelSamples;
+}
+
+long long ImuRecorder::dropped() const {
+	return this->droppedSamples;
+}
+
+size_t ImuRecorder::ringBytes() const {
+	return this->ring.capacity() * sizeof(ImuSample);
+}
+
+// Effective rates from the sensor timestamps, after stop().
+void ImuRecorder::report(SessionMetadata& metadata) const {
+	auto rate = [this](int stream, long long samples) {
+		double span = (this->lastTimestamp[stream] - this->firstTimestamp[stream]) / 1000.0;
+		return samples > 1 && span > 0.0 ? (samples - 1) / span : 0.0;
+	};
+
+	metadata.setField("imu_file", SessionMetadata::text("imu.bin"));
+	metadata.setField("imu_gyro_samples", SessionMetadata::number(static_cast<double>(this->gyroSamples.load())));
+	metadata.setField("imu_accel_samples", SessionMetadata::number(static_cast<double>(this->accelSamples.load())));
+	metadata.setField("imu_gyro_hz", SessionMetadata::number(rate(IMU_GYRO, this->gyroSamples)));
+	metadata.setField("imu_accel_hz", SessionMetadata::number(rate(IMU_ACCEL, this->accelSamples)));
+	metadata.setField("imu_dropped_samples", SessionMetadata::number(static_cast<double>(this->droppedSamples.load())));
+	metadata.setField("imu_batches", SessionMetadata::number(static_cast<double>(this->batches)));
+	metadata.setField("imu_largest_batch", SessionMetadata::number(static_cast<double>(this->largestBatch)));
+	metadata.setField("imu_timestamp_domain", SessionMetadata::number(this->timestampDomain));
+}
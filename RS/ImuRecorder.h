@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <librealsense2/rs.hpp>
+#include "SessionMetadata.h"
+#include "ThreadPlacement.h"
+
+#ifndef IMURECORDER_H
+#define IMURECORDER_H
+
+using namespace std;
+
+enum ImuStream : uint32_t { IMU_GYRO = 0, IMU_ACCEL = 1 };
+
+// One record of imu.bin, 24 bytes.
+struct ImuSample {
+	double timestamp;		// Sensor timestamp in milliseconds.
+	float x, y, z;			// rad/s for the gyro, m/s^2 for the accelerometer.
+	uint32_t stream;		// ImuStream.
+};
+
+/*
+Single producer, single consumer ring of samples. push never blocks and
+never allocates, a full ring drops the new sample. The two indices sit on
+their own cache lines so the SDK's thread and the writer don't share one.
+*/
+class ImuRing
+{
+	private:
+		vector<ImuSample> slots;
+		size_t mask = 0;
+		alignas(64) std::atomic<size_t> head{ 0 };		// Next slot to fill, only the producer writes it.
+		alignas(64) std::atomic<size_t> tail{ 0 };		// Next slot to read, only the consumer writes it.
+
+	public:
+		ImuRing();
+		void reset(size_t capacity);
+		bool push(const ImuSample& sample);
+		size_t pop(ImuSample* samples, size_t count);
+		size_t capacity() const;
+};
+
+/*
+Gyro and accelerometer at their full rate, from the motion sensor opened
+on its own next to the pipeline. The sensor's callback only copies the
+sample into the ring; a writer thread wakes every batchMs and appends
+whatever accumulated to imu.bin with a single write, so the rate of the IMU
+never reaches the capture path or the disk as single samples. Any
+rs2::sensor with motion profiles works, a software_sensor or a playback
+device's sensor as well as a camera's.
+
+imu.bin, little endian: char[4] "RSIM", uint32 version, uint32 record size,
+then ImuSample records in arrival order, gyro and accelerometer interleaved.
+*/
+class ImuRecorder
+{
+	private:
+		rs2::sensor sensor;
+		bool sensorStarted = false;
+		ImuRing ring;
+		ofstream output;
+		std::thread worker;
+		std::atomic<bool> running{ false };
+		unsigned int batchMs = 250;
+		ThreadPlacement placement;
+
+		std::atomic<long long> gyroSamples{ 0 };
+		std::atomic<long long> accelSamples{ 0 };
+		std::atomic<long long> droppedSamples{ 0 };
+		std::atomic<int> timestampDomain{ -1 };
+		long long batches = 0;
+		long long largestBatch = 0;
+		double firstTimestamp[2] = { -1.0, -1.0 };
+		double lastTimestamp[2] = { 0.0, 0.0 };
+
+		void onFrame(const rs2::frame& frame);
+		void workerLoop();
+		size_t writeBatch(vector<ImuSample>& batch);
+
+	public:
+		ImuRecorder();
+		~ImuRecorder();
+		bool start(rs2::sensor sensor, const string& filename, int gyroFps, int accelFps, size_t ringSamples, unsigned int batchMs);
+		void stop();
+		void setPlacement(const ThreadPlacement& placement);
+		long long samples() const;
+		long long dropped() const;
+		size_t ringBytes() const;
+		void report(SessionMetadata& metadata) const;
+
+		static bool findMotionSensor(const rs2::device& device, rs2::sensor& sensor);
+};
+
+#endif // !
@@ -0,0 +1,229 @@
+#include "JitterBenchmark.h"
+
+#include <direct.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cmath>
+
+#include "Utilities.h"
+#include "WriterStatistics.h"
+#include "WriterSettings.h"
+#include "SessionMetadata.h"
+
+JitterBenchmark::JitterBenchmark(string outputDir, float trialSeconds, int loadThreads, const RecorderOptions& options) {
+	this->outputDir = outputDir;
+	this->trialSeconds = trialSeconds;
+	this->loadThreads = max(0, loadThreads);
+	this->options = options;
+	loadStreamProfile(outputDir + "stream_profile.cfg", this->profile);
+}
+
+JitterTrial JitterBenchmark::runTrial(const string& name, bool placed) {
+	JitterTrial trial;
+	trial.name = name;
+
+	RecorderPlacement placement;
+	if (placed) {
+		placement = recorderPlacement(this->options);
+		std::cout << setProcessPriority(this->options.processPriority) << endl;
+		std::cout << "Thread placement " << placement.capture.apply() << endl;
+	}
+
+	rs2::pipeline pipeline;
+	rs2::config config;
+	config.enable_stream(RS2_STREAM_DEPTH, 0, this->profile.depthWidth, this->profile.depthHeight, RS2_FORMAT_Z16, this->profile.depthFps);
+	config.enable_stream(RS2_STREAM_COLOR, 0, this->profile.colorWidth, this->profile.colorHeight, RS2_FORMAT_BGR8, this->profile.colorFps);
+
+	try {
+		pipeline.start(config);
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Could not start " << this->profile.describe() << " (" << e.what() << ")" << endl;
+		return trial;
+	}
+	trial.started = true;
+
+	std::chrono::high_resolution_clock Clock;
+
+	// A camera that delivers nothing fails the trial, and with it the benchmark.
+	try {
+		auto warmUpStart = Clock.now();
+		while (std::chrono::duration<float>(Clock.now() - warmUpStart).count() < 1.0f) {
+			pipeline.wait_for_frames(10000);
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error during the " << name << " trial: " << e.what() << endl;
+		trial.started = false;
+		pipeline.stop();
+		return trial;
+	}
+
+	string trialDir = this->outputDir + "jitter_benchmark/";
+	if (!isPathExist(trialDir)) {
+		_mkdir(trialDir.c_str());
+	}
+
+	rs2::frame_queue depthFramesQueue(2);
+	rs2::frame_queue colorFramesQueue(2);
+	WriterStatistics depthStatistics;
+	WriterStatistics colorStatistics;
+
+	WriterSettings depthSettings;
+	depthSettings.imageType = "depth";
+	depthSettings.directory = trialDir + name + "_depth_";
+	depthSettings.baseDirectory = this->outputDir;
+	depthSettings.individualVideoLength = this->trialSeconds + 60.0f;
+	depthSettings.fps = static_cast<float>(this->profile.depthFps);
+	depthSettings.resolution = cv::Size(this->profile.colorWidth, this->profile.colorHeight);
+	depthSettings.fourcc = this->profile.fourcc;
+	depthSettings.queueTimeoutMs = 1000;
+	depthSettings.statistics = &depthStatistics;
+	depthSettings.placement = placement.writer;
+
+	WriterSettings colorSettings = depthSettings;
+	colorSettings.imageType = "color";
+	colorSettings.directory = trialDir + name + "_color_";
+	colorSettings.fps = static_cast<float>(this->profile.colorFps);
+	colorSettings.statistics = &colorStatistics;
+
+	std::thread depthSavingThread(writeFrames, depthFramesQueue, depthSettings);
+	std::thread colorSavingThread(writeFrames, colorFramesQueue, colorSettings);
+
+	// Competing load, left to the OS in both trials.
+	std::atomic<bool> loadRunning{ true };
+	vector<std::thread> load;
+	for (int i = 0; i < this->loadThreads; ++i) {
+		load.emplace_back([&loadRunning]() {
+			volatile double sink = 0.0;
+			while (loadRunning) {
+				for (int j = 0; j < 10000; ++j) {
+					sink = sink + std::sqrt(static_cast<double>(j));
+				}
+			}
+		});
+	}
+
+	rs2::align alignTo(RS2_STREAM_COLOR);
+	rs2::frameset frameSet;
+	unsigned long long lastColorNumber = 0;
+	unsigned long long lastDepthNumber = 0;
+	vector<double> intervals;
+	intervals.reserve(static_cast<size_t>(this->trialSeconds * this->profile.colorFps) + 1);
+
+	auto trialStart = Clock.now();
+	auto lastArrival = trialStart;
+
+	try {
+		while (std::chrono::duration<float>(Clock.now() - trialStart).count() < this->trialSeconds) {
+			frameSet = pipeline.wait_for_frames(10000);
+
+			auto arrival = Clock.now();
+			if (trial.frameSets > 0) {
+				intervals.push_back(std::chrono::duration<double, std::milli>(arrival - lastArrival).count());
+			}
+			lastArrival = arrival;
+
+			rs2::frame colorFrame = frameSet.get_color_frame();
+			rs2::frame depthFrame = frameSet.get_depth_frame();
+			if (lastColorNumber != 0 && colorFrame.get_frame_number() > lastColorNumber + 1) {
+				trial.sensorDrops += colorFrame.get_frame_number() - lastColorNumber - 1;
+			}
+			if (lastDepthNumber != 0 && depthFrame.get_frame_number() > lastDepthNumber + 1) {
+				trial.sensorDrops += depthFrame.get_frame_number() - lastDepthNumber - 1;
+			}
+			lastColorNumber = colorFrame.get_frame_number();
+			lastDepthNumber = depthFrame.get_frame_number();
+
+			// The same work the recorder does on the capture thread.
+			frameSet = alignTo.process(frameSet);
+			depthFramesQueue.enqueue(frameSet.get_depth_frame());
+			colorFramesQueue.enqueue(frameSet.get_color_frame());
+			trial.frameSets++;
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error during the " << name << " trial: " << e.what() << endl;
+	}
+
+	loadRunning = false;
+	for (std::thread& thread : load) {
+		thread.join();
+	}
+	depthSavingThread.join();
+	colorSavingThread.join();
+	pipeline.stop();
+
+	if (!intervals.empty()) {
+		double sum = 0.0, squaredSum = 0.0;
+		for (double interval : intervals) {
+			sum += interval;
+			squaredSum += interval * interval;
+		}
+		trial.meanIntervalMs = sum / intervals.size();
+		trial.stdIntervalMs = std::sqrt(max(0.0, squaredSum / intervals.size() - trial.meanIntervalMs * trial.meanIntervalMs));
+
+		std::sort(intervals.begin(), intervals.end());
+		trial.p99IntervalMs = intervals[min(intervals.size() - 1, intervals.size() * 99 / 100)];
+		trial.maxIntervalMs = intervals.back();
+	}
+	return trial;
+}
+
+void JitterBenchmark::printTrial(const JitterTrial& trial) {
+	std::cout << trial.name << ": ";
+
+	if (!trial.started) {
+		std::cout << "did not start" << endl;
+		return;
+	}
+
+	std::cout << trial.frameSets << " framesets, interval " << trial.meanIntervalMs << " ms"
+			  << ", std " << trial.stdIntervalMs << " ms"
+			  << ", p99 " << trial.p99IntervalMs << " ms"
+			  << ", max " << trial.maxIntervalMs << " ms"
+			  << ", sensor drops " << trial.sensorDrops << endl;
+}
+
+bool JitterBenchmark::run() {
+	std::cout << "Jitter benchmark, " << this->profile.describe() << ", " << this->trialSeconds << " seconds per trial, "
+			  << this->loadThreads << " load threads." << endl;
+
+	// The placed trial runs last, a pinned capture thread can't be reliably unpinned.
+	JitterTrial unplaced = this->runTrial("unplaced", false);
+	this->printTrial(unplaced);
+	JitterTrial placed = this->runTrial("placed", true);
+	this->printTrial(placed);
+
+	if (!unplaced.started || !placed.started) {
+		return false;
+	}
+
+	SessionMetadata results;
+	results.setFile(this->outputDir + "jitter_benchmark.json");
+	results.setField("stream_profile", SessionMetadata::text(this->profile.describe()));
+	results.setField("trial_seconds", SessionMetadata::number(this->trialSeconds));
+	results.setField("load_threads", SessionMetadata::number(this->loadThreads));
+
+	RecorderPlacement placement = recorderPlacement(this->options);
+	results.setField("placement", "{\"capture\": " + SessionMetadata::text(placement.capture.describe()) +
+					 ", \"writer\": " + SessionMetadata::text(placement.writer.describe()) + "}");
+
+	for (const JitterTrial* trial : { &unplaced, &placed }) {
+		results.appendRecord("trials", { { "name", SessionMetadata::text(trial->name) },
+										 { "framesets", SessionMetadata::number(static_cast<double>(trial->frameSets)) },
+										 { "sensor_drops", SessionMetadata::number(static_cast<double>(trial->sensorDrops)) },
+										 { "mean_interval_ms", SessionMetadata::number(trial->meanIntervalMs) },
+										 { "std_interval_ms", SessionMetadata::number(trial->stdIntervalMs) },
+										 { "p99_interval_ms", SessionMetadata::number(trial->p99IntervalMs) },
+										 { "max_interval_ms", SessionMetadata::number(trial->maxIntervalMs) } });
+	}
+
+	std::cout << "Interval std " << unplaced.stdIntervalMs << " -> " << placed.stdIntervalMs << " ms, p99 "
+			  << unplaced.p99IntervalMs << " -> " << placed.p99IntervalMs << " ms." << endl;
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <librealsense2/rs.hpp>
+#include "RecorderOptions.h"
+#include "StreamProfile.h"
+#include "ThreadPlacement.h"
+
+#ifndef JITTERBENCHMARK_H
+#define JITTERBENCHMARK_H
+
+using namespace std;
+
+struct JitterTrial {
+	string name;
+	bool started = false;
+	unsigned long long frameSets = 0;
+	unsigned long long sensorDrops = 0;
+	double meanIntervalMs = 0.0;
+	double stdIntervalMs = 0.0;
+	double p99IntervalMs = 0.0;
+	double maxIntervalMs = 0.0;
+};
+
+/*
+Records the same short session twice, once with every thread left to the
+OS and once with the thread placement from recorder_options.cfg, and
+compares how regularly the capture loop receives framesets. Busy threads
+on every core stand in for whatever else runs on the machine. The result
+goes to jitter_benchmark.json in the recordings directory.
+*/
+class JitterBenchmark
+{
+	private:
+		string outputDir;
+		float trialSeconds;
+		int loadThreads;
+		RecorderOptions options;
+		StreamProfile profile;
+
+		JitterTrial runTrial(const string& name, bool placed);
+		void printTrial(const JitterTrial& trial);
+
+	public:
+		JitterBenchmark(string outputDir, float trialSeconds, int loadThreads, const RecorderOptions& options);
+		bool run();
+};
+
+#endif // !
@@ -0,0 +1,82 @@
+#include "JournalRecovery.h"
+
+#include <iostream>
+#include <fstream>
+
+#include "FrameJournal.h"
+#include "Utilities.h"
+
+JournalRecovery::JournalRecovery(string sessionDir) {
+	if (!sessionDir.empty() && sessionDir.back() != '/' && sessionDir.back() != '\\') {
+		sessionDir += "/";
+	}
+	this->sessionDir = sessionDir;
+}
+
+int JournalRecovery::recoverStream(const string& stream) {
+	int segments = 0;
+
+	for (int videoID = 1; ; ++videoID) {
+		string base = this->sessionDir + stream + "/" + to_string(videoID);
+		if (!isPathExist(base + ".rsj")) {
+			break;
+		}
+		segments++;
+
+		FrameJournalReader reader;
+		if (!reader.open(base + ".rsj")) {
+			std::cerr << "Skipping unreadable " << base << ".rsj" << endl;
+			continue;
+		}
+
+		ofstream indexFile(base + ".idx", std::ios::binary | std::ios::trunc);
+		uint32_t count = static_cast<uint32_t>(reader.size());
+		indexFile.write("RSJI", 4);
+		indexFile.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		for (const JournalEntry& entry : reader.entries()) {
+			indexFile.write(reinterpret_cast<const char*>(&entry.offset), sizeof(entry.offset));
+			indexFile.write(reinterpret_cast<const char*>(&entry.size), sizeof(entry.size));
+			indexFile.write(reinterpret_cast<const char*>(&entry.timestamp), sizeof(entry.timestamp));
+		}
+		indexFile.close();
+
+		uint64_t lostBytes = reader.totalBytes() - reader.readableBytes();
+		std::cout << stream << " " << videoID << ": " << count << " frames" << (reader.finalised() ? "" : ", not closed")
+				  << (lostBytes > 0 ? ", " + to_string(lostBytes) + " bytes after the last complete frame" : "") << endl;
+
+		MetadataRecord record = {
+			{ "stream", SessionMetadata::text(stream) },
+			{ "segment", SessionMetadata::number(videoID) },
+			{ "frames", SessionMetadata::number(count) },
+			{ "finalised", reader.finalised() ? "true" : "false" },
+			{ "readable_bytes", SessionMetadata::number(static_cast<double>(reader.readableBytes())) },
+			{ "lost_bytes", SessionMetadata::number(static_cast<double>(lostBytes)) }
+		};
+		if (count > 0) {
+			record.push_back({ "first_timestamp_ms", SessionMetadata::number(reader.entries().front().timestamp) });
+			record.push_back({ "last_timestamp_ms", SessionMetadata::number(reader.entries().back().timestamp) });
+		}
+		this->summary.appendRecord("segments", record);
+	}
+
+	return segments;
+}
+
+bool JournalRecovery::run() {
+	this->summary.setFile(this->sessionDir + "recovery_index.json");
+
+	int segments = 0;
+	// depth_raw/ is a journal whatever segment_container says.
+	for (const string& stream : { "color", "depth", "context", "depth_raw", "ir_left", "ir_right" }) {
+		segments += this->recoverStream(stream);
+	}
+
+	if (segments == 0) {
+		std::cerr << "No journal segments found in " << this->sessionDir << endl;
+		return false;
+	}
+
+	this->summary.setField("journal_segments", SessionMetadata::number(segments));
+	std::cout << "Indexed " << segments << " segments, see " << this->sessionDir << "recovery_index.json" << endl;
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include "SessionMetadata.h"
+
+#ifndef JOURNALRECOVERY_H
+#define JOURNALRECOVERY_H
+
+using namespace std;
+
+/*
+Offline tool for sessions recorded with segment_container = journal. Every
+N.rsj is checked record by record and gets an N.idx next to it (payload
+offset, size and timestamp of each readable frame), nothing is re-encoded.
+A summary of all segments goes to <session>/recovery_index.json.
+
+N.idx, little endian: char[4] "RSJI", uint32 count,
+then uint64 offset, uint32 size, double timestamp (ms) per frame.
+*/
+class JournalRecovery
+{
+	private:
+		string sessionDir;
+		SessionMetadata summary;
+
+		int recoverStream(const string& stream);
+
+	public:
+		JournalRecovery(string sessionDir);
+		bool run();
+};
+
+#endif // !
@@ -0,0 +1,437 @@
+#include "KernelBenchmark.h"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+
+#include "Utilities.h"
+#include "DepthFilterChain.h"
+#include "SessionMetadata.h"
+#include "ImuRecorder.h"
+#include "DepthQualityMonitor.h"
+#include "RecorderOptions.h"
+#include <opencv-3.4/modules/videoio/include/opencv2/videoio/videoio_c.h>
+
+KernelBenchmark::KernelBenchmark(string outputFile, string workDir, float secondsPerKernel, string nameFilter) {
+	this->outputFile = outputFile;
+	this->workDir = workDir;
+	this->secondsPerKernel = max(0.1f, secondsPerKernel);
+	this->nameFilter = nameFilter;
+	loadStreamProfile(workDir + "stream_profile.cfg", this->profile);
+
+	RecorderOptions options;
+	loadRecorderOptions(workDir + "recorder_options.cfg", options);
+	this->infraredFourcc = options.infraredFourcc;
+}
+
+// Pinhole intrinsics from the D435 field of view, close enough for alignment to do its usual work.
+static rs2_intrinsics syntheticIntrinsics(int width, int height, float horizontalFov, float verticalFov) {
+	const float degrees = 3.14159265f / 180.0f;
+	rs2_intrinsics intrinsics = {};
+	intrinsics.width = width;
+	intrinsics.height = height;
+	intrinsics.ppx = width / 2.0f;
+	intrinsics.ppy = height / 2.0f;
+	intrinsics.fx = width / 2.0f / std::tan(horizontalFov / 2.0f * degrees);
+	intrinsics.fy = height / 2.0f / std::tan(verticalFov / 2.0f * degrees);
+	intrinsics.model = RS2_DISTORTION_NONE;
+	return intrinsics;
+}
+
+/*
+A tilted plane between 0.6 and 1 m with a few bumps, sensor noise and 3%
+holes for depth, a noisy gradient for color, dim shading for infrared. The RNG is seeded so every run
+benchmarks the same pixels.
+*/
+bool KernelBenchmark::createFrames(rs2::software_device& device) {
+	const int depthWidth = this->profile.depthWidth, depthHeight = this->profile.depthHeight;
+	const int colorWidth = this->profile.colorWidth, colorHeight = this->profile.colorHeight;
+	cv::RNG rng(42);
+
+	this->depthPixels.assign(static_cast<size_t>(depthWidth) * depthHeight, 0);
+	for (int y = 0; y < depthHeight; ++y) {
+		for (int x = 0; x < depthWidth; ++x) {
+			double depth = 600.0 + 400.0 * y / depthHeight + 30.0 * std::sin(x * 0.05) * std::cos(y * 0.04) + rng.gaussian(2.0);
+			this->depthPixels[static_cast<size_t>(y) * depthWidth + x] = rng.uniform(0.0, 1.0) < 0.03 ? 0 : static_cast<uint16_t>(depth);
+		}
+	}
+
+	cv::Mat color(colorHeight, colorWidth, CV_8UC3);
+	for (int y = 0; y < colorHeight; ++y) {
+		for (int x = 0; x < colorWidth; ++x) {
+			color.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(x * 255 / colorWidth), static_cast<uchar>(y * 255 / colorHeight), static_cast<uchar>(128 + rng.uniform(-20, 20)));
+		}
+	}
+	this->colorPixels.assign(color.data, color.data + color.total() * color.elemSize());
+	cv::Mat rgb;
+	cv::cvtColor(color, rgb, cv::COLOR_BGR2RGB);
+	this->rgbPixels.assign(rgb.data, rgb.data + rgb.total() * rgb.elemSize());
+
+	// Infrared with the emitter off: dim, smooth shading and sensor noise.
+	this->infraredPixels.assign(static_cast<size_t>(depthWidth) * depthHeight, 0);
+	for (int y = 0; y < depthHeight; ++y) {
+		for (int x = 0; x < depthWidth; ++x) {
+			double level = 70.0 + 40.0 * std::sin(x * 0.02) * std::cos(y * 0.03) + rng.gaussian(3.0);
+			this->infraredPixels[static_cast<size_t>(y) * depthWidth + x] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, level)));
+		}
+	}
+
+	rs2::software_sensor depthSensor = device.add_sensor("Depth");
+	depthSensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, 0.001f);
+	depthSensor.add_read_only_option(RS2_OPTION_STEREO_BASELINE, 50.0f);
+	rs2::software_sensor colorSensor = device.add_sensor("Color");
+	rs2::software_sensor rgbSensor = device.add_sensor("RGB");
+	rs2::software_sensor infraredSensor = device.add_sensor("Infrared");
+
+	rs2_video_stream depthStream = {};
+	depthStream.type = RS2_STREAM_DEPTH;
+	depthStream.uid = 0;
+	depthStream.width = depthWidth;
+	depthStream.height = depthHeight;
+	depthStream.fps = this->profile.depthFps;
+	depthStream.bpp = 2;
+	depthStream.fmt = RS2_FORMAT_Z16;
+	depthStream.intrinsics = syntheticIntrinsics(depthWidth, depthHeight, 87.0f, 58.0f);
+
+	rs2_video_stream colorStream = {};
+	colorStream.type = RS2_STREAM_COLOR;
+	colorStream.uid = 1;
+	colorStream.width = colorWidth;
+	colorStream.height = colorHeight;
+	colorStream.fps = this->profile.colorFps;
+	colorStream.bpp = 3;
+	colorStream.fmt = RS2_FORMAT_BGR8;
+	colorStream.intrinsics = syntheticIntrinsics(colorWidth, colorHeight, 69.0f, 42.0f);
+
+	rs2_video_stream rgbStream = colorStream;
+	rgbStream.uid = 2;
+	rgbStream.fmt = RS2_FORMAT_RGB8;
+
+	rs2_video_stream infraredStream = depthStream;
+	infraredStream.type = RS2_STREAM_INFRARED;
+	infraredStream.index = 1;
+	infraredStream.uid = 3;
+	infraredStream.bpp = 1;
+	infraredStream.fmt = RS2_FORMAT_Y8;
+
+	rs2::stream_profile depthProfile = depthSensor.add_video_stream(depthStream);
+	rs2::stream_profile colorProfile = colorSensor.add_video_stream(colorStream);
+	rs2::stream_profile rgbProfile = rgbSensor.add_video_stream(rgbStream);
+	rs2::stream_profile infraredProfile = infraredSensor.add_video_stream(infraredStream);
+	depthProfile.register_extrinsics_to(colorProfile, { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0.015f, 0, 0 } });
+	infraredProfile.register_extrinsics_to(depthProfile, { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } });
+	infraredProfile.register_extrinsics_to(colorProfile, { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0.015f, 0, 0 } });
+
+	// Depth and color go through a syncer to come out as one frameset for alignment.
+	device.create_matcher(RS2_MATCHER_DLR_C);
+	rs2::syncer sync;
+	rs2::frame_queue rgbFrames(1, true);
+	rs2::frame_queue infraredFrames(1, true);
+	depthSensor.open(depthProfile);
+	colorSensor.open(colorProfile);
+	rgbSensor.open(rgbProfile);
+	infraredSensor.open(infraredProfile);
+	depthSensor.start(sync);
+	colorSensor.start(sync);
+	rgbSensor.start(rgbFrames);
+	infraredSensor.start(infraredFrames);
+
+	// The buffers outlive the frames, the SDK doesn't have to free anything.
+	auto send = [](rs2::software_sensor& sensor, const rs2::stream_profile& profile, void* pixels, int stride, int bpp) {
+		rs2_software_video_frame softwareFrame = {};
+		softwareFrame.pixels = pixels;
+		softwareFrame.deleter = [](void*) {};
+		softwareFrame.stride = stride;
+		softwareFrame.bpp = bpp;
+		softwareFrame.timestamp = 1000.0;
+		softwareFrame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+		softwareFrame.frame_number = 1;
+		softwareFrame.profile = profile.get();
+		softwareFrame.depth_units = 0.001f;
+		sensor.on_video_frame(softwareFrame);
+	};
+	send(depthSensor, depthProfile, this->depthPixels.data(), depthWidth * 2, 2);
+	send(colorSensor, colorProfile, this->colorPixels.data(), colorWidth * 3, 3);
+	send(rgbSensor, rgbProfile, this->rgbPixels.data(), colorWidth * 3, 3);
+	send(infraredSensor, infraredProfile, this->infraredPixels.data(), depthWidth, 1);
+
+	try {
+		// The matcher may deliver depth and color separately before the pair.
+		for (int attempt = 0; attempt < 10 && !(this->frameSet && this->frameSet.size() == 2); ++attempt) {
+			this->frameSet = sync.wait_for_frames(1000);
+		}
+		this->rgbFrame = rgbFrames.wait_for_frame(1000);
+		this->infraredFrame = infraredFrames.wait_for_frame(1000);
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Synthetic frames never arrived (" << e.what() << ")" << endl;
+		return false;
+	}
+
+	this->depthFrame = this->frameSet.get_depth_frame();
+	this->colorFrame = this->frameSet.get_color_frame();
+	return this->depthFrame && this->colorFrame && this->rgbFrame && this->infraredFrame;
+}
+
+void KernelBenchmark::measure(const string& name, cv::Size resolution, size_t inputBytes, const std::function<void()>& kernel) {
+	if (!this->nameFilter.empty() && name.find(this->nameFilter) == string::npos) {
+		return;
+	}
+
+	KernelResult result;
+	result.name = name;
+	result.resolution = resolution;
+
+	try {
+		// Caches, the frame pool and lazy initialisation inside the SDK.
+		for (int i = 0; i < 3; ++i) {
+			kernel();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed(0.0);
+		while (elapsed.count() < this->secondsPerKernel || result.iterations < 5) {
+			kernel();
+			result.iterations++;
+			elapsed = std::chrono::steady_clock::now() - start;
+		}
+
+		result.nsPerFrame = elapsed.count() * 1e9 / result.iterations;
+		result.megabytesPerSecond = static_cast<double>(inputBytes) * result.iterations / elapsed.count() / 1e6;
+	}
+	catch (const rs2::error& e) {
+		std::cerr << name << " failed: " << e.what() << endl;
+		return;
+	}
+	catch (const cv::Exception& e) {
+		std::cerr << name << " failed: " << e.what() << endl;
+		return;
+	}
+
+	std::cout << name << " " << resolution.width << "x" << resolution.height << ": " << result.nsPerFrame / 1000.0 << " us/frame, "
+			  << result.megabytesPerSecond << " MB/s (" << result.iterations << " frames)" << endl;
+	this->results.push_back(result);
+}
+
+void KernelBenchmark::runKernels() {
+	cv::Size depthSize(this->profile.depthWidth, this->profile.depthHeight);
+	cv::Size colorSize(this->profile.colorWidth, this->profile.colorHeight);
+	size_t depthBytes = this->depthPixels.size() * sizeof(uint16_t);
+	size_t colorBytes = this->colorPixels.size();
+
+	// Results go to variables outside the kernels so nothing is optimised away.
+	cv::Mat image;
+	rs2::frame output;
+
+	this->measure("frame_to_mat_bgr8", colorSize, colorBytes, [&]() { image = frame_to_mat(this->colorFrame); });
+	this->measure("frame_to_mat_rgb8", colorSize, colorBytes, [&]() { image = frame_to_mat(this->rgbFrame); });
+	this->measure("frame_to_mat_z16", depthSize, depthBytes, [&]() { image = frame_to_mat(this->depthFrame); });
+	this->measure("frame_to_mat_y8", depthSize, this->infraredPixels.size(), [&]() { image = frame_to_mat(this->infraredFrame); });
+
+	cv::Mat rgb(colorSize, CV_8UC3, this->rgbPixels.data());
+	cv::Mat bgr;
+	this->measure("cvtColor_rgb2bgr", colorSize, colorBytes, [&]() { cv::cvtColor(rgb, bgr, cv::COLOR_RGB2BGR); });
+
+	// The depth quality grid at its default stride, with the budget out of the way.
+	DepthQualityMonitor depthQuality;
+	depthQuality.configure(8, 1e9, 10.0f, 0.001f, 0.19f, 7.0f);
+	rs2::depth_frame rawDepth = this->frameSet.get_depth_frame();
+	this->measure("depth_quality_grid_stride_8", depthSize, depthBytes / 64, [&]() { depthQuality.update(rawDepth, nullptr); });
+
+	rs2::align alignTo(RS2_STREAM_COLOR);
+	this->measure("align_depth_to_color", colorSize, depthBytes + colorBytes, [&]() { output = alignTo.process(this->frameSet); });
+	rs2::frame alignedDepth = alignTo.process(this->frameSet).as<rs2::frameset>().get_depth_frame();
+
+	// Aligned to depth, rs2::align reprojects every other video frame of the frameset, infrared included.
+	rs2::filter addInfrared([this](rs2::frame frame, rs2::frame_source& source) {
+		source.frame_ready(source.allocate_composite_frame({ this->depthFrame, this->colorFrame, this->infraredFrame }));
+	});
+	rs2::frameset withInfrared = addInfrared.process(this->frameSet);
+	rs2::filter alignInput = withoutInfrared();
+	rs2::align alignToDepth(RS2_STREAM_DEPTH);
+	size_t infraredBytes = this->infraredPixels.size();
+	this->measure("align_color_to_depth", depthSize, depthBytes + colorBytes, [&]() { output = alignToDepth.process(this->frameSet); });
+	this->measure("align_color_to_depth_with_infrared", depthSize, depthBytes + colorBytes + infraredBytes, [&]() { output = alignToDepth.process(withInfrared); });
+	this->measure("align_color_to_depth_infrared_removed", depthSize, depthBytes + colorBytes + infraredBytes, [&]() { output = alignToDepth.process(alignInput.process(withInfrared)); });
+	size_t alignedBytes = static_cast<size_t>(colorSize.area()) * sizeof(uint16_t);
+
+	// The writer chain filter by filter, each on the output of the one before it.
+	rs2::threshold_filter thresholdFilter;
+	thresholdFilter.set_option(RS2_OPTION_MIN_DISTANCE, 0.19f);
+	thresholdFilter.set_option(RS2_OPTION_MAX_DISTANCE, 7.0f);
+	rs2::disparity_transform depthToDisparity(true);
+	rs2::spatial_filter spatialFilter;
+	rs2::temporal_filter temporalFilter;
+	rs2::disparity_transform disparityToDepth(false);
+	rs2::colorizer colorizer;
+	colorizer.set_option(RS2_OPTION_HISTOGRAM_EQUALIZATION_ENABLED, 0);
+	colorizer.set_option(RS2_OPTION_COLOR_SCHEME, 9.0f);
+	colorizer.set_option(RS2_OPTION_MIN_DISTANCE, 0.19f);
+	colorizer.set_option(RS2_OPTION_MAX_DISTANCE, 7.0f);
+
+	rs2::frame thresholded = thresholdFilter.process(alignedDepth);
+	rs2::frame disparity = depthToDisparity.process(thresholded);
+	size_t disparityBytes = static_cast<size_t>(colorSize.area()) * sizeof(float);
+
+	this->measure("threshold_filter", colorSize, alignedBytes, [&]() { output = thresholdFilter.process(alignedDepth); });
+	this->measure("disparity_transform_to_disparity", colorSize, alignedBytes, [&]() { output = depthToDisparity.process(thresholded); });
+	this->measure("spatial_filter", colorSize, disparityBytes, [&]() { output = spatialFilter.process(disparity); });
+	this->measure("temporal_filter", colorSize, disparityBytes, [&]() { output = temporalFilter.process(disparity); });
+	this->measure("disparity_transform_to_depth", colorSize, disparityBytes, [&]() { output = disparityToDepth.process(disparity); });
+	this->measure("colorizer", colorSize, alignedBytes, [&]() { output = colorizer.process(alignedDepth); });
+
+	DepthFilterChain chain(0.19f, 7.0f);
+	this->measure("depth_filter_chain", colorSize, alignedBytes, [&]() { output = chain.process(alignedDepth); });
+
+	// The preview of VideoController::showVideo.
+	cv::Mat colorImage = frame_to_mat(this->colorFrame);
+	cv::Mat depthImage = frame_to_mat(chain.process(alignedDepth)).clone();
+	cv::Mat smallColor, smallDepth, blended;
+	cv::Size previewSize(1080, 720);
+	this->measure("resize_color_preview", colorSize, colorBytes, [&]() { cv::resize(colorImage, smallColor, previewSize, 0, 0, cv::INTER_LINEAR); });
+	this->measure("resize_depth_preview", colorSize, depthImage.total() * depthImage.elemSize(), [&]() { cv::resize(depthImage, smallDepth, previewSize, 0, 0, cv::INTER_LINEAR); });
+	cv::resize(colorImage, smallColor, previewSize, 0, 0, cv::INTER_LINEAR);
+	cv::resize(depthImage, smallDepth, previewSize, 0, 0, cv::INTER_LINEAR);
+	this->measure("addWeighted_preview", previewSize, smallColor.total() * smallColor.elemSize() * 2, [&]() { cv::addWeighted(smallColor, 1, smallDepth, 0.5, 0.0, blended); });
+
+	// The encoders of both writers, into a scratch file that is removed afterwards.
+	string fourcc = this->profile.fourcc;
+	string scratch = this->workDir + "kernel_benchmark" + videoExtension(fourcc);
+	for (const string& stream : { string("color"), string("depth") }) {
+		cv::Mat frame = stream == "color" ? colorImage : depthImage;
+		cv::VideoWriter writer(scratch, CV_FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3]), static_cast<double>(this->profile.colorFps), frame.size(), true);
+		if (!writer.isOpened()) {
+			std::cerr << "Could not open a " << fourcc << " writer for " << scratch << endl;
+			continue;
+		}
+		this->measure("videowriter_write_" + stream + "_" + fourcc, frame.size(), frame.total() * frame.elemSize(), [&]() { writer.write(frame); });
+		writer.release();
+	}
+	std::remove(scratch.c_str());
+
+	// Each infrared writer on top of the two above, one channel into the infrared codec.
+	string infraredFourcc = this->infraredFourcc;
+	string infraredScratch = this->workDir + "kernel_benchmark_infrared" + videoExtension(infraredFourcc);
+	cv::Mat infraredImage = frame_to_mat(this->infraredFrame);
+	cv::VideoWriter infraredWriter(infraredScratch, CV_FOURCC(infraredFourcc[0], infraredFourcc[1], infraredFourcc[2], infraredFourcc[3]), static_cast<double>(this->profile.depthFps), infraredImage.size(), false);
+	if (infraredWriter.isOpened()) {
+		this->measure("videowriter_write_infrared_" + infraredFourcc, infraredImage.size(), infraredImage.total(), [&]() { infraredWriter.write(infraredImage); });
+		infraredWriter.release();
+	}
+	else {
+		std::cerr << "Could not open a " << infraredFourcc << " writer for " << infraredScratch << endl;
+	}
+	std::remove(infraredScratch.c_str());
+}
+
+/*
+One motion frame from a software sensor into ImuRecorder, the callback's
+cost on the SDK's thread with the batch writer running beside it. Samples
+sent have to come back as written or dropped, never lost in between;
+false when some were.
+*/
+bool KernelBenchmark::runImuKernel() {
+	if (!this->nameFilter.empty() && string("imu_software_motion_frame").find(this->nameFilter) == string::npos) {
+		return true;
+	}
+
+	rs2::software_device device;
+	rs2::software_sensor motionSensor = device.add_sensor("Motion Module");
+
+	rs2_motion_stream gyroStream = {};
+	gyroStream.type = RS2_STREAM_GYRO;
+	gyroStream.uid = 10;
+	gyroStream.fps = 400;
+	gyroStream.fmt = RS2_FORMAT_MOTION_XYZ32F;
+	rs2_motion_stream accelStream = gyroStream;
+	accelStream.type = RS2_STREAM_ACCEL;
+	accelStream.uid = 11;
+	accelStream.fps = 200;
+	rs2::stream_profile gyroProfile = motionSensor.add_motion_stream(gyroStream);
+	rs2::stream_profile accelProfile = motionSensor.add_motion_stream(accelStream);
+
+	string scratch = this->workDir + "kernel_benchmark_imu.bin";
+	ImuRecorder recorder;
+	if (!recorder.start(motionSensor, scratch, gyroStream.fps, accelStream.fps, 16384, 250)) {
+		return false;
+	}
+
+	// Two gyro samples to every accelerometer one, as at 400 and 200 Hz.
+	float gyro[3] = { 0.01f, -0.02f, 0.005f };
+	float accel[3] = { 0.1f, -9.8f, 0.2f };
+	long long sent = 0;
+	auto send = [&]() {
+		bool isGyro = sent % 3 != 2;
+		rs2_software_motion_frame motionFrame = {};
+		motionFrame.data = isGyro ? gyro : accel;
+		motionFrame.deleter = [](void*) {};
+		motionFrame.timestamp = 1000.0 + sent * 5.0 / 3.0;
+		motionFrame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+		motionFrame.frame_number = static_cast<int>(sent);
+		motionFrame.profile = isGyro ? gyroProfile.get() : accelProfile.get();
+		motionSensor.on_motion_frame(motionFrame);
+		sent++;
+	};
+	this->measure("imu_software_motion_frame", cv::Size(3, 1), sizeof(ImuSample), send);
+
+	recorder.stop();
+	std::remove(scratch.c_str());
+	if (sent > 0 && recorder.samples() + recorder.dropped() != sent) {
+		std::cerr << "imu_software_motion_frame: " << sent << " samples sent, " << recorder.samples() << " written and " << recorder.dropped() << " dropped." << endl;
+		return false;
+	}
+	return true;
+}
+
+bool KernelBenchmark::writeResults() {
+	SessionMetadata report;
+	report.setFile(this->outputFile);
+	report.setField("opencv_version", SessionMetadata::text(CV_VERSION));
+	report.setField("librealsense_version", SessionMetadata::text(RS2_API_VERSION_STR));
+	report.setField("hardware_threads", SessionMetadata::number(std::thread::hardware_concurrency()));
+	report.setField("stream_profile", SessionMetadata::text(this->profile.describe()));
+	report.setField("seconds_per_kernel", SessionMetadata::number(this->secondsPerKernel));
+
+	for (const KernelResult& result : this->results) {
+		report.appendRecord("kernels", { { "name", SessionMetadata::text(result.name) },
+										 { "width", SessionMetadata::number(result.resolution.width) },
+										 { "height", SessionMetadata::number(result.resolution.height) },
+										 { "iterations", SessionMetadata::number(static_cast<double>(result.iterations)) },
+										 { "ns_per_frame", SessionMetadata::number(result.nsPerFrame) },
+										 { "mb_per_s", SessionMetadata::number(result.megabytesPerSecond) } });
+	}
+
+	std::cout << "Results written to " << this->outputFile << endl;
+	return !this->results.empty();
+}
+
+bool KernelBenchmark::run() {
+	std::cout << "Benchmarking per-frame kernels at " << this->profile.describe() << ", " << this->secondsPerKernel << " seconds each." << endl;
+
+	rs2::software_device device;
+	bool imuAccounted = true;
+	try {
+		if (!this->createFrames(device)) {
+			std::cerr << "Could not create the synthetic frames." << endl;
+			return false;
+		}
+		this->runKernels();
+		imuAccounted = this->runImuKernel();
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+	}
+
+	// Frames go back to the device before it is destroyed.
+	this->frameSet = rs2::frameset();
+	this->depthFrame = rs2::frame();
+	this->colorFrame = rs2::frame();
+	this->rgbFrame = rs2::frame();
+	this->infraredFrame = rs2::frame();
+
+	// The results are written either way, a lost IMU sample still fails the run.
+	return this->writeResults() && imuAccounted;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "StreamProfile.h"
+
+#ifndef KERNELBENCHMARK_H
+#define KERNELBENCHMARK_H
+
+using namespace std;
+
+struct KernelResult {
+	string name;
+	cv::Size resolution;
+	unsigned long long iterations = 0;
+	double nsPerFrame = 0.0;
+	double megabytesPerSecond = 0.0;	// Input bytes processed.
+};
+
+/*
+Times every per-frame operation of the recorder on synthetic frames at the
+resolutions of the stream profile: frame_to_mat per format, the RGB to BGR
+conversion, the depth quality grid, alignment (to depth also with the
+infrared frames in the frameset and with them taken out), each filter of
+the writer chain and the colorizer, the preview's resize and blend,
+VideoWriter::write for color, depth and
+infrared (infrared_fourcc of recorder_options.cfg), and one IMU sample
+through ImuRecorder from a software motion sensor. The frames come
+from a software device, so no camera is needed. Each kernel runs for a
+fixed time after a short warm up, results go to a JSON file whose order
+and keys stay the same so runs can be diffed between versions and machines.
+*/
+class KernelBenchmark
+{
+	private:
+		string outputFile;
+		string workDir;
+		float secondsPerKernel;
+		string nameFilter;
+		StreamProfile profile;
+		string infraredFourcc;
+		vector<KernelResult> results;
+
+		// Synthetic frames, the software device reads the pixels from these buffers.
+		vector<uint16_t> depthPixels;
+		vector<uint8_t> colorPixels;
+		vector<uint8_t> rgbPixels;
+		vector<uint8_t> infraredPixels;
+		rs2::frameset frameSet;
+		rs2::frame depthFrame;
+		rs2::frame colorFrame;
+		rs2::frame rgbFrame;
+		rs2::frame infraredFrame;
+
+		bool createFrames(rs2::software_device& device);
+		void measure(const string& name, cv::Size resolution, size_t inputBytes, const std::function<void()>& kernel);
+		void runKernels();
+		bool runImuKernel();
+		bool writeResults();
+
+	public:
+		KernelBenchmark(string outputFile, string workDir, float secondsPerKernel, string nameFilter);
+		bool run();
+};
+
+#endif // !
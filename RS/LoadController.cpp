@@ -0,0 +1,199 @@
+#include "LoadController.h"
+
+#include <iostream>
+#include <algorithm>
+
+LoadController::LoadController() {
+	this->windowStart = std::chrono::high_resolution_clock::now();
+}
+
+LoadController::LoadController(const RecorderOptions& options, float cameraFps, SessionMetadata* metadata) {
+	this->options = options;
+	this->metadata = metadata;
+	this->cameraFps = cameraFps;
+
+	this->depthRatio = max(1, options.minDepthSamplingRatio);
+	this->colorRatio = max(1, options.minColorSamplingRatio);
+	this->previewEvery = max(1, options.minPreviewInterval);
+	this->windowStart = std::chrono::high_resolution_clock::now();
+
+	this->logChange("initial", 0.0f, 0, 1, 1, 0.0f, 0.0f, 0.0f);
+}
+
+int LoadController::depthSamplingRatio() const {
+	return this->depthRatio;
+}
+
+int LoadController::colorSamplingRatio() const {
+	return this->colorRatio;
+}
+
+int LoadController::previewInterval() const {
+	return this->previewEvery;
+}
+
+void LoadController::sampleQueues(const rs2::frame_queue& colorQueue, const rs2::frame_queue& depthQueue) {
+	float colorOccupancy = static_cast<float>(colorQueue.size()) / static_cast<float>(max<size_t>(1, colorQueue.capacity()));
+	float depthOccupancy = static_cast<float>(depthQueue.size()) / static_cast<float>(max<size_t>(1, depthQueue.capacity()));
+	this->sampleOccupancy(colorOccupancy, depthOccupancy);
+}
+
+// Fill of the writers' inputs between 0 and 1, for writers that are not fed by an rs2::frame_queue.
+void LoadController::sampleOccupancy(float colorOccupancy, float depthOccupancy) {
+	this->queueOccupancySum += max(colorOccupancy, depthOccupancy);
+	this->windowFrames++;
+}
+
+// Frames captured while the memory budget was exceeded, see memory_policy = shed.
+void LoadController::sampleMemory(bool overBudget) {
+	if (overBudget) {
+		this->memoryPressureFrames++;
+	}
+}
+
+void LoadController::update(float sessionTime, unsigned long long frameCount,
+							const WriterStatistics& color, const WriterStatistics& depth) {
+
+	if (this->windowFrames < this->options.loadControlWindow) {
+		return;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<float> windowLength = now - this->windowStart;
+
+	long long colorBusy = color.busyMicroseconds.load();
+	long long depthBusy = depth.busyMicroseconds.load();
+
+	float occupancy = static_cast<float>(this->queueOccupancySum / this->windowFrames);
+	float colorUtilisation = (colorBusy - this->lastColorBusy) / 1e6f / max(windowLength.count(), 1e-3f);
+	float depthUtilisation = (depthBusy - this->lastDepthBusy) / 1e6f / max(windowLength.count(), 1e-3f);
+	float utilisation = max(colorUtilisation, depthUtilisation);
+
+	bool memoryPressure = this->memoryPressureFrames > 0;
+
+	this->windowFrames = 0;
+	this->queueOccupancySum = 0.0;
+	this->memoryPressureFrames = 0;
+	this->lastColorBusy = colorBusy;
+	this->lastDepthBusy = depthBusy;
+	this->windowStart = now;
+
+	if (!this->options.adaptiveLoadShedding) {
+		return;
+	}
+
+	bool overloaded = memoryPressure || occupancy > this->options.queueHighWatermark || utilisation > this->options.writerHighUtilisation;
+	bool idle = !memoryPressure && occupancy < this->options.queueLowWatermark && utilisation < this->options.writerLowUtilisation;
+
+	if (overloaded) {
+		this->idleWindows = 0;
+		this->overloadedWindows++;
+
+		if (this->overloadedWindows >= this->options.shedAfterWindows) {
+			this->overloadedWindows = 0;
+			if (this->shed()) {
+				this->logChange(memoryPressure ? "memory" : "overloaded", sessionTime, frameCount, color.currentSegment, depth.currentSegment,
+								occupancy, colorUtilisation, depthUtilisation);
+			}
+		}
+	}
+	else if (idle) {
+		this->overloadedWindows = 0;
+		this->idleWindows++;
+
+		if (this->idleWindows >= this->options.recoverAfterWindows) {
+			this->idleWindows = 0;
+			if (this->recover(colorUtilisation, depthUtilisation)) {
+				this->logChange("recovered", sessionTime, frameCount, color.currentSegment, depth.currentSegment,
+								occupancy, colorUtilisation, depthUtilisation);
+			}
+		}
+	}
+	else {
+		this->overloadedWindows = 0;
+		this->idleWindows = 0;
+	}
+}
+
+/*
+Degrade one step, cheapest loss first: preview, then depth, then color.
+*/
+bool LoadController::shed() {
+	if (this->previewEvery < this->options.maxPreviewInterval) {
+		this->previewEvery = min(this->previewEvery * 2, this->options.maxPreviewInterval);
+		return true;
+	}
+
+	if (this->depthRatio < this->options.maxDepthSamplingRatio) {
+		this->depthRatio++;
+		return true;
+	}
+
+	if (this->colorRatio < this->options.maxColorSamplingRatio) {
+		this->colorRatio++;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+Restore one step in the reverse order. A writer is only given more frames
+when its utilisation scaled by the new rate still stays under the high
+watermark, otherwise we would shed again a few windows later.
+*/
+bool LoadController::recover(float colorUtilisation, float depthUtilisation) {
+	if (this->colorRatio > this->options.minColorSamplingRatio) {
+		float predicted = colorUtilisation * this->colorRatio / (this->colorRatio - 1);
+		if (predicted >= this->options.writerHighUtilisation) {
+			return false;
+		}
+		this->colorRatio--;
+		return true;
+	}
+
+	if (this->depthRatio > this->options.minDepthSamplingRatio) {
+		float predicted = depthUtilisation * this->depthRatio / (this->depthRatio - 1);
+		if (predicted >= this->options.writerHighUtilisation) {
+			return false;
+		}
+		this->depthRatio--;
+		return true;
+	}
+
+	if (this->previewEvery > this->options.minPreviewInterval) {
+		this->previewEvery = max(this->previewEvery / 2, this->options.minPreviewInterval);
+		return true;
+	}
+
+	return false;
+}
+
+void LoadController::logChange(const string& reason, float sessionTime, unsigned long long frameCount,
+							   int colorSegment, int depthSegment, float occupancy, float colorUtilisation, float depthUtilisation) {
+
+	std::cout << "Load controller (" << reason << "): depth 1/" << this->depthRatio
+			  << ", color 1/" << this->colorRatio
+			  << ", preview 1/" << this->previewEvery << " at " << sessionTime << " seconds." << endl;
+
+	if (this->metadata == nullptr) {
+		return;
+	}
+
+	MetadataRecord record = {
+		{ "time_s", SessionMetadata::number(sessionTime) },
+		{ "frameset", SessionMetadata::number(static_cast<double>(frameCount)) },
+		{ "reason", SessionMetadata::text(reason) },
+		{ "color_segment", SessionMetadata::number(colorSegment) },
+		{ "depth_segment", SessionMetadata::number(depthSegment) },
+		{ "depth_sampling_ratio", SessionMetadata::number(this->depthRatio) },
+		{ "effective_depth_fps", SessionMetadata::number(this->cameraFps / this->depthRatio) },
+		{ "color_sampling_ratio", SessionMetadata::number(this->colorRatio) },
+		{ "effective_color_fps", SessionMetadata::number(this->cameraFps / this->colorRatio) },
+		{ "preview_interval", SessionMetadata::number(this->previewEvery) },
+		{ "queue_occupancy", SessionMetadata::number(occupancy) },
+		{ "color_writer_utilisation", SessionMetadata::number(colorUtilisation) },
+		{ "depth_writer_utilisation", SessionMetadata::number(depthUtilisation) }
+	};
+	this->metadata->appendRecord("load_changes", record);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <librealsense2/rs.hpp>
+#include "RecorderOptions.h"
+#include "SessionMetadata.h"
+#include "WriterStatistics.h"
+
+#ifndef LOADCONTROLLER_H
+#define LOADCONTROLLER_H
+
+using namespace std;
+
+/*
+Watches the writer queues and how busy the writer threads are, and trades
+preview refreshes, depth framesets and finally color frames for headroom
+when the machine can't keep up. Changes only happen after several
+consecutive windows past a watermark, so the rates don't oscillate.
+*/
+class LoadController
+{
+	private:
+		RecorderOptions options;
+		SessionMetadata* metadata = nullptr;
+		float cameraFps = 30;
+
+		int depthRatio = 5;
+		int colorRatio = 1;
+		int previewEvery = 1;
+
+		// Window accumulators
+		int windowFrames = 0;
+		double queueOccupancySum = 0.0;
+		int memoryPressureFrames = 0;
+		long long lastColorBusy = 0;
+		long long lastDepthBusy = 0;
+		std::chrono::high_resolution_clock::time_point windowStart;
+
+		int overloadedWindows = 0;
+		int idleWindows = 0;
+
+		bool shed();
+		bool recover(float colorUtilisation, float depthUtilisation);
+		void logChange(const string& reason, float sessionTime, unsigned long long frameCount,
+					   int colorSegment, int depthSegment, float occupancy, float colorUtilisation, float depthUtilisation);
+
+	public:
+		LoadController();
+		LoadController(const RecorderOptions& options, float cameraFps, SessionMetadata* metadata);
+		void sampleQueues(const rs2::frame_queue& colorQueue, const rs2::frame_queue& depthQueue);
+		void sampleOccupancy(float colorOccupancy, float depthOccupancy);
+		void sampleMemory(bool overBudget);
+		void update(float sessionTime, unsigned long long frameCount,
+					const WriterStatistics& color, const WriterStatistics& depth);
+
+		int depthSamplingRatio() const;
+		int colorSamplingRatio() const;
+		int previewInterval() const;
+};
+
+#endif // !
@@ -0,0 +1,127 @@
+#include "MemoryBudget.h"
+
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+void MemoryAccount::set(long long bytes) {
+	long long previous = this->bytes.exchange(bytes);
+	long long highest = this->peak;
+	while (bytes > highest && !this->peak.compare_exchange_weak(highest, bytes)) {
+	}
+	if (this->budget != nullptr && bytes != previous) {
+		this->budget->changed(bytes - previous);
+	}
+}
+
+long long MemoryAccount::current() const {
+	return this->bytes;
+}
+
+MemoryBudget::MemoryBudget() {
+}
+
+void MemoryBudget::setLimit(long long bytes) {
+	this->limit = bytes;
+}
+
+/*
+Accounts live as long as the budget, asking twice for a name returns the same
+one. A fixed account holds memory no dropped or delayed frameset gives back,
+the SDK's queues or a pre-roll waiting for its writer.
+*/
+MemoryAccount* MemoryBudget::account(const string& name, bool fixed) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	for (MemoryAccount& existing : this->accounts) {
+		if (existing.name == name) {
+			return &existing;
+		}
+	}
+	this->accounts.emplace_back();
+	this->accounts.back().budget = this;
+	this->accounts.back().name = name;
+	this->accounts.back().fixed = fixed;
+	return &this->accounts.back();
+}
+
+void MemoryBudget::changed(long long delta) {
+	long long now = this->total += delta;
+	long long highest = this->peak;
+	while (now > highest && !this->peak.compare_exchange_weak(highest, now)) {
+	}
+	if (delta < 0) {
+		// Taking the lock orders this with a waiter between its check and its wait.
+		{ std::lock_guard<std::mutex> guard(this->lock); }
+		this->released.notify_all();
+	}
+}
+
+long long MemoryBudget::current() const {
+	return this->total;
+}
+
+long long MemoryBudget::fixedUsage() const {
+	std::lock_guard<std::mutex> guard(this->lock);
+	long long bytes = 0;
+	for (const MemoryAccount& account : this->accounts) {
+		if (account.fixed) {
+			bytes += account.bytes;
+		}
+	}
+	return bytes;
+}
+
+// Dropping or blocking framesets can only get under a limit above what the fixed accounts hold.
+bool MemoryBudget::limitReachable() const {
+	return this->limit <= 0 || this->limit > this->fixedUsage();
+}
+
+long long MemoryBudget::peakUsage() const {
+	return this->peak;
+}
+
+bool MemoryBudget::overBudget() const {
+	return this->limit > 0 && this->total > this->limit;
+}
+
+// Backpressure: true once usage is back under the limit, false when timeoutMs ran out first.
+bool MemoryBudget::waitForRoom(unsigned int timeoutMs) {
+	std::unique_lock<std::mutex> guard(this->lock);
+	return this->released.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this]() { return this->limit <= 0 || this->total <= this->limit; });
+}
+
+void MemoryBudget::countOverBudget() {
+	this->overBudgetEvents++;
+}
+
+// Peaks and events start over from what is held now, for the next session.
+void MemoryBudget::resetPeaks() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	for (MemoryAccount& account : this->accounts) {
+		account.peak = account.bytes.load();
+	}
+	this->peak = this->total.load();
+	this->overBudgetEvents = 0;
+}
+
+string MemoryBudget::describe() const {
+	ostringstream text;
+	text << std::fixed << std::setprecision(0) << "frame memory " << this->total / 1048576.0 << " MB";
+	if (this->limit > 0) {
+		text << " of " << this->limit / 1048576.0;
+	}
+	text << ", peak " << this->peak / 1048576.0 << " MB";
+	return text.str();
+}
+
+void MemoryBudget::report(SessionMetadata& metadata) const {
+	metadata.setField("memory_budget_mb", SessionMetadata::number(this->limit / 1048576.0));
+	metadata.setField("memory_peak_mb", SessionMetadata::number(this->peak / 1048576.0));
+	metadata.setField("memory_over_budget_events", SessionMetadata::number(static_cast<double>(this->overBudgetEvents.load())));
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	for (const MemoryAccount& account : this->accounts) {
+		metadata.appendRecord("memory_accounts", { { "name", SessionMetadata::text(account.name) },
+												   { "peak_mb", SessionMetadata::number(account.peak / 1048576.0) } });
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "SessionMetadata.h"
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+using namespace std;
+
+class MemoryBudget;
+
+/*
+Bytes one queue or buffer holds right now. The owner sets the absolute
+amount whenever it changes, so a frame a bounded queue dropped on its own
+can't leak out of the accounting.
+*/
+class MemoryAccount
+{
+	friend class MemoryBudget;
+
+	private:
+		MemoryBudget* budget = nullptr;
+		string name;
+		std::atomic<long long> bytes{ 0 };
+		std::atomic<long long> peak{ 0 };
+		bool fixed = false;
+
+	public:
+		void set(long long bytes);
+		long long current() const;
+};
+
+/*
+Process wide budget for frame memory: writer queues, pre-roll and preview
+buffers, the proxy frame, analytics queues and an estimate of the SDK's own
+frame queues. Every holder reports into an account, the budget keeps the
+sum and its peak. What happens above the limit is up to the capture side
+(see memory_policy): drop the frameset, block until the writers catch up,
+or shed load through the LoadController. A limit of 0 only measures.
+*/
+class MemoryBudget
+{
+	friend class MemoryAccount;
+
+	private:
+		list<MemoryAccount> accounts;
+		mutable std::mutex lock;
+		std::condition_variable released;
+		std::atomic<long long> limit{ 0 };
+		std::atomic<long long> total{ 0 };
+		std::atomic<long long> peak{ 0 };
+		std::atomic<unsigned long long> overBudgetEvents{ 0 };
+
+		void changed(long long delta);
+
+	public:
+		MemoryBudget();
+		void setLimit(long long bytes);
+		MemoryAccount* account(const string& name, bool fixed = false);
+		long long current() const;
+		long long fixedUsage() const;
+		bool limitReachable() const;
+		long long peakUsage() const;
+		bool overBudget() const;
+		bool waitForRoom(unsigned int timeoutMs);
+		void countOverBudget();
+		void resetPeaks();
+		string describe() const;
+		void report(SessionMetadata& metadata) const;
+};
+
+#endif // !
@@ -0,0 +1,287 @@
+#include "PointCloudExporter.h"
+
+#include <direct.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+
+#include "Utilities.h"
+#include "ThreadPool.h"
+#include "FrameJournal.h"
+
+PointCloudExporter::PointCloudExporter(string sessionDir, string format, int firstFrame, int lastFrame, unsigned int threadCount) {
+	if (!sessionDir.empty() && sessionDir.back() != '/' && sessionDir.back() != '\\') {
+		sessionDir += "/";
+	}
+	this->sessionDir = sessionDir;
+	this->outputDir = sessionDir + "pointclouds/";
+	this->format = format;
+	this->firstFrame = max(0, firstFrame);
+	this->lastFrame = lastFrame;
+	this->threadCount = threadCount == 0 ? max(1u, std::thread::hardware_concurrency()) : threadCount;
+}
+
+vector<string> PointCloudExporter::listDepthSegments() {
+	vector<string> segments;
+
+	for (int videoID = 1; ; ++videoID) {
+		string mp4 = this->sessionDir + "depth/" + to_string(videoID) + ".mp4";
+		string avi = this->sessionDir + "depth/" + to_string(videoID) + ".avi";
+		string rsj = this->sessionDir + "depth/" + to_string(videoID) + ".rsj";
+
+		if (isPathExist(mp4)) {
+			segments.push_back(mp4);
+		}
+		else if (isPathExist(avi)) {
+			segments.push_back(avi);
+		}
+		else if (isPathExist(rsj)) {
+			segments.push_back(rsj);
+		}
+		else {
+			break;
+		}
+	}
+
+	return segments;
+}
+
+/*
+Depth is archived aligned to color, so the intrinsics that match the decoded
+frame size are the ones to deproject with.
+*/
+bool PointCloudExporter::loadCalibration(cv::Size frameSize) {
+	double value;
+	if (readJsonNumber(this->sessionDir + "session_metadata.json", "min_depth_m", value)) {
+		this->minDepth = static_cast<float>(value);
+	}
+	if (readJsonNumber(this->sessionDir + "session_metadata.json", "max_depth_m", value)) {
+		this->maxDepth = static_cast<float>(value);
+	}
+	if (readJsonNumber(this->sessionDir + "depth_parameters.json", "depth_scale", value)
+		|| readJsonNumber(this->sessionDir + "depth_parameters", "depth_scale", value)) {
+		this->depthScale = static_cast<float>(value);
+	}
+
+	vector<string> candidates = { "intrinsics_depth.json", "intrinsics_color.json" };
+	for (const string& candidate : candidates) {
+		rs2_intrinsics intrinsics;
+		if (readIntrinsics(this->sessionDir + candidate, intrinsics)
+			&& intrinsics.width == frameSize.width && intrinsics.height == frameSize.height) {
+			std::cout << "Deprojecting with " << candidate << endl;
+			this->rays.build(intrinsics);
+			return true;
+		}
+	}
+
+	std::cerr << "No intrinsics in " << this->sessionDir << " match the " << frameSize.width << "x" << frameSize.height << " depth frames." << endl;
+	return false;
+}
+
+/*
+Inverse of the colorizer's hue scheme with histogram equalisation off,
+as described in Intel's depth image compression by colorization paper.
+Black pixels had no depth.
+*/
+void decodeColorizedDepthRow(const unsigned char* bgr, float* meters, int width, float minDepth, float maxDepth) {
+	const float scale = (maxDepth - minDepth) / 1529.0f;
+
+	for (int x = 0; x < width; ++x) {
+		int b = bgr[3 * x];
+		int g = bgr[3 * x + 1];
+		int r = bgr[3 * x + 2];
+
+		if (max(r, max(g, b)) < 128) {
+			meters[x] = 0.0f;
+			continue;
+		}
+
+		int hue;
+		if (r >= g && r >= b) {
+			hue = g >= b ? g - b : g - b + 1529;
+		}
+		else if (g >= r && g >= b) {
+			hue = b - r + 510;
+		}
+		else {
+			hue = r - g + 1020;
+		}
+
+		meters[x] = minDepth + scale * hue;
+	}
+}
+
+void PointCloudExporter::toMeters(const cv::Mat& frame, cv::Mat& meters) const {
+	meters.create(frame.rows, frame.cols, CV_32FC1);
+
+	if (frame.type() == CV_16UC1) {
+		frame.convertTo(meters, CV_32F, this->depthScale);
+		return;
+	}
+
+	for (int y = 0; y < frame.rows; ++y) {
+		decodeColorizedDepthRow(frame.ptr<unsigned char>(y), meters.ptr<float>(y), frame.cols, this->minDepth, this->maxDepth);
+	}
+}
+
+void PointCloudExporter::writePly(const cv::Mat& meters, const string& filename) {
+	vector<float> points;
+	points.reserve(static_cast<size_t>(meters.rows) * meters.cols * 3);
+
+	for (int y = 0; y < meters.rows; ++y) {
+		const float* z = meters.ptr<float>(y);
+		const float* rx = this->rays.xRow(y);
+		const float* ry = this->rays.yRow(y);
+
+		for (int x = 0; x < meters.cols; ++x) {
+			if (z[x] <= 0.0f) {
+				continue;
+			}
+			points.push_back(rx[x] * z[x]);
+			points.push_back(ry[x] * z[x]);
+			points.push_back(z[x]);
+		}
+	}
+
+	ofstream plyFile(filename, ios::binary);
+	plyFile << "ply\n"
+			<< "format binary_little_endian 1.0\n"
+			<< "element vertex " << points.size() / 3 << "\n"
+			<< "property float x\n"
+			<< "property float y\n"
+			<< "property float z\n"
+			<< "end_header\n";
+	plyFile.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
+	plyFile.close();
+
+	this->pointsWritten += points.size() / 3;
+}
+
+void PointCloudExporter::writeXyz(const cv::Mat& meters, const string& filename) {
+	vector<float> points(static_cast<size_t>(meters.rows) * meters.cols * 3);
+	vector<float> rowX(meters.cols), rowY(meters.cols);
+
+	for (int y = 0; y < meters.rows; ++y) {
+		const float* z = meters.ptr<float>(y);
+		const float* rx = this->rays.xRow(y);
+		const float* ry = this->rays.yRow(y);
+
+		// Plain loops over contiguous planes so the compiler vectorises them.
+		for (int x = 0; x < meters.cols; ++x) {
+			rowX[x] = rx[x] * z[x];
+			rowY[x] = ry[x] * z[x];
+		}
+
+		float* out = points.data() + static_cast<size_t>(y) * meters.cols * 3;
+		for (int x = 0; x < meters.cols; ++x) {
+			out[3 * x] = rowX[x];
+			out[3 * x + 1] = rowY[x];
+			out[3 * x + 2] = z[x];
+		}
+	}
+
+	ofstream xyzFile(filename, ios::binary);
+	xyzFile.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
+	xyzFile.close();
+
+	this->pointsWritten += static_cast<unsigned long long>(meters.rows) * meters.cols;
+}
+
+void PointCloudExporter::exportFrame(const cv::Mat& frame, int frameIndex) {
+	cv::Mat meters;
+	this->toMeters(frame, meters);
+
+	string filename = this->outputDir + to_string(frameIndex) + "." + this->format;
+	if (this->format == "xyz") {
+		this->writeXyz(meters, filename);
+	}
+	else {
+		this->writePly(meters, filename);
+	}
+}
+
+bool PointCloudExporter::run() {
+	if (this->format != "ply" && this->format != "xyz") {
+		std::cerr << "Unknown point cloud format " << this->format << ", use ply or xyz." << endl;
+		return false;
+	}
+
+	vector<string> segments = this->listDepthSegments();
+	if (segments.empty()) {
+		std::cerr << "No depth segments found in " << this->sessionDir << "depth/" << endl;
+		return false;
+	}
+
+	if (!isPathExist(this->outputDir)) {
+		_mkdir(this->outputDir.c_str());
+	}
+
+	std::cout << "Exporting " << this->format << " point clouds from " << segments.size() << " segments with "
+			  << this->threadCount << " threads." << endl;
+
+	ThreadPool pool(this->threadCount, 2 * this->threadCount);
+	std::chrono::high_resolution_clock Clock;
+	auto startTime = Clock.now();
+
+	bool calibrated = false;
+	int frameIndex = 0;
+	int exported = 0;
+
+	for (const string& segment : segments) {
+		if (this->lastFrame >= 0 && frameIndex > this->lastFrame) {
+			break;
+		}
+
+		// Journals are read up to their last complete frame, see FrameJournal.
+		bool isJournal = segment.size() > 4 && segment.compare(segment.size() - 4, 4, ".rsj") == 0;
+		cv::VideoCapture capture;
+		FrameJournalReader journal;
+		size_t journalPosition = 0;
+
+		if (isJournal ? !journal.open(segment) : !capture.open(segment)) {
+			std::cerr << "Failed to open " << segment << endl;
+			continue;
+		}
+
+		// Skip whole segments before the range without decoding them.
+		int segmentFrames = isJournal ? static_cast<int>(journal.size()) : static_cast<int>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+		if (segmentFrames > 0 && frameIndex + segmentFrames <= this->firstFrame) {
+			frameIndex += segmentFrames;
+			continue;
+		}
+
+		while (this->lastFrame < 0 || frameIndex <= this->lastFrame) {
+			cv::Mat frame;
+			if (isJournal ? !journal.read(journalPosition++, frame) : !capture.read(frame)) {
+				break;
+			}
+
+			if (frameIndex < this->firstFrame) {
+				frameIndex++;
+				continue;
+			}
+
+			if (!calibrated) {
+				if (!this->loadCalibration(cv::Size(frame.cols, frame.rows))) {
+					return false;
+				}
+				calibrated = true;
+			}
+
+			int index = frameIndex;
+			pool.submit([this, frame, index]() { this->exportFrame(frame, index); });
+
+			frameIndex++;
+			exported++;
+		}
+	}
+
+	pool.wait();
+
+	std::chrono::duration<float> elapsed = Clock.now() - startTime;
+	std::cout << "Exported " << exported << " frames (" << this->pointsWritten << " points) in " << elapsed.count()
+			  << " seconds, " << exported / max(elapsed.count(), 1e-3f) << " frames/s." << endl;
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "RayTable.h"
+
+#ifndef POINTCLOUDEXPORTER_H
+#define POINTCLOUDEXPORTER_H
+
+using namespace std;
+
+/*
+Offline tool that turns the recorded depth of a session into point clouds.
+Frames are decoded in order on the calling thread and deprojected and
+written by a pool of workers, one file per frame in <session>/pointclouds/:
+  ply - binary little endian PLY with the valid points only.
+  xyz - organised float32 XYZ, width * height points, zeros where depth is missing.
+*/
+class PointCloudExporter
+{
+	private:
+		string sessionDir;
+		string outputDir;
+		string format;
+		int firstFrame;
+		int lastFrame;
+		unsigned int threadCount;
+
+		float minDepth = 0.19f;
+		float maxDepth = 7.0f;
+		float depthScale = 0.001f;
+		RayTable rays;
+
+		std::atomic<unsigned long long> pointsWritten{ 0 };
+
+		vector<string> listDepthSegments();
+		bool loadCalibration(cv::Size frameSize);
+		void toMeters(const cv::Mat& frame, cv::Mat& meters) const;
+		void exportFrame(const cv::Mat& frame, int frameIndex);
+		void writePly(const cv::Mat& meters, const string& filename);
+		void writeXyz(const cv::Mat& meters, const string& filename);
+
+	public:
+		PointCloudExporter(string sessionDir, string format, int firstFrame, int lastFrame, unsigned int threadCount);
+		bool run();
+};
+
+void decodeColorizedDepthRow(const unsigned char* bgr, float* meters, int width, float minDepth, float maxDepth);
+
+#endif // !
@@ -0,0 +1,232 @@
+#include "ProfileCalibrator.h"
+
+#include <direct.h>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "Utilities.h"
+#include "WriterStatistics.h"
+#include "WriterSettings.h"
+
+ProfileCalibrator::ProfileCalibrator(string outputDir, float trialSeconds, float safetyMargin, int depthSamplingRatio) {
+	this->outputDir = outputDir;
+	this->trialSeconds = trialSeconds;
+	this->safetyMargin = safetyMargin;
+	this->depthSamplingRatio = max(1, depthSamplingRatio);
+	this->createCandidates();
+}
+
+/*
+Candidates are ordered from the most to the least demanding, the first one
+that is sustained wins. Depth stays at 848x480, the optimal D400 resolution,
+and runs at the color rate so framesets keep their cadence.
+*/
+void ProfileCalibrator::createCandidates() {
+	vector<cv::Size> colorResolutions = { cv::Size(1920, 1080), cv::Size(1280, 720), cv::Size(848, 480) };
+	vector<int> frameRates = { 30, 15 };
+	vector<string> encoders = { "mp4v", "MJPG" };
+
+	for (int fps : frameRates) {
+		for (const cv::Size& resolution : colorResolutions) {
+			for (const string& fourcc : encoders) {
+				StreamProfile profile;
+				profile.colorWidth = resolution.width;
+				profile.colorHeight = resolution.height;
+				profile.colorFps = fps;
+				profile.depthFps = fps;
+				profile.fourcc = fourcc;
+				this->candidates.push_back(profile);
+			}
+		}
+	}
+
+	std::stable_sort(this->candidates.begin(), this->candidates.end(), [](const StreamProfile& a, const StreamProfile& b) {
+		return a.colorWidth * a.colorHeight * a.colorFps > b.colorWidth * b.colorHeight * b.colorFps;
+	});
+}
+
+CalibrationTrial ProfileCalibrator::runTrial(const StreamProfile& profile) {
+	CalibrationTrial trial;
+	trial.profile = profile;
+
+	rs2::pipeline pipeline;
+	rs2::config config;
+	config.enable_stream(RS2_STREAM_DEPTH, 0, profile.depthWidth, profile.depthHeight, RS2_FORMAT_Z16, profile.depthFps);
+	config.enable_stream(RS2_STREAM_COLOR, 0, profile.colorWidth, profile.colorHeight, RS2_FORMAT_BGR8, profile.colorFps);
+
+	try {
+		pipeline.start(config);
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Profile " << profile.describe() << " is not supported by this camera (" << e.what() << ")" << endl;
+		return trial;
+	}
+	trial.started = true;
+
+	std::chrono::high_resolution_clock Clock;
+
+	// Let the streams and auto-exposure start before measuring. A camera that delivers nothing fails the trial.
+	try {
+		auto warmUpStart = Clock.now();
+		while (std::chrono::duration<float>(Clock.now() - warmUpStart).count() < 1.0f) {
+			pipeline.wait_for_frames(10000);
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error during trial " << profile.describe() << ": " << e.what() << endl;
+		trial.framesDropped = static_cast<unsigned long long>(this->trialSeconds * profile.colorFps);
+		pipeline.stop();
+		return trial;
+	}
+
+	string trialDir = this->outputDir + "calibration/";
+	if (!isPathExist(trialDir)) {
+		_mkdir(trialDir.c_str());
+	}
+
+	rs2::frame_queue depthFramesQueue(2);
+	rs2::frame_queue colorFramesQueue(2);
+	WriterStatistics depthStatistics;
+	WriterStatistics colorStatistics;
+
+	WriterSettings depthSettings;
+	depthSettings.imageType = "depth";
+	depthSettings.directory = trialDir + "depth_";
+	depthSettings.baseDirectory = this->outputDir;
+	depthSettings.individualVideoLength = this->trialSeconds + 60.0f;
+	depthSettings.fps = static_cast<float>(profile.depthFps) / this->depthSamplingRatio;
+	depthSettings.resolution = cv::Size(profile.colorWidth, profile.colorHeight);
+	depthSettings.fourcc = profile.fourcc;
+	depthSettings.queueTimeoutMs = 1000;
+	depthSettings.statistics = &depthStatistics;
+
+	WriterSettings colorSettings = depthSettings;
+	colorSettings.imageType = "color";
+	colorSettings.directory = trialDir + "color_";
+	colorSettings.fps = static_cast<float>(profile.colorFps);
+	colorSettings.statistics = &colorStatistics;
+
+	std::thread depthSavingThread(writeFrames, depthFramesQueue, depthSettings);
+	std::thread colorSavingThread(writeFrames, colorFramesQueue, colorSettings);
+
+	rs2::align alignTo(RS2_STREAM_COLOR);
+	rs2::frameset frameSet;
+	unsigned long long lastColorNumber = 0;
+	unsigned long long lastDepthNumber = 0;
+	unsigned long long colorEnqueued = 0;
+	unsigned long long depthEnqueued = 0;
+	unsigned long long frameSets = 0;
+	unsigned long long sensorDrops = 0;
+
+	double cpuStart = processCpuSeconds();
+	auto trialStart = Clock.now();
+
+	try {
+		while (std::chrono::duration<float>(Clock.now() - trialStart).count() < this->trialSeconds) {
+			frameSet = pipeline.wait_for_frames(10000);
+
+			rs2::frame colorFrame = frameSet.get_color_frame();
+			rs2::frame depthFrame = frameSet.get_depth_frame();
+
+			// Gaps in the frame counters are frames the SDK or USB lost.
+			if (lastColorNumber != 0 && colorFrame.get_frame_number() > lastColorNumber + 1) {
+				sensorDrops += colorFrame.get_frame_number() - lastColorNumber - 1;
+			}
+			if (lastDepthNumber != 0 && depthFrame.get_frame_number() > lastDepthNumber + 1) {
+				sensorDrops += depthFrame.get_frame_number() - lastDepthNumber - 1;
+			}
+			lastColorNumber = colorFrame.get_frame_number();
+			lastDepthNumber = depthFrame.get_frame_number();
+
+			if (frameSets % this->depthSamplingRatio == 0) {
+				frameSet = alignTo.process(frameSet);
+				depthFramesQueue.enqueue(frameSet.get_depth_frame());
+				colorFramesQueue.enqueue(frameSet.get_color_frame());
+				depthEnqueued++;
+			}
+			else {
+				colorFramesQueue.enqueue(colorFrame);
+			}
+			colorEnqueued++;
+			frameSets++;
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error during trial " << profile.describe() << ": " << e.what() << endl;
+		sensorDrops += static_cast<unsigned long long>(this->trialSeconds * profile.colorFps);
+	}
+
+	std::chrono::duration<float> wallTime = Clock.now() - trialStart;
+	double cpuTime = processCpuSeconds() - cpuStart;
+
+	depthSavingThread.join();
+	colorSavingThread.join();
+	pipeline.stop();
+
+	// Whatever the writers did not get to was overwritten in the queues.
+	unsigned long long queueDrops = (colorEnqueued - min<unsigned long long>(colorEnqueued, colorStatistics.framesWritten.load()))
+								  + (depthEnqueued - min<unsigned long long>(depthEnqueued, depthStatistics.framesWritten.load()));
+	unsigned int cores = max(1u, std::thread::hardware_concurrency());
+
+	trial.framesCaptured = colorEnqueued + depthEnqueued;
+	trial.framesDropped = sensorDrops + queueDrops;
+	trial.dropRate = static_cast<float>(trial.framesDropped) / static_cast<float>(max<unsigned long long>(1, trial.framesCaptured + sensorDrops));
+	trial.cpuUtilisation = static_cast<float>(cpuTime / (wallTime.count() * cores));
+	trial.colorWriterUtilisation = colorStatistics.busyMicroseconds / 1e6f / wallTime.count();
+	trial.depthWriterUtilisation = depthStatistics.busyMicroseconds / 1e6f / wallTime.count();
+
+	float limit = 1.0f - this->safetyMargin;
+	trial.sustained = trial.dropRate <= this->maxDropRate
+				   && trial.cpuUtilisation <= limit
+				   && trial.colorWriterUtilisation <= limit
+				   && trial.depthWriterUtilisation <= limit;
+
+	return trial;
+}
+
+void ProfileCalibrator::printTrial(const CalibrationTrial& trial) {
+	std::cout << trial.profile.describe() << ": ";
+
+	if (!trial.started) {
+		std::cout << "not supported" << endl;
+		return;
+	}
+
+	std::cout << "dropped " << trial.framesDropped << " (" << trial.dropRate * 100.0f << "%)"
+			  << ", CPU " << trial.cpuUtilisation * 100.0f << "%"
+			  << ", color writer " << trial.colorWriterUtilisation * 100.0f << "%"
+			  << ", depth writer " << trial.depthWriterUtilisation * 100.0f << "%"
+			  << (trial.sustained ? " -> sustained" : " -> not sustained") << endl;
+}
+
+bool ProfileCalibrator::run() {
+	std::cout << "Calibrating " << this->candidates.size() << " stream profiles, "
+			  << this->trialSeconds << " seconds each." << endl;
+
+	vector<CalibrationTrial> trials;
+	for (const StreamProfile& candidate : this->candidates) {
+		CalibrationTrial trial = this->runTrial(candidate);
+		this->printTrial(trial);
+		trials.push_back(trial);
+	}
+
+	for (const CalibrationTrial& trial : trials) {
+		if (!trial.sustained) {
+			continue;
+		}
+
+		ostringstream comment;
+		comment << "Calibrated with " << this->trialSeconds << " second trials and a " << this->safetyMargin * 100.0f << "% safety margin." << endl;
+		comment << "Dropped " << trial.dropRate * 100.0f << "% of frames, CPU " << trial.cpuUtilisation * 100.0f << "%, "
+				<< "writers " << trial.colorWriterUtilisation * 100.0f << "% / " << trial.depthWriterUtilisation * 100.0f << "%.";
+
+		std::cout << "Selected " << trial.profile.describe() << endl;
+		return saveStreamProfile(this->outputDir + "stream_profile.cfg", trial.profile, comment.str());
+	}
+
+	std::cerr << "No candidate profile was sustained in real time, keeping the current profile." << endl;
+	return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "StreamProfile.h"
+
+#ifndef PROFILECALIBRATOR_H
+#define PROFILECALIBRATOR_H
+
+using namespace std;
+
+struct CalibrationTrial {
+	StreamProfile profile;
+	bool started = false;
+	unsigned long long framesCaptured = 0;
+	unsigned long long framesDropped = 0;
+	float dropRate = 1.0f;
+	float cpuUtilisation = 1.0f;
+	float colorWriterUtilisation = 1.0f;
+	float depthWriterUtilisation = 1.0f;
+	bool sustained = false;
+};
+
+/*
+Runs short recordings with every candidate stream profile and encoder and
+picks the most demanding one this machine sustains in real time with
+safetyMargin of CPU and writer time to spare. The result is written to
+stream_profile.cfg, which the recorder loads at startup.
+*/
+class ProfileCalibrator
+{
+	private:
+		string outputDir;
+		float trialSeconds;
+		float safetyMargin;
+		float maxDropRate = 0.005f;
+		int depthSamplingRatio;
+		vector<StreamProfile> candidates;
+
+		void createCandidates();
+		CalibrationTrial runTrial(const StreamProfile& profile);
+		void printTrial(const CalibrationTrial& trial);
+
+	public:
+		ProfileCalibrator(string outputDir, float trialSeconds, float safetyMargin, int depthSamplingRatio);
+		bool run();
+};
+
+#endif // !
@@ -0,0 +1,174 @@
+#include "ProxyWriter.h"
+
+#include <iostream>
+#include <cmath>
+#include <opencv-3.4/modules/videoio/include/opencv2/videoio/videoio_c.h>
+
+ProxyWriter::ProxyWriter() {
+}
+
+ProxyWriter::~ProxyWriter() {
+	this->stop();
+}
+
+bool ProxyWriter::start(const string& proxyDir, const string& thumbnailDir, int height, float fps, float thumbnailInterval, float segmentLength, int thumbnailQuality) {
+	if (this->running || fps <= 0.0f) {
+		return false;
+	}
+
+	this->proxyDir = proxyDir;
+	this->thumbnailDir = thumbnailDir;
+	this->height = max(2, height / 2 * 2);
+	this->fps = fps;
+	this->thumbnailInterval = thumbnailInterval;
+	this->segmentLength = max(1.0f, segmentLength);
+	this->thumbnailQuality = thumbnailQuality;
+	this->firstTimestamp = -1.0;
+	this->nextFrameTimestamp = 0.0;
+	this->framesWritten = 0;
+	this->thumbnailsWritten = 0;
+	this->thumbnailIndex.clear();
+	this->thumbnailIndex.setFile(thumbnailDir + "index.json");
+
+	this->running = true;
+	this->worker = std::thread(&ProxyWriter::workerLoop, this);
+	return true;
+}
+
+// Called by the preview with the color timestamp before it builds anything for the proxy.
+bool ProxyWriter::wants(double timestamp) {
+	return this->running && timestamp >= this->nextFrameTimestamp;
+}
+
+void ProxyWriter::submit(double timestamp, const cv::Mat& preview) {
+	if (!this->running || preview.empty()) {
+		return;
+	}
+
+	// Due times on a fixed grid of 1000 / fps ms from the first frame. A frame that comes
+	// later than one or more due times stands in for all of them, so the mp4 keeps the
+	// session's time at fps whatever rate the preview offers frames at.
+	double period = 1000.0 / this->fps;
+	int slots = 1;
+	if (this->firstTimestamp < 0.0) {
+		this->firstTimestamp = timestamp;
+		this->nextFrameTimestamp = timestamp;
+	}
+	else {
+		double behind = std::floor((timestamp - this->nextFrameTimestamp) / period);
+		slots = static_cast<int>(min(max(0.0, behind), static_cast<double>(this->fps * this->segmentLength))) + 1;
+	}
+	this->nextFrameTimestamp += slots * period;
+	if (this->nextFrameTimestamp <= timestamp) {
+		this->nextFrameTimestamp = timestamp + period;		// A gap longer than a segment, start the grid over.
+	}
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	preview.copyTo(this->pending);
+	this->pendingRepeats = (this->hasPending ? this->pendingRepeats : 0) + slots;		// A frame the worker missed leaves its slots to this one.
+	this->pendingTimestamp = timestamp;
+	this->pendingSeconds = (timestamp - this->firstTimestamp) / 1000.0;
+	this->hasPending = true;
+	this->wake.notify_one();
+
+	// The waiting frame and the one the worker is encoding.
+	if (this->memory != nullptr) {
+		this->memory->set(2 * static_cast<long long>(this->pending.total() * this->pending.elemSize()));
+	}
+}
+
+void ProxyWriter::workerLoop() {
+	if (this->placement.isSet()) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	cv::Mat frame, scaled;
+	cv::VideoWriter writer;
+	int segment = 0;
+	double nextThumbnail = 0.0;
+
+	while (true) {
+		double timestamp, seconds;
+		int repeats;
+		{
+			std::unique_lock<std::mutex> guard(this->lock);
+			this->wake.wait(guard, [this]() { return this->hasPending || !this->running; });
+			if (!this->hasPending) {
+				break;
+			}
+			cv::swap(frame, this->pending);
+			timestamp = this->pendingTimestamp;
+			seconds = this->pendingSeconds;
+			repeats = this->pendingRepeats;
+			this->hasPending = false;
+		}
+
+		int width = static_cast<int>(std::lround(frame.cols * static_cast<double>(this->height) / frame.rows / 2.0)) * 2;
+		cv::resize(frame, scaled, cv::Size(width, this->height), 0, 0, cv::INTER_AREA);
+
+		try {
+			// Proxy segments follow the recording's segment length.
+			int frameSegment = static_cast<int>(seconds / this->segmentLength) + 1;
+			if (frameSegment != segment) {
+				segment = frameSegment;
+				writer.release();
+				writer.open(this->proxyDir + to_string(segment) + ".mp4", CV_FOURCC('m', 'p', '4', 'v'), static_cast<double>(this->fps), scaled.size(), true);
+			}
+			for (int i = 0; i < repeats; ++i) {
+				writer.write(scaled);
+			}
+			this->framesWritten += repeats;
+
+			if (this->thumbnailInterval > 0.0f && seconds >= nextThumbnail) {
+				string name = to_string(static_cast<long long>(seconds)) + ".jpg";
+				cv::imwrite(this->thumbnailDir + name, scaled, { cv::IMWRITE_JPEG_QUALITY, this->thumbnailQuality });
+				this->thumbnailIndex.appendRecord("thumbnails", { { "file", SessionMetadata::text(name) },
+																  { "seconds", SessionMetadata::number(seconds) },
+																  { "timestamp", SessionMetadata::number(timestamp) },
+																  { "proxy_segment", SessionMetadata::number(segment) } });
+				this->thumbnailsWritten++;
+				while (nextThumbnail <= seconds) {
+					nextThumbnail += this->thumbnailInterval;
+				}
+			}
+		}
+		catch (const cv::Exception& e) {
+			std::cerr << "Proxy writer stopped: " << e.what() << endl;
+			break;
+		}
+	}
+	writer.release();
+}
+
+void ProxyWriter::stop() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		if (!this->running) {
+			return;
+		}
+		this->running = false;
+	}
+	this->wake.notify_one();
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	if (this->memory != nullptr) {
+		this->memory->set(0);
+	}
+}
+
+void ProxyWriter::setPlacement(const ThreadPlacement& placement) {
+	this->placement = placement;
+}
+
+void ProxyWriter::setMemoryAccount(MemoryAccount* memory) {
+	this->memory = memory;
+}
+
+long long ProxyWriter::written() const {
+	return this->framesWritten;
+}
+
+int ProxyWriter::thumbnails() const {
+	return this->thumbnailsWritten;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "opencv2/opencv.hpp"
+#include "SessionMetadata.h"
+#include "ThreadPlacement.h"
+#include "MemoryBudget.h"
+
+#ifndef PROXYWRITER_H
+#define PROXYWRITER_H
+
+using namespace std;
+
+/*
+Small review copy of a session, made from the preview's color and depth
+blend so capture pays for nothing but a copy of a frame it already has.
+The preview offers a frame whenever wants() says one is due; the worker
+scales it down, appends it to proxy/N.mp4 and every thumbnailInterval
+seconds also saves it as thumbnails/<seconds>.jpg, listed with its sensor
+timestamp in thumbnails/index.json. One frame waits at most, a busy worker
+drops proxy frames rather than holding up the preview. Frames are due every
+1000 / fps ms of sensor time; where the preview skipped some, the next frame
+is written again in their place, so proxies play in real time.
+*/
+class ProxyWriter
+{
+	private:
+		string proxyDir;
+		string thumbnailDir;
+		int height = 480;
+		float fps = 5.0f;
+		float thumbnailInterval = 10.0f;
+		float segmentLength = 180.0f;
+		int thumbnailQuality = 80;
+
+		std::thread worker;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::atomic<bool> running{ false };
+		cv::Mat pending;
+		double pendingTimestamp = 0.0;
+		double pendingSeconds = 0.0;		// Since the first proxy frame.
+		int pendingRepeats = 0;				// Due frames of the grid it is written for.
+		bool hasPending = false;
+
+		// Sensor timestamps (ms), only touched by the preview thread.
+		double firstTimestamp = -1.0;
+		double nextFrameTimestamp = 0.0;
+
+		std::atomic<long long> framesWritten{ 0 };
+		std::atomic<int> thumbnailsWritten{ 0 };
+		SessionMetadata thumbnailIndex;
+		ThreadPlacement placement;
+		MemoryAccount* memory = nullptr;
+
+		void workerLoop();
+
+	public:
+		ProxyWriter();
+		~ProxyWriter();
+		bool start(const string& proxyDir, const string& thumbnailDir, int height, float fps, float thumbnailInterval, float segmentLength, int thumbnailQuality);
+		bool wants(double timestamp);
+		void submit(double timestamp, const cv::Mat& preview);
+		void stop();
+		void setPlacement(const ThreadPlacement& placement);
+		void setMemoryAccount(MemoryAccount* memory);
+		long long written() const;
+		int thumbnails() const;
+};
+
+#endif // !
@@ -0,0 +1,146 @@
+#include "ROIMeasurement.h"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <librealsense2/rsutil.h>
+
+ROIMeasurement::ROIMeasurement() {
+}
+
+void ROIMeasurement::setDepthScale(float depthScale) {
+	this->depthScale = depthScale;
+}
+
+void ROIMeasurement::setReferencePlane(cv::Point3f normal, float distance) {
+	float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	if (length <= 0.0f) {
+		return;
+	}
+	this->planeNormal = cv::Point3f(normal.x / length, normal.y / length, normal.z / length);
+	this->planeDistance = distance;
+}
+
+ROIStatistics3D ROIMeasurement::measure(const rs2::depth_frame& frame, cv::Rect roi) {
+	ROIStatistics3D statistics;
+
+	rs2_intrinsics intrinsics = frame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+	if (!this->rays.matches(intrinsics)) {
+		this->rays.build(intrinsics);
+	}
+
+	roi = roi & cv::Rect(0, 0, frame.get_width(), frame.get_height());
+	if (roi.width <= 0 || roi.height <= 0) {
+		return statistics;
+	}
+
+	const unsigned char* data = static_cast<const unsigned char*>(frame.get_data());
+	const int stride = frame.get_stride_in_bytes();
+	const float scale = this->depthScale;
+	const float nx = this->planeNormal.x;
+	const float ny = this->planeNormal.y;
+	const float nz = this->planeNormal.z;
+	const float d = this->planeDistance;
+	const bool hasPlane = d > 0.0f;
+
+	double count = 0.0, distance = 0.0, sumX = 0.0, sumY = 0.0, sumZ = 0.0, area = 0.0, volume = 0.0;
+
+	for (int y = roi.y; y < roi.y + roi.height; ++y) {
+		const uint16_t* raw = reinterpret_cast<const uint16_t*>(data + static_cast<size_t>(y) * stride) + roi.x;
+		const float* rx = this->rays.xRow(y) + roi.x;
+		const float* ry = this->rays.yRow(y) + roi.x;
+		const float* length = this->rays.lengthRow(y) + roi.x;
+		const float* footprint = this->rays.areaRow(y) + roi.x;
+
+		// Missing depth is zero, so it drops out of every sum but the height term.
+		float rowCount = 0.0f, rowDistance = 0.0f, rowX = 0.0f, rowY = 0.0f, rowZ = 0.0f, rowArea = 0.0f, rowVolume = 0.0f;
+		for (int i = 0; i < roi.width; ++i) {
+			float z = raw[i] * scale;
+			float valid = raw[i] != 0 ? 1.0f : 0.0f;
+			float px = rx[i] * z;
+			float py = ry[i] * z;
+			float a = footprint[i] * z * z;
+			float h = std::max(d - (nx * px + ny * py + nz * z), 0.0f) * valid;
+
+			rowCount += valid;
+			rowDistance += length[i] * z;
+			rowX += px;
+			rowY += py;
+			rowZ += z;
+			rowArea += a;
+			rowVolume += a * h;
+		}
+
+		count += rowCount;
+		distance += rowDistance;
+		sumX += rowX;
+		sumY += rowY;
+		sumZ += rowZ;
+		area += rowArea;
+		volume += rowVolume;
+	}
+
+	if (count == 0.0) {
+		return statistics;
+	}
+
+	statistics.validPixels = static_cast<int>(count);
+	statistics.meanDistance = static_cast<float>(distance / count);
+	statistics.centroid = cv::Point3f(static_cast<float>(sumX / count), static_cast<float>(sumY / count), static_cast<float>(sumZ / count));
+	statistics.surfaceArea = static_cast<float>(area);
+	statistics.volumeAbovePlane = hasPlane ? static_cast<float>(volume) : 0.0f;
+
+	return statistics;
+}
+
+// ROIHolder lives in preview coordinates.
+cv::Rect ROIMeasurement::previewToColor(const ROIHolder& roi, cv::Size previewSize, cv::Size colorSize) {
+	float x_scaling = static_cast<float>(colorSize.width) / previewSize.width;
+	float y_scaling = static_cast<float>(colorSize.height) / previewSize.height;
+
+	return cv::Rect(int(roi.origin.x * x_scaling), int(roi.origin.y * y_scaling),
+					int(roi.width * x_scaling), int(roi.height * y_scaling));
+}
+
+/*
+The preview shows depth aligned to color, so an ROI drawn there has to be
+moved into the raw depth image. The corners are placed at the given distance
+and reprojected, which is exact for a surface at that distance.
+*/
+cv::Rect ROIMeasurement::colorToDepth(cv::Rect colorRect, const rs2_intrinsics& colorIntrinsics,
+									  const rs2_intrinsics& depthIntrinsics, const rs2_extrinsics& colorToDepth, float distance) {
+	float minX = static_cast<float>(depthIntrinsics.width), minY = static_cast<float>(depthIntrinsics.height);
+	float maxX = 0.0f, maxY = 0.0f;
+
+	cv::Point corners[4] = { colorRect.tl(), cv::Point(colorRect.x + colorRect.width, colorRect.y),
+							 cv::Point(colorRect.x, colorRect.y + colorRect.height), colorRect.br() };
+
+	for (const cv::Point& corner : corners) {
+		float colorPixel[2] = { static_cast<float>(corner.x), static_cast<float>(corner.y) };
+		float colorPoint[3], depthPoint[3], depthPixel[2];
+
+		rs2_deproject_pixel_to_point(colorPoint, &colorIntrinsics, colorPixel, distance);
+		rs2_transform_point_to_point(depthPoint, &colorToDepth, colorPoint);
+		rs2_project_point_to_pixel(depthPixel, &depthIntrinsics, depthPoint);
+
+		minX = std::min(minX, depthPixel[0]);
+		minY = std::min(minY, depthPixel[1]);
+		maxX = std::max(maxX, depthPixel[0]);
+		maxY = std::max(maxY, depthPixel[1]);
+	}
+
+	cv::Rect depthRect(int(minX), int(minY), int(maxX - minX), int(maxY - minY));
+	return depthRect & cv::Rect(0, 0, depthIntrinsics.width, depthIntrinsics.height);
+}
+
+string ROIMeasurement::describe(const ROIStatistics3D& statistics) {
+	ostringstream text;
+	text << std::fixed << std::setprecision(3)
+		 << "ROI: " << statistics.meanDistance << " m, centroid ("
+		 << statistics.centroid.x << ", " << statistics.centroid.y << ", " << statistics.centroid.z << ")";
+
+	if (statistics.volumeAbovePlane > 0.0f) {
+		text << ", volume " << std::setprecision(1) << statistics.volumeAbovePlane * 1e6f << " ml";
+	}
+	return text.str();
+}
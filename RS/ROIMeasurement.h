@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "RayTable.h"
+#include "ROIHolder.h"
+
+#ifndef ROIMEASUREMENT_H
+#define ROIMEASUREMENT_H
+
+using namespace std;
+
+struct ROIStatistics3D {
+	int validPixels = 0;
+	float meanDistance = 0.0f;		// Along the ray, in meters.
+	cv::Point3f centroid;			// Camera coordinates, in meters.
+	float surfaceArea = 0.0f;		// Square meters facing the camera.
+	float volumeAbovePlane = 0.0f;	// Cubic meters between the surface and the reference plane.
+};
+
+/*
+3D statistics of a rectangle of a depth frame. Rays are computed once per
+set of intrinsics, after that a measurement only touches the ROI rows with
+straight loops over contiguous arrays, so it is cheap enough for every frame.
+*/
+class ROIMeasurement
+{
+	private:
+		RayTable rays;
+		float depthScale = 0.001f;
+
+		// Reference plane n.P = d, heights are measured towards the camera.
+		cv::Point3f planeNormal = cv::Point3f(0.0f, 0.0f, 1.0f);
+		float planeDistance = 0.0f;
+
+	public:
+		ROIMeasurement();
+		void setDepthScale(float depthScale);
+		void setReferencePlane(cv::Point3f normal, float distance);
+		ROIStatistics3D measure(const rs2::depth_frame& frame, cv::Rect roi);
+
+		static cv::Rect previewToColor(const ROIHolder& roi, cv::Size previewSize, cv::Size colorSize);
+		static cv::Rect colorToDepth(cv::Rect colorRect, const rs2_intrinsics& colorIntrinsics,
+									 const rs2_intrinsics& depthIntrinsics, const rs2_extrinsics& colorToDepth, float distance);
+		static string describe(const ROIStatistics3D& statistics);
+};
+
+#endif // !
@@ -0,0 +1,233 @@
+#include "ROITimeSeries.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdint>
+
+ROITimeSeries::ROITimeSeries() : frames(8) {
+}
+
+ROITimeSeries::~ROITimeSeries() {
+	this->stop();
+}
+
+void ROITimeSeries::addRegion(cv::Rect region) {
+	std::lock_guard<std::mutex> guard(this->regionLock);
+	this->regions.push_back(region);
+}
+
+void ROITimeSeries::clearRegions() {
+	std::lock_guard<std::mutex> guard(this->regionLock);
+	this->regions.clear();
+}
+
+// The holder is taken to be in depth pixel coordinates.
+void ROITimeSeries::addRegion(const ROIHolder& region) {
+	this->addRegion(cv::Rect(region.origin.x, region.origin.y, region.width, region.height));
+}
+
+void ROITimeSeries::setRegion(size_t index, cv::Rect region) {
+	std::lock_guard<std::mutex> guard(this->regionLock);
+	if (index < this->regions.size()) {
+		this->regions[index] = region;
+	}
+}
+
+size_t ROITimeSeries::regionCount() {
+	std::lock_guard<std::mutex> guard(this->regionLock);
+	return this->regions.size();
+}
+
+bool ROITimeSeries::start(const string& filename, float depthScale) {
+	if (this->running || this->regionCount() == 0) {
+		return false;
+	}
+
+	this->output.open(filename, std::ios::binary | std::ios::trunc);
+	if (!this->output.is_open()) {
+		std::cerr << "Failed to open ROI time series " << filename << endl;
+		return false;
+	}
+
+	this->depthScale = depthScale;
+	this->recordsWritten = 0;
+	this->writeHeader();
+
+	this->running = true;
+	this->worker = std::thread(&ROITimeSeries::workerLoop, this);
+	return true;
+}
+
+void ROITimeSeries::writeHeader() {
+	std::lock_guard<std::mutex> guard(this->regionLock);
+
+	uint32_t version = 1;
+	uint32_t count = static_cast<uint32_t>(this->regions.size());
+	this->output.write("RSTS", 4);
+	this->output.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	this->output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	this->output.write(reinterpret_cast<const char*>(&this->depthScale), sizeof(this->depthScale));
+
+	for (const cv::Rect& region : this->regions) {
+		int32_t rect[4] = { region.x, region.y, region.width, region.height };
+		this->output.write(reinterpret_cast<const char*>(rect), sizeof(rect));
+	}
+}
+
+// Called from the capture loop with every raw depth frame, the queue drops the oldest frame when the worker falls behind.
+void ROITimeSeries::enqueue(const rs2::frame& depthFrame) {
+	if (this->running && depthFrame) {
+		this->frames.enqueue(depthFrame);
+		if (this->memory != nullptr) {
+			this->memory->set(static_cast<long long>(this->frames.size()) * depthFrame.get_data_size());
+		}
+	}
+}
+
+void ROITimeSeries::workerLoop() {
+	if (this->placement.isSet()) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	rs2::frame frame;
+	while (this->running) {
+		if (!this->frames.try_wait_for_frame(&frame, 100)) {
+			continue;
+		}
+		if (this->memory != nullptr) {
+			this->memory->set(static_cast<long long>(this->frames.size()) * frame.get_data_size());
+		}
+
+		rs2::depth_frame depthFrame = frame.as<rs2::depth_frame>();
+		if (depthFrame) {
+			this->process(depthFrame);
+		}
+	}
+
+	// Whatever was queued before stop() still belongs to the series.
+	while (this->frames.poll_for_frame(&frame)) {
+		rs2::depth_frame depthFrame = frame.as<rs2::depth_frame>();
+		if (depthFrame) {
+			this->process(depthFrame);
+		}
+	}
+	if (this->memory != nullptr) {
+		this->memory->set(0);
+	}
+}
+
+void ROITimeSeries::process(const rs2::depth_frame& frame) {
+	vector<cv::Rect> current;
+	{
+		std::lock_guard<std::mutex> guard(this->regionLock);
+		current = this->regions;
+	}
+
+	// Integrate only the bounding box of all regions.
+	cv::Rect frameRect(0, 0, frame.get_width(), frame.get_height());
+	cv::Rect bounds;
+	for (cv::Rect& region : current) {
+		region = region & frameRect;
+		bounds = bounds.area() == 0 ? region : (bounds | region);
+	}
+
+	double timestamp = frame.get_timestamp();
+	uint64_t frameNumber = frame.get_frame_number();
+	this->output.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+	this->output.write(reinterpret_cast<const char*>(&frameNumber), sizeof(frameNumber));
+
+	if (bounds.area() > 0) {
+		cv::Mat depth(cv::Size(frame.get_width(), frame.get_height()), CV_16UC1,
+					  (void*)frame.get_data(), frame.get_stride_in_bytes());
+		cv::Mat crop = depth(bounds);
+
+		// Zero depth adds nothing to the sums, the mask only has to count the valid pixels.
+		cv::integral(crop, this->sum, this->squaredSum, CV_64F, CV_64F);
+		cv::compare(crop, 0, this->validMask, cv::CMP_GT);
+		cv::integral(this->validMask, this->count, CV_32S);
+	}
+
+	const double scale = this->depthScale;
+	for (const cv::Rect& region : current) {
+		float mean = 0.0f, variance = 0.0f;
+		uint32_t valid = 0;
+
+		if (region.area() > 0) {
+			int x0 = region.x - bounds.x, y0 = region.y - bounds.y;
+			int x1 = x0 + region.width, y1 = y0 + region.height;
+
+			double s = this->sum.at<double>(y1, x1) - this->sum.at<double>(y0, x1) - this->sum.at<double>(y1, x0) + this->sum.at<double>(y0, x0);
+			double sq = this->squaredSum.at<double>(y1, x1) - this->squaredSum.at<double>(y0, x1) - this->squaredSum.at<double>(y1, x0) + this->squaredSum.at<double>(y0, x0);
+			int n = (this->count.at<int>(y1, x1) - this->count.at<int>(y0, x1) - this->count.at<int>(y1, x0) + this->count.at<int>(y0, x0)) / 255;
+
+			if (n > 0) {
+				double meanUnits = s / n;
+				mean = static_cast<float>(meanUnits * scale);
+				variance = static_cast<float>(std::max(0.0, sq / n - meanUnits * meanUnits) * scale * scale);
+				valid = static_cast<uint32_t>(n);
+			}
+		}
+
+		this->output.write(reinterpret_cast<const char*>(&mean), sizeof(mean));
+		this->output.write(reinterpret_cast<const char*>(&variance), sizeof(variance));
+		this->output.write(reinterpret_cast<const char*>(&valid), sizeof(valid));
+	}
+
+	// Flush about once a second so a crash loses little of the series.
+	if (++this->recordsWritten % 30 == 0) {
+		this->output.flush();
+	}
+}
+
+void ROITimeSeries::setPlacement(const ThreadPlacement& placement) {
+	this->placement = placement;
+}
+
+void ROITimeSeries::setMemoryAccount(MemoryAccount* memory) {
+	this->memory = memory;
+}
+
+void ROITimeSeries::stop() {
+	if (!this->running) {
+		return;
+	}
+
+	this->running = false;
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	this->output.close();
+}
+
+long long ROITimeSeries::written() const {
+	return this->recordsWritten;
+}
+
+// "x,y,width,height; x,y,width,height" in depth pixels.
+vector<cv::Rect> ROITimeSeries::parseRegions(const string& value) {
+	vector<cv::Rect> parsed;
+	stringstream list(value);
+	string entry;
+
+	while (getline(list, entry, ';')) {
+		stringstream fields(entry);
+		string field;
+		vector<int> numbers;
+		while (getline(fields, field, ',')) {
+			try {
+				numbers.push_back(stoi(field));
+			}
+			catch (const std::exception&) {
+				break;
+			}
+		}
+
+		if (numbers.size() == 4 && numbers[2] > 0 && numbers[3] > 0) {
+			parsed.push_back(cv::Rect(numbers[0], numbers[1], numbers[2], numbers[3]));
+		}
+		else if (entry.find_first_not_of(" \t") != string::npos) {
+			std::cerr << "Ignoring ROI region \"" << entry << "\", expected x,y,width,height." << endl;
+		}
+	}
+	return parsed;
+}
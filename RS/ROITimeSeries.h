@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include "opencv2/opencv.hpp"
+#include <librealsense2/rs.hpp>
+#include "ThreadPlacement.h"
+#include "MemoryBudget.h"
+#include "ROIHolder.h"
+
+#ifndef ROITIMESERIES_H
+#define ROITIMESERIES_H
+
+using namespace std;
+
+/*
+Mean and variance of depth inside any number of regions for every raw depth
+frame, on its own thread. Each frame gets one integral image of the sum, the
+squared sum and the valid pixel count over the bounding box of all regions,
+after which every region costs four lookups per table.
+
+roi_series.bin, little endian:
+	header	char[4] "RSTS", uint32 version, uint32 regions, float depth scale,
+			then x, y, width, height as int32 for every region (depth pixels)
+	record	double timestamp (ms), uint64 frame number,
+			then float mean (m), float variance (m^2), uint32 valid pixels per region
+Missing depth (zero) is left out of the statistics.
+*/
+class ROITimeSeries
+{
+	private:
+		vector<cv::Rect> regions;
+		std::mutex regionLock;
+		float depthScale = 0.001f;
+
+		rs2::frame_queue frames;
+		std::thread worker;
+		std::atomic<bool> running{ false };
+		std::atomic<long long> recordsWritten{ 0 };
+
+		ofstream output;
+		cv::Mat sum, squaredSum, count, validMask;
+
+		ThreadPlacement placement;
+		MemoryAccount* memory = nullptr;
+
+		void workerLoop();
+		void writeHeader();
+		void process(const rs2::depth_frame& frame);
+
+	public:
+		ROITimeSeries();
+		~ROITimeSeries();
+		void addRegion(cv::Rect region);
+		void addRegion(const ROIHolder& region);
+		void setRegion(size_t index, cv::Rect region);
+		void clearRegions();
+		size_t regionCount();
+		bool start(const string& filename, float depthScale);
+		void enqueue(const rs2::frame& depthFrame);
+		void stop();
+		void setPlacement(const ThreadPlacement& placement);
+		void setMemoryAccount(MemoryAccount* memory);
+		long long written() const;
+
+		static vector<cv::Rect> parseRegions(const string& value);
+};
+
+#endif // !
@@ -5,9 +5,108 @@
 #include <opencv2/core/base.hpp>
 #include <iostream>
 #include "Utilities.h"
+#include "RecorderOptions.h"
+#include "ProfileCalibrator.h"
+#include "PointCloudExporter.h"
+#include "JournalRecovery.h"
+#include "DepthReprocessor.h"
+#include "JitterBenchmark.h"
+#include "KernelBenchmark.h"
+#include "SessionManifest.h"
+#include "RecorderDaemon.h"
+#include <thread>
 
 using namespace std;
-int main() {
+int main(int argc, char* argv[]) {
+
+    // RS.exe --calibrate [seconds per trial]
+    if (argc > 1 && string(argv[1]) == "--calibrate") {
+        RecorderOptions options;
+        loadRecorderOptions(recordingsDirectory + "recorder_options.cfg", options);
+
+        float trialSeconds = argc > 2 ? stof(argv[2]) : 10.0f;
+        ProfileCalibrator calibrator(recordingsDirectory, trialSeconds, 0.25f, options.minDepthSamplingRatio);
+        return calibrator.run() ? 0 : 1;
+    }
+
+    // RS.exe --export-pointcloud <session directory> [ply|xyz] [first frame] [last frame] [threads]
+    if (argc > 2 && string(argv[1]) == "--export-pointcloud") {
+        string format = argc > 3 ? string(argv[3]) : "ply";
+        int firstFrame = argc > 4 ? stoi(argv[4]) : 0;
+        int lastFrame = argc > 5 ? stoi(argv[5]) : -1;
+        unsigned int threads = argc > 6 ? static_cast<unsigned int>(stoi(argv[6])) : 0;
+
+        PointCloudExporter exporter(argv[2], format, firstFrame, lastFrame, threads);
+        return exporter.run() ? 0 : 1;
+    }
+
+    // RS.exe --recover <session directory>
+    if (argc > 2 && string(argv[1]) == "--recover") {
+        JournalRecovery recovery(argv[2]);
+        return recovery.run() ? 0 : 1;
+    }
+
+    // RS.exe --reprocess <session directory> [filter settings file] [threads] [video|journal]
+    if (argc > 2 && string(argv[1]) == "--reprocess") {
+        string filterFile = argc > 3 ? string(argv[3]) : "";
+        unsigned int threads = argc > 4 ? static_cast<unsigned int>(stoi(argv[4])) : 0;
+        string container = argc > 5 ? string(argv[5]) : "video";
+
+        DepthReprocessor reprocessor(argv[2], filterFile, threads, container);
+        return reprocessor.run() ? 0 : 1;
+    }
+
+    // RS.exe --jitter-benchmark [seconds per trial] [load threads]
+    if (argc > 1 && string(argv[1]) == "--jitter-benchmark") {
+        RecorderOptions options;
+        loadRecorderOptions(recordingsDirectory + "recorder_options.cfg", options);
+
+        float trialSeconds = argc > 2 ? stof(argv[2]) : 30.0f;
+        int loadThreads = argc > 3 ? stoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+        JitterBenchmark benchmark(recordingsDirectory, trialSeconds, loadThreads, options);
+        return benchmark.run() ? 0 : 1;
+    }
+
+    // RS.exe --locate <session directory> <stream> <timestamp ms>
+    if (argc > 4 && string(argv[1]) == "--locate") {
+        string sessionDir = string(argv[2]);
+        if (sessionDir.back() != '/' && sessionDir.back() != '\\') {
+            sessionDir += "/";
+        }
+
+        vector<ManifestSegment> segments;
+        ManifestSegment segment;
+        uint32_t frameIndex = 0;
+        if (!SessionManifest::load(sessionDir + "manifest.json", segments) ||
+            !SessionManifest::locate(sessionDir, segments, argv[3], stod(argv[4]), segment, frameIndex)) {
+            cerr << "No " << argv[3] << " frame near " << argv[4] << " in " << sessionDir << "manifest.json" << endl;
+            return 1;
+        }
+        cout << segment.file << " frame " << frameIndex << endl;
+        return 0;
+    }
+
+    // RS.exe --benchmark [seconds per kernel] [kernel name filter] [output file]
+    if (argc > 1 && string(argv[1]) == "--benchmark") {
+        float seconds = argc > 2 ? stof(argv[2]) : 2.0f;
+        string filter = argc > 3 ? string(argv[3]) : "";
+        string outputFile = argc > 4 ? string(argv[4]) : recordingsDirectory + "kernel_benchmark.json";
+
+        KernelBenchmark benchmark(outputFile, recordingsDirectory, seconds, filter);
+        return benchmark.run() ? 0 : 1;
+    }
+
+    // RS.exe --daemon, sessions on a schedule or on a command, see RecorderDaemon.
+    if (argc > 1 && string(argv[1]) == "--daemon") {
+        RecorderOptions options;
+        loadRecorderOptions(recordingsDirectory + "recorder_options.cfg", options);
+
+        VideoRecorder recorder(3.0, 180.0, true, true);
+        RecorderDaemon daemon(recorder, options, recordingsDirectory + "recorder_command.txt");
+        int result = daemon.run();
+        recorder.stopPipeline();
+        return result;
+    }
 
     VideoRecorder recorder(3.0, 180.0, true, true);
     recorder.verifySetUp();
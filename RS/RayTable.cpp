@@ -0,0 +1,83 @@
+#include "RayTable.h"
+
+#include <cstring>
+#include <cmath>
+#include <librealsense2/rsutil.h>
+
+RayTable::RayTable() {
+	std::memset(&this->intrinsics, 0, sizeof(this->intrinsics));
+}
+
+RayTable::RayTable(const rs2_intrinsics& intrinsics) {
+	this->build(intrinsics);
+}
+
+void RayTable::build(const rs2_intrinsics& intrinsics) {
+	this->intrinsics = intrinsics;
+	this->width = intrinsics.width;
+	this->height = intrinsics.height;
+	this->rayX.resize(static_cast<size_t>(this->width) * this->height);
+	this->rayY.resize(static_cast<size_t>(this->width) * this->height);
+	this->rayLength.resize(static_cast<size_t>(this->width) * this->height);
+	this->pixelArea.resize(static_cast<size_t>(this->width) * this->height);
+
+	for (int y = 0; y < this->height; ++y) {
+		for (int x = 0; x < this->width; ++x) {
+			float pixel[2] = { static_cast<float>(x), static_cast<float>(y) };
+			float point[3];
+			rs2_deproject_pixel_to_point(point, &this->intrinsics, pixel, 1.0f);
+
+			size_t index = static_cast<size_t>(y) * this->width + x;
+			this->rayX[index] = point[0];
+			this->rayY[index] = point[1];
+			this->rayLength[index] = std::sqrt(point[0] * point[0] + point[1] * point[1] + 1.0f);
+		}
+	}
+
+	// Footprint of a pixel at unit depth, from the spacing of neighbouring rays.
+	for (int y = 0; y < this->height; ++y) {
+		int below = y + 1 < this->height ? y + 1 : y - 1;
+		for (int x = 0; x < this->width; ++x) {
+			int right = x + 1 < this->width ? x + 1 : x - 1;
+			size_t index = static_cast<size_t>(y) * this->width + x;
+			float dx = this->rayX[static_cast<size_t>(y) * this->width + right] - this->rayX[index];
+			float dy = this->rayY[static_cast<size_t>(below) * this->width + x] - this->rayY[index];
+			this->pixelArea[index] = std::fabs(dx * dy);
+		}
+	}
+}
+
+bool RayTable::matches(const rs2_intrinsics& intrinsics) const {
+	return this->width == intrinsics.width
+		&& this->height == intrinsics.height
+		&& this->intrinsics.fx == intrinsics.fx
+		&& this->intrinsics.fy == intrinsics.fy
+		&& this->intrinsics.ppx == intrinsics.ppx
+		&& this->intrinsics.ppy == intrinsics.ppy
+		&& this->intrinsics.model == intrinsics.model
+		&& std::memcmp(this->intrinsics.coeffs, intrinsics.coeffs, sizeof(intrinsics.coeffs)) == 0;
+}
+
+int RayTable::getWidth() const {
+	return this->width;
+}
+
+int RayTable::getHeight() const {
+	return this->height;
+}
+
+const float* RayTable::xRow(int y) const {
+	return this->rayX.data() + static_cast<size_t>(y) * this->width;
+}
+
+const float* RayTable::yRow(int y) const {
+	return this->rayY.data() + static_cast<size_t>(y) * this->width;
+}
+
+const float* RayTable::lengthRow(int y) const {
+	return this->rayLength.data() + static_cast<size_t>(y) * this->width;
+}
+
+const float* RayTable::areaRow(int y) const {
+	return this->pixelArea.data() + static_cast<size_t>(y) * this->width;
+}
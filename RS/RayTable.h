@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+#ifndef RAYTABLE_H
+#define RAYTABLE_H
+
+using namespace std;
+
+/*
+Per-pixel deprojection rays for one set of intrinsics, stored as X/Z and
+Y/Z planes so a row of depth values turns into points with two multiplies
+per pixel. Distortion is handled once, when the table is built.
+The length plane turns depth into distance along the ray, the area plane
+times depth squared is the surface a pixel covers facing the camera.
+*/
+class RayTable
+{
+	private:
+		rs2_intrinsics intrinsics;
+		int width = 0;
+		int height = 0;
+		vector<float> rayX;
+		vector<float> rayY;
+		vector<float> rayLength;
+		vector<float> pixelArea;
+
+	public:
+		RayTable();
+		explicit RayTable(const rs2_intrinsics& intrinsics);
+		void build(const rs2_intrinsics& intrinsics);
+		bool matches(const rs2_intrinsics& intrinsics) const;
+
+		int getWidth() const;
+		int getHeight() const;
+		const float* xRow(int y) const;
+		const float* yRow(int y) const;
+		const float* lengthRow(int y) const;
+		const float* areaRow(int y) const;
+};
+
+#endif // !
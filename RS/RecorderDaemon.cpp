@@ -0,0 +1,156 @@
+#include "RecorderDaemon.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <ctime>
+
+RecorderDaemon::RecorderDaemon(VideoRecorder& recorder, const RecorderOptions& options, const string& commandFile)
+	: recorder(recorder), options(options), commandFile(commandFile) {
+	this->schedule = parseSchedule(options.daemonSchedule);
+	this->lastIntervalStart = std::chrono::steady_clock::now();
+}
+
+RecorderDaemon::~RecorderDaemon() {
+	this->running = false;
+	if (this->watcher.joinable()) {
+		this->watcher.join();
+	}
+}
+
+// "08:00, 14:30" as minutes after midnight.
+vector<int> RecorderDaemon::parseSchedule(const string& value) {
+	vector<int> parsed;
+	stringstream list(value);
+	string entry;
+
+	while (getline(list, entry, ',')) {
+		int hours = 0, minutes = 0;
+		char separator = 0;
+		stringstream time(entry);
+		if (time >> hours >> separator >> minutes && separator == ':' && hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60) {
+			parsed.push_back(hours * 60 + minutes);
+		}
+		else if (entry.find_first_not_of(" \t") != string::npos) {
+			std::cerr << "Ignoring scheduled start \"" << entry << "\", expected HH:MM." << endl;
+		}
+	}
+	return parsed;
+}
+
+void RecorderDaemon::watchCommands() {
+	while (this->running) {
+		ifstream file(this->commandFile);
+		if (file.is_open()) {
+			string command;
+			file >> command;
+			file.close();
+			std::remove(this->commandFile.c_str());
+			this->handleCommand(command);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+void RecorderDaemon::handleCommand(const string& command) {
+	if (command == "start") {
+		if (this->recording) {
+			std::cout << "A session is already recording." << endl;
+			return;
+		}
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->trigger = std::chrono::steady_clock::now();
+		this->startRequested = true;
+	}
+	else if (command == "stop") {
+		this->recorder.requestStop();
+	}
+	else if (command == "quit") {
+		this->quitRequested = true;
+		this->recorder.requestStop();
+	}
+	else if (!command.empty()) {
+		std::cerr << "Unknown command \"" << command << "\" in " << this->commandFile << ", expected start, stop or quit." << endl;
+	}
+}
+
+// Each scheduled minute starts one session, a session still running at the next one doesn't start another.
+bool RecorderDaemon::scheduledStartDue() {
+	auto now = std::chrono::steady_clock::now();
+	if (this->options.daemonIntervalMinutes > 0.0f &&
+		std::chrono::duration<float>(now - this->lastIntervalStart).count() >= this->options.daemonIntervalMinutes * 60.0f) {
+		this->lastIntervalStart = now;
+		return true;
+	}
+
+	if (this->schedule.empty()) {
+		return false;
+	}
+
+	std::time_t wallClock = std::time(0);
+	tm timeinfo;
+	localtime_s(&timeinfo, &wallClock);
+	int minute = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+	if (minute == this->lastScheduledMinute) {
+		return false;
+	}
+	for (int scheduled : this->schedule) {
+		if (scheduled == minute) {
+			this->lastScheduledMinute = minute;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Polled by the recorder's idle loop with every frameset.
+bool RecorderDaemon::startDue() {
+	if (this->quitRequested || this->startRequested) {
+		return true;
+	}
+	if (this->scheduledStartDue()) {
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->trigger = std::chrono::steady_clock::now();
+		this->startRequested = true;
+		return true;
+	}
+	return false;
+}
+
+int RecorderDaemon::run() {
+	this->running = true;
+	this->watcher = std::thread(&RecorderDaemon::watchCommands, this);
+	std::cout << "Recorder waiting for sessions, write start, stop or quit to " << this->commandFile << "." << endl;
+
+	int sessions = 0;
+	while (!this->quitRequested) {
+		this->recorder.idle([this]() { return this->startDue(); }, this->options.daemonIdleFps);
+		if (this->quitRequested) {
+			break;
+		}
+
+		std::chrono::steady_clock::time_point trigger;
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			trigger = this->trigger;
+			this->startRequested = false;
+		}
+
+		this->recording = true;
+		this->recorder.startSession(this->options.daemonSessionMinutes, trigger);
+		this->recorder.recordVideo();
+		this->recording = false;
+		this->lastIntervalStart = std::chrono::steady_clock::now();
+
+		sessions++;
+		if (this->options.daemonMaxSessions > 0 && sessions >= this->options.daemonMaxSessions) {
+			break;
+		}
+	}
+
+	this->running = false;
+	this->watcher.join();
+	std::cout << "Recorder stopped after " << sessions << " sessions." << endl;
+	return 0;
+}
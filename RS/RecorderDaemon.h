@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include "RecorderOptions.h"
+#include "VideoRecorder.h"
+
+#ifndef RECORDERDAEMON_H
+#define RECORDERDAEMON_H
+
+using namespace std;
+
+/*
+Keeps one VideoRecorder, and with it the device, pipeline and sensor
+settings, for any number of sessions. A session starts at the times of
+daemon_schedule, every daemon_interval_min minutes, or when "start" is
+written to the command file. "stop" ends the running session, "quit" the
+daemon. The command file is checked every 100 ms and removed once read.
+Between sessions the recorder idles on the warm pipeline.
+*/
+class RecorderDaemon
+{
+	private:
+		VideoRecorder& recorder;
+		RecorderOptions options;
+		string commandFile;
+		vector<int> schedule;				// Minutes after midnight.
+
+		std::thread watcher;
+		std::atomic<bool> running{ false };
+		std::atomic<bool> startRequested{ false };
+		std::atomic<bool> quitRequested{ false };
+		std::atomic<bool> recording{ false };
+		std::mutex lock;
+		std::chrono::steady_clock::time_point trigger;
+
+		int lastScheduledMinute = -1;
+		std::chrono::steady_clock::time_point lastIntervalStart;
+
+		void watchCommands();
+		void handleCommand(const string& command);
+		bool scheduledStartDue();
+		bool startDue();
+
+	public:
+		RecorderDaemon(VideoRecorder& recorder, const RecorderOptions& options, const string& commandFile);
+		~RecorderDaemon();
+		int run();
+
+		static vector<int> parseSchedule(const string& value);
+};
+
+#endif // !
@@ -0,0 +1,188 @@
+#include "RecorderOptions.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+static string trim(const string& s) {
+	size_t first = s.find_first_not_of(" \t\r");
+	if (first == string::npos) {
+		return "";
+	}
+	size_t last = s.find_last_not_of(" \t\r");
+	return s.substr(first, last - first + 1);
+}
+
+static bool parseBool(const string& value) {
+	return value == "1" || value == "true" || value == "on" || value == "yes";
+}
+
+static bool applyOption(RecorderOptions& options, const string& key, const string& value) {
+
+	// Adaptive load shedding
+	if (key == "adaptive_load_shedding") options.adaptiveLoadShedding = parseBool(value);
+	else if (key == "min_depth_sampling_ratio") options.minDepthSamplingRatio = stoi(value);
+	else if (key == "max_depth_sampling_ratio") options.maxDepthSamplingRatio = stoi(value);
+	else if (key == "min_color_sampling_ratio") options.minColorSamplingRatio = stoi(value);
+	else if (key == "max_color_sampling_ratio") options.maxColorSamplingRatio = stoi(value);
+	else if (key == "min_preview_interval") options.minPreviewInterval = stoi(value);
+	else if (key == "max_preview_interval") options.maxPreviewInterval = stoi(value);
+	else if (key == "load_control_window") options.loadControlWindow = stoi(value);
+	else if (key == "queue_high_watermark") options.queueHighWatermark = stof(value);
+	else if (key == "queue_low_watermark") options.queueLowWatermark = stof(value);
+	else if (key == "writer_high_utilisation") options.writerHighUtilisation = stof(value);
+	else if (key == "writer_low_utilisation") options.writerLowUtilisation = stof(value);
+	else if (key == "shed_after_windows") options.shedAfterWindows = stoi(value);
+	else if (key == "recover_after_windows") options.recoverAfterWindows = stoi(value);
+
+	// Live 3D measurement of the depth ROI
+	else if (key == "roi_measurement") options.roiMeasurement = parseBool(value);
+	else if (key == "roi_reference_plane_m") options.roiReferencePlane = stof(value);
+	else if (key == "depth_quality") options.depthQuality = parseBool(value);
+	else if (key == "depth_quality_stride") options.depthQualityStride = stoi(value);
+	else if (key == "depth_quality_budget_us") options.depthQualityBudgetUs = stof(value);
+	else if (key == "depth_quality_interval_s") options.depthQualityInterval = stof(value);
+
+	// Motion triggered recording
+	else if (key == "motion_trigger") options.motionTrigger = parseBool(value);
+	else if (key == "motion_pre_roll_s") options.motionPreRoll = stof(value);
+	else if (key == "motion_post_roll_s") options.motionPostRoll = stof(value);
+	else if (key == "motion_threshold") options.motionThreshold = stof(value);
+	else if (key == "motion_depth_delta_mm") options.motionDepthDelta = stoi(value);
+	else if (key == "motion_color_delta") options.motionColorDelta = stoi(value);
+	else if (key == "idle_frame_interval") options.idleFrameInterval = stoi(value);
+
+	// Full rate depth statistics of regions
+	else if (key == "roi_series") options.roiSeries = parseBool(value);
+	else if (key == "roi_series_regions") options.roiSeriesRegions = value;
+
+	// Encode only the operator's ROI
+	else if (key == "roi_crop_recording") options.roiCropRecording = parseBool(value);
+	else if (key == "roi_crop_margin") options.roiCropMargin = stof(value);
+	else if (key == "context_interval") options.contextInterval = stoi(value);
+
+	// Wait for auto-exposure before recording
+	else if (key == "exposure_settle_timeout_s") options.exposureSettleTimeout = stof(value);
+	else if (key == "exposure_settle_window") options.exposureSettleWindow = stoi(value);
+	else if (key == "exposure_tolerance") options.exposureTolerance = stof(value);
+	else if (key == "brightness_tolerance") options.brightnessTolerance = stof(value);
+
+	// Pre-roll buffers
+	else if (key == "preview_pre_roll_s") options.previewPreRoll = stof(value);
+	else if (key == "pre_roll_budget_mb") options.preRollBudgetMb = stoi(value);
+	else if (key == "pre_roll_jpeg") options.preRollJpeg = parseBool(value);
+	else if (key == "pre_roll_jpeg_quality") options.preRollJpegQuality = stoi(value);
+
+	// Segment files
+	else if (key == "segment_container") options.segmentContainer = value;
+	else if (key == "journal_lossless_depth") options.journalLosslessDepth = parseBool(value);
+	else if (key == "journal_jpeg_quality") options.journalJpegQuality = stoi(value);
+	else if (key == "raw_depth_archive") options.rawDepthArchive = parseBool(value);
+	else if (key == "infrared") options.infrared = value;
+	else if (key == "infrared_fourcc") options.infraredFourcc = value;
+
+	// Camera health
+	else if (key == "telemetry") options.telemetry = parseBool(value);
+	else if (key == "telemetry_interval_s") options.telemetryInterval = stof(value);
+	else if (key == "imu") options.imu = parseBool(value);
+	else if (key == "imu_gyro_fps") options.imuGyroFps = stoi(value);
+	else if (key == "imu_accel_fps") options.imuAccelFps = stoi(value);
+	else if (key == "imu_batch_ms") options.imuBatchMs = stoi(value);
+	else if (key == "imu_ring_samples") options.imuRingSamples = stoi(value);
+
+	// Color/depth pairing index
+	else if (key == "pairing_index") options.pairingIndex = parseBool(value);
+	else if (key == "pairing_tolerance_ms") options.pairingTolerance = stof(value);
+
+	// Review proxy
+	else if (key == "proxy_stream") options.proxyStream = parseBool(value);
+	else if (key == "proxy_height") options.proxyHeight = stoi(value);
+	else if (key == "proxy_fps") options.proxyFps = stof(value);
+	else if (key == "thumbnail_interval_s") options.thumbnailInterval = stof(value);
+	else if (key == "thumbnail_quality") options.thumbnailQuality = stoi(value);
+
+	// Capture
+	else if (key == "capture_mode") options.captureMode = value;
+
+	// Alignment
+	else if (key == "align_to") options.alignTo = value;
+
+	// Writer pipeline
+	else if (key == "pipeline_executor") options.pipelineExecutor = value;
+	else if (key == "graph_workers") options.graphWorkers = stoi(value);
+	else if (key == "graph_queue") options.graphQueue = stoi(value);
+
+	// Long running recorder
+	else if (key == "daemon_schedule") options.daemonSchedule = value;
+	else if (key == "daemon_interval_min") options.daemonIntervalMinutes = stof(value);
+	else if (key == "daemon_session_min") options.daemonSessionMinutes = stof(value);
+	else if (key == "daemon_idle_fps") options.daemonIdleFps = stoi(value);
+	else if (key == "daemon_max_sessions") options.daemonMaxSessions = stoi(value);
+
+	// Thread placement
+	else if (key == "thread_placement") options.threadPlacement = parseBool(value);
+	else if (key == "process_priority") options.processPriority = value;
+	else if (key == "capture_cores") options.captureCores = value;
+	else if (key == "capture_priority") options.capturePriority = value;
+	else if (key == "writer_cores") options.writerCores = value;
+	else if (key == "writer_priority") options.writerPriority = value;
+	else if (key == "analytics_cores") options.analyticsCores = value;
+	else if (key == "analytics_priority") options.analyticsPriority = value;
+
+	// Frame memory budget
+	else if (key == "memory_budget_mb") options.memoryBudgetMb = stoi(value);
+	else if (key == "memory_policy") options.memoryPolicy = value;
+	else if (key == "memory_block_ms") options.memoryBlockMs = stoi(value);
+	else if (key == "sdk_frames_queue_size") options.sdkFramesQueueSize = stoi(value);
+	else return false;
+
+	return true;
+}
+
+/*
+Reads "key = value" lines, '#' starts a comment. Returns false when the file
+does not exist, in which case the defaults are left untouched.
+*/
+bool loadRecorderOptions(const string& filename, RecorderOptions& options) {
+	ifstream optionsFile(filename);
+
+	if (!optionsFile.is_open()) {
+		return false;
+	}
+
+	string line;
+	int lineNumber = 0;
+
+	while (getline(optionsFile, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != string::npos) {
+			line = line.substr(0, comment);
+		}
+
+		size_t separator = line.find('=');
+		if (trim(line).empty()) {
+			continue;
+		}
+		if (separator == string::npos) {
+			std::cerr << filename << ":" << lineNumber << " is not a key = value pair." << endl;
+			continue;
+		}
+
+		string key = trim(line.substr(0, separator));
+		string value = trim(line.substr(separator + 1));
+
+		try {
+			if (!applyOption(options, key, value)) {
+				std::cerr << filename << ":" << lineNumber << " unknown option " << key << "." << endl;
+			}
+		}
+		catch (const std::exception&) {
+			std::cerr << filename << ":" << lineNumber << " invalid value for " << key << "." << endl;
+		}
+	}
+
+	std::cout << "Loaded recorder options from " << filename << endl;
+	return true;
+}
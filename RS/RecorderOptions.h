@@ -0,0 +1,147 @@
+#pragma once
+#include <string>
+
+#ifndef RECORDEROPTIONS_H
+#define RECORDEROPTIONS_H
+
+using namespace std;
+
+// Root of all sessions, recorder_options.cfg and stream_profile.cfg live here too.
+const string recordingsDirectory = string("C:/Users/Neonatology Research/Documents/SLAPI data/VIDEO_RECORDINGS/");
+
+/*
+Settings that can be changed per deployment without recompiling.
+Features are off by default, so a run without a file records as the
+recorder always did: depth from one frameset in five, color at the camera
+rate. What changes regardless is listed in the README under "Recorder
+options". Values are overridden by a "key = value" file (see
+loadRecorderOptions).
+*/
+struct RecorderOptions {
+
+	// Adaptive load shedding
+	bool adaptiveLoadShedding = false;	// Off: the sampling stays at the minimum ratios.
+	int minDepthSamplingRatio = 5;		// Keep one depth frameset out of N.
+	int maxDepthSamplingRatio = 15;
+	int minColorSamplingRatio = 1;		// Keep one color frame out of N, 1 keeps every frame.
+	int maxColorSamplingRatio = 1;
+	int minPreviewInterval = 1;			// Refresh the preview every N framesets.
+	int maxPreviewInterval = 6;
+	int loadControlWindow = 30;			// Framesets per controller decision.
+	float queueHighWatermark = 0.75f;	// Mean queue occupancy that counts as overloaded.
+	float queueLowWatermark = 0.25f;
+	float writerHighUtilisation = 0.85f;	// Fraction of wall time a writer spends busy.
+	float writerLowUtilisation = 0.60f;
+	int shedAfterWindows = 2;			// Consecutive overloaded windows before degrading.
+	int recoverAfterWindows = 10;		// Consecutive idle windows before restoring.
+
+	// Live 3D measurement of the depth ROI
+	bool roiMeasurement = false;
+	float roiReferencePlane = 0.0f;		// Distance of the mattress plane in meters, 0 disables the volume.
+
+	// Depth quality of the raw frames, see DepthQualityMonitor
+	bool depthQuality = false;
+	int depthQualityStride = 8;			// Every Nth pixel of every Nth row.
+	float depthQualityBudgetUs = 500.0f;	// The stride doubles while a frame takes longer.
+	float depthQualityInterval = 10.0f;	// Seconds per record in session_metadata.json.
+
+	// Motion triggered recording
+	bool motionTrigger = false;
+	float motionPreRoll = 2.0f;			// Seconds kept before activity starts.
+	float motionPostRoll = 5.0f;		// Seconds recorded after the scene is still again.
+	float motionThreshold = 0.01f;		// Fraction of changed pixels that counts as activity.
+	int motionDepthDelta = 15;			// Depth change in millimeters.
+	int motionColorDelta = 12;			// Gray level change.
+	int idleFrameInterval = 0;			// Keep one idle frame out of N, 0 drops them all.
+
+	// Full rate depth statistics of regions, see ROITimeSeries
+	bool roiSeries = false;
+	string roiSeriesRegions;			// "x,y,width,height; ..." in depth pixels, added after the operator's ROI.
+
+	// Encode only the operator's ROI
+	bool roiCropRecording = false;
+	float roiCropMargin = 0.1f;			// Added on every side, as a fraction of the larger ROI side.
+	int contextInterval = 0;			// Keep one full color frame out of N in context/, 0 disables it.
+
+	// Wait for auto-exposure before recording
+	float exposureSettleTimeout = 10.0f;	// Seconds, recording starts anyway after this.
+	int exposureSettleWindow = 15;		// Framesets that have to agree.
+	float exposureTolerance = 0.02f;	// Exposure spread as a fraction of its mean.
+	float brightnessTolerance = 2.0f;	// Brightness spread in gray levels.
+
+	// Pre-roll buffers, for the preview hand over and the motion trigger
+	float previewPreRoll = 0.0f;		// Seconds of preview written before the recording, 0 disables it.
+	int preRollBudgetMb = 512;			// Per stream, 2 s of 1080p BGR at 30 fps take 373 MB.
+	bool preRollJpeg = false;			// Keep pre-roll frames JPEG encoded, about a tenth of the memory.
+	int preRollJpegQuality = 90;
+
+	// Segment files
+	string segmentContainer = "video";	// "journal" keeps segments readable after a crash, see FrameJournal.
+	bool journalLosslessDepth = true;	// PNG for the colorized depth, so it decodes back exactly.
+	int journalJpegQuality = 90;
+	bool rawDepthArchive = false;		// Unfiltered Z16 in depth_raw/N.rsj as well, for re-processing.
+
+	// Infrared
+	string infrared = "off";			// "left", "right" or "both", Y8 at the depth resolution and rate in ir_left/ and ir_right/.
+	string infraredFourcc = "FFV1";		// Lossless and fast on 8 bit grayscale, in .mkv.
+
+	// Camera health
+	bool telemetry = false;
+	float telemetryInterval = 1.0f;		// Seconds between samples.
+
+	// Motion sensor
+	bool imu = false;					// Gyro and accelerometer to imu.bin, on cameras with a motion sensor.
+	int imuGyroFps = 400;				// Nearest rate the sensor offers, 0 the highest.
+	int imuAccelFps = 200;
+	int imuBatchMs = 250;				// Samples accumulate this long before one write.
+	int imuRingSamples = 16384;			// Rounded up to a power of two, a full ring drops samples.
+
+	// Color/depth pairing index
+	bool pairingIndex = false;
+	float pairingTolerance = 17.0f;		// Milliseconds, half a frame at 30 fps.
+
+	// Review proxy and thumbnails, made from the preview
+	bool proxyStream = false;
+	int proxyHeight = 480;
+	float proxyFps = 5.0f;
+	float thumbnailInterval = 10.0f;	// Seconds, 0 disables the thumbnails.
+	int thumbnailQuality = 80;
+
+	// Capture, "poll" waits for framesets on the main thread, "callback" takes them on the SDK's thread.
+	string captureMode = "poll";
+
+	// Alignment, "color" maps depth onto the color pixels, "depth" color onto the depth pixels.
+	string alignTo = "color";
+
+	// Writer pipeline, "threads" runs one thread per writer, "graph" runs every step as a stage on a shared pool.
+	string pipelineExecutor = "threads";
+	int graphWorkers = 0;				// 0: all cores but one.
+	int graphQueue = 4;					// Frames an edge between two stages holds.
+
+	// Long running recorder (RS.exe --daemon)
+	string daemonSchedule;				// Daily start times, "08:00, 14:30".
+	float daemonIntervalMinutes = 0.0f;	// A session every N minutes after the last one ended, 0 disables it.
+	float daemonSessionMinutes = 0.0f;	// 0 keeps the recorder's session length.
+	int daemonIdleFps = 0;				// Stream rate between sessions, 0 keeps the session rate for the fastest start.
+	int daemonMaxSessions = 0;			// 0: until "quit".
+
+	// Thread placement, cores as "0", "1-3" or "0,2", priority realtime, high, normal or low
+	bool threadPlacement = false;
+	string processPriority = "high";
+	string captureCores = "0";			// Capture loop, alignment and the preview.
+	string capturePriority = "realtime";
+	string writerCores;					// Empty: every core but the capture ones.
+	string writerPriority = "normal";
+	string analyticsCores;				// ROI time series and telemetry.
+	string analyticsPriority = "low";
+
+	// Frame memory budget, over every queue and buffer holding frames
+	int memoryBudgetMb = 0;				// 0 only measures.
+	string memoryPolicy = "shed";		// "shed" through the load controller, "drop" framesets, or "block" capture.
+	int memoryBlockMs = 100;			// Longest a blocked frameset waits before it is dropped, in poll mode only.
+	int sdkFramesQueueSize = 0;			// RS2_OPTION_FRAMES_QUEUE_SIZE of the sensors, 0 keeps the SDK's.
+};
+
+bool loadRecorderOptions(const string& filename, RecorderOptions& options);
+
+#endif // !
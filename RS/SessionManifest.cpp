@@ -0,0 +1,277 @@
+#include "SessionManifest.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "SessionMetadata.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+static const size_t frameTableHeader = 8;
+static const size_t frameTableRecord = sizeof(double) + sizeof(uint64_t);
+
+SessionManifest::SessionManifest(const string& baseDirectory) {
+	this->baseDirectory = baseDirectory;
+	this->filename = baseDirectory + "manifest.json";
+	this->lastWrite = std::chrono::steady_clock::now();
+}
+
+static unsigned long long fileBytes(const string& filename) {
+	ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return 0;
+	}
+	return static_cast<unsigned long long>(file.tellg());
+}
+
+// file is relative to the session directory, "color/3.mp4".
+void SessionManifest::beginSegment(const string& stream, int segment, const string& file, const string& codec) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->closeSegment(stream);
+
+	ManifestSegment entry;
+	entry.stream = stream;
+	entry.segment = segment;
+	entry.file = file;
+	entry.frameTable = file.substr(0, file.find_last_of('.')) + ".frames";
+	entry.codec = codec;
+	this->openSegments[stream] = this->segments.size();
+	this->segments.push_back(entry);
+
+	unique_ptr<ofstream> table(new ofstream(this->baseDirectory + entry.frameTable, std::ios::binary | std::ios::trunc));
+	uint32_t version = 1;
+	table->write("RSFT", 4);
+	table->write(reinterpret_cast<const char*>(&version), sizeof(version));
+	table->flush();		// A crash before the next flush still leaves a table with its header.
+	this->frameTables[stream] = std::move(table);
+
+	this->writeFile();
+}
+
+void SessionManifest::addFrame(const string& stream, double timestamp, unsigned long long frameNumber) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	auto open = this->openSegments.find(stream);
+	if (open == this->openSegments.end()) {
+		return;
+	}
+
+	ManifestSegment& entry = this->segments[open->second];
+	if (entry.frames == 0) {
+		entry.firstTimestamp = timestamp;
+	}
+	if (frameNumber != 0) {
+		if (entry.firstFrameNumber == 0) {
+			entry.firstFrameNumber = frameNumber;
+		}
+		entry.lastFrameNumber = frameNumber;
+	}
+	entry.lastTimestamp = timestamp;
+	entry.frames++;
+
+	ofstream& table = *this->frameTables[stream];
+	uint64_t number = frameNumber;
+	table.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+	table.write(reinterpret_cast<const char*>(&number), sizeof(number));
+
+	if (std::chrono::steady_clock::now() - this->lastWrite > std::chrono::seconds(10)) {
+		for (auto& open : this->frameTables) {
+			open.second->flush();
+		}
+		this->writeFile();
+	}
+}
+
+void SessionManifest::endSegment(const string& stream) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->closeSegment(stream);
+	this->writeFile();
+}
+
+void SessionManifest::finish() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	while (!this->openSegments.empty()) {
+		this->closeSegment(this->openSegments.begin()->first);
+	}
+	this->writeFile();
+}
+
+// Lock held by the caller.
+void SessionManifest::closeSegment(const string& stream) {
+	auto open = this->openSegments.find(stream);
+	if (open == this->openSegments.end()) {
+		return;
+	}
+
+	ManifestSegment& entry = this->segments[open->second];
+	entry.complete = true;
+	entry.bytes = fileBytes(this->baseDirectory + entry.file);
+	this->frameTables.erase(stream);
+	this->openSegments.erase(open);
+}
+
+void SessionManifest::writeFile() {
+	string temporary = this->filename + ".tmp";
+	ofstream manifest(temporary, std::ios::trunc);
+	if (!manifest.is_open()) {
+		std::cerr << "Failed to write the session manifest to " << temporary << endl;
+		return;
+	}
+
+	manifest << "{" << endl;
+	manifest << "    \"version\": 1," << endl;
+	manifest << "    \"segments\": [";
+	for (size_t i = 0; i < this->segments.size(); ++i) {
+		ManifestSegment& entry = this->segments[i];
+		if (!entry.complete) {
+			entry.bytes = fileBytes(this->baseDirectory + entry.file);
+		}
+		double span = (entry.lastTimestamp - entry.firstTimestamp) / 1000.0;
+		entry.effectiveFps = entry.frames > 1 && span > 0.0 ? (entry.frames - 1) / span : 0.0;
+
+		manifest << endl << "        {\"stream\": " << SessionMetadata::text(entry.stream)
+				 << ", \"segment\": " << entry.segment
+				 << ", \"file\": " << SessionMetadata::text(entry.file)
+				 << ", \"frame_table\": " << SessionMetadata::text(entry.frameTable)
+				 << ", \"codec\": " << SessionMetadata::text(entry.codec)
+				 << ", \"first_timestamp\": " << SessionMetadata::number(entry.firstTimestamp)
+				 << ", \"last_timestamp\": " << SessionMetadata::number(entry.lastTimestamp)
+				 << ", \"first_frame_number\": " << entry.firstFrameNumber
+				 << ", \"last_frame_number\": " << entry.lastFrameNumber
+				 << ", \"frames\": " << entry.frames
+				 << ", \"effective_fps\": " << SessionMetadata::number(entry.effectiveFps)
+				 << ", \"bytes\": " << entry.bytes
+				 << ", \"complete\": " << (entry.complete ? "true" : "false") << "}"
+				 << (i + 1 < this->segments.size() ? "," : "");
+	}
+	manifest << endl << "    ]" << endl << "}" << endl;
+	manifest.close();
+
+	// One step, at no point is there no manifest.json for a crash to leave behind.
+#ifdef _WIN32
+	bool replaced = MoveFileExA(temporary.c_str(), this->filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool replaced = std::rename(temporary.c_str(), this->filename.c_str()) == 0;
+#endif
+	if (!replaced) {
+		std::cerr << "Failed to replace " << this->filename << endl;
+	}
+	this->lastWrite = std::chrono::steady_clock::now();
+}
+
+// The text after "key": on a single line record, up to the next ',' or '}'.
+static string recordValue(const string& line, const string& key) {
+	size_t position = line.find("\"" + key + "\":");
+	if (position == string::npos) {
+		return "";
+	}
+	position += key.size() + 3;
+	while (position < line.size() && line[position] == ' ') {
+		position++;
+	}
+	if (position < line.size() && line[position] == '"') {
+		size_t end = line.find('"', position + 1);
+		return line.substr(position + 1, end - position - 1);
+	}
+	size_t end = line.find_first_of(",}", position);
+	return line.substr(position, end - position);
+}
+
+bool SessionManifest::load(const string& filename, vector<ManifestSegment>& segments) {
+	ifstream manifest(filename);
+	if (!manifest.is_open()) {
+		return false;
+	}
+
+	segments.clear();
+	string line;
+	while (getline(manifest, line)) {
+		if (line.find("\"stream\":") == string::npos) {
+			continue;
+		}
+
+		ManifestSegment entry;
+		entry.stream = recordValue(line, "stream");
+		entry.segment = atoi(recordValue(line, "segment").c_str());
+		entry.file = recordValue(line, "file");
+		entry.frameTable = recordValue(line, "frame_table");
+		entry.codec = recordValue(line, "codec");
+		entry.firstTimestamp = atof(recordValue(line, "first_timestamp").c_str());
+		entry.lastTimestamp = atof(recordValue(line, "last_timestamp").c_str());
+		entry.firstFrameNumber = strtoull(recordValue(line, "first_frame_number").c_str(), nullptr, 10);
+		entry.lastFrameNumber = strtoull(recordValue(line, "last_frame_number").c_str(), nullptr, 10);
+		entry.frames = static_cast<uint32_t>(strtoul(recordValue(line, "frames").c_str(), nullptr, 10));
+		entry.effectiveFps = atof(recordValue(line, "effective_fps").c_str());
+		entry.bytes = strtoull(recordValue(line, "bytes").c_str(), nullptr, 10);
+		entry.complete = recordValue(line, "complete") == "true";
+		segments.push_back(entry);
+	}
+	return !segments.empty();
+}
+
+/*
+The segment of the stream that started last before timestamp, then the frame
+closest to it, by binary search over the segment's frame table. Frames still
+in the writer's buffers when the manifest was written are not in the table.
+*/
+bool SessionManifest::locate(const string& sessionDirectory, const vector<ManifestSegment>& segments, const string& stream,
+							 double timestamp, ManifestSegment& segment, uint32_t& frameIndex) {
+	vector<const ManifestSegment*> candidates;
+	for (const ManifestSegment& entry : segments) {
+		if (entry.stream == stream && entry.frames > 0) {
+			candidates.push_back(&entry);
+		}
+	}
+	if (candidates.empty()) {
+		return false;
+	}
+
+	auto after = std::upper_bound(candidates.begin(), candidates.end(), timestamp, [](double value, const ManifestSegment* entry) {
+		return value < entry->firstTimestamp;
+	});
+	segment = **(after == candidates.begin() ? after : after - 1);
+
+	ifstream table(sessionDirectory + segment.frameTable, std::ios::binary | std::ios::ate);
+	if (!table.is_open()) {
+		return false;
+	}
+	// Shorter than its header when the recorder died before writing it out.
+	std::streamoff bytes = table.tellg();
+	if (bytes < static_cast<std::streamoff>(frameTableHeader)) {
+		return false;
+	}
+	uint32_t frames = static_cast<uint32_t>((static_cast<size_t>(bytes) - frameTableHeader) / frameTableRecord);
+	if (frames == 0) {
+		return false;
+	}
+
+	auto timestampAt = [&table](uint32_t index) {
+		double value = 0.0;
+		table.seekg(frameTableHeader + static_cast<size_t>(index) * frameTableRecord);
+		table.read(reinterpret_cast<char*>(&value), sizeof(value));
+		return value;
+	};
+
+	// First frame at or after timestamp, then whichever neighbour is closer.
+	uint32_t low = 0, high = frames;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (timestampAt(middle) < timestamp) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	if (low == frames || (low > 0 && timestamp - timestampAt(low - 1) < timestampAt(low) - timestamp)) {
+		low--;
+	}
+	frameIndex = low;
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+
+#ifndef SESSIONMANIFEST_H
+#define SESSIONMANIFEST_H
+
+using namespace std;
+
+struct ManifestSegment {
+	string stream;						// Directory of the stream: "color", "depth", "context", "depth_raw".
+	int segment = 0;
+	string file;						// Relative to the session directory.
+	string frameTable;
+	string codec;
+	double firstTimestamp = 0.0;		// Sensor timestamps in milliseconds.
+	double lastTimestamp = 0.0;
+	unsigned long long firstFrameNumber = 0;
+	unsigned long long lastFrameNumber = 0;
+	uint32_t frames = 0;
+	double effectiveFps = 0.0;
+	unsigned long long bytes = 0;
+	bool complete = false;
+};
+
+/*
+Keeps manifest.json of a session up to date while the writers run: one line
+per segment and stream with the first and last timestamp and frame number,
+frame count, effective fps, file size and codec. Next to every segment the
+timestamp of each frame goes to N.frames, so a timestamp maps to a segment
+and frame with two binary searches and no video file is opened.
+
+N.frames, little endian: char[4] "RSFT", uint32 version, then per frame
+double timestamp (ms), uint64 frame number (0 for frames from a pre-roll).
+
+The manifest is rewritten when a segment opens or closes and every few
+seconds in between, through a temporary file so a crash leaves the last
+complete version.
+*/
+class SessionManifest
+{
+	private:
+		string baseDirectory;
+		string filename;
+		std::mutex lock;
+		vector<ManifestSegment> segments;
+		map<string, size_t> openSegments;
+		map<string, unique_ptr<ofstream>> frameTables;
+		std::chrono::steady_clock::time_point lastWrite;
+
+		void closeSegment(const string& stream);
+		void writeFile();
+
+	public:
+		SessionManifest(const string& baseDirectory);
+		void beginSegment(const string& stream, int segment, const string& file, const string& codec);
+		void addFrame(const string& stream, double timestamp, unsigned long long frameNumber);
+		void endSegment(const string& stream);
+		void finish();
+
+		static bool load(const string& filename, vector<ManifestSegment>& segments);
+		static bool locate(const string& sessionDirectory, const vector<ManifestSegment>& segments, const string& stream,
+						   double timestamp, ManifestSegment& segment, uint32_t& frameIndex);
+};
+
+#endif // !
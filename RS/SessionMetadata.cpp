@@ -0,0 +1,156 @@
+#include "SessionMetadata.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+SessionMetadata::SessionMetadata() {
+}
+
+void SessionMetadata::setFile(const string& filename) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->filename = filename;
+}
+
+// Starts over for the next session, the file written so far stays as it is.
+void SessionMetadata::clear() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->fieldOrder.clear();
+	this->fields.clear();
+	this->sectionOrder.clear();
+	this->sections.clear();
+}
+
+void SessionMetadata::setField(const string& key, const string& jsonValue) {
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	if (this->fields.find(key) == this->fields.end()) {
+		this->fieldOrder.push_back(key);
+	}
+	this->fields[key] = jsonValue;
+	this->changed();
+}
+
+void SessionMetadata::appendRecord(const string& section, const MetadataRecord& record) {
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	if (this->sections.find(section) == this->sections.end()) {
+		this->sectionOrder.push_back(section);
+	}
+	this->sections[section].push_back(record);
+	this->changed();
+}
+
+void SessionMetadata::flush() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->writeFile();
+}
+
+// Ending the deferral writes what has been waiting.
+void SessionMetadata::setDeferred(bool deferred) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->deferred = deferred;
+	if (!deferred && this->stale) {
+		this->writeFile();
+	}
+}
+
+// The file is written outside the lock, setField and appendRecord don't wait for the disk meanwhile.
+void SessionMetadata::flushPending() {
+	string pendingFile, content;
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		if (!this->stale || this->filename.empty()) {
+			this->stale = false;
+			return;
+		}
+		this->stale = false;
+		pendingFile = this->filename;
+		content = this->render();
+	}
+	save(pendingFile, content);
+}
+
+void SessionMetadata::changed() {
+	if (this->deferred) {
+		this->stale = true;
+		return;
+	}
+	this->writeFile();
+}
+
+void SessionMetadata::writeFile() {
+	this->stale = false;
+	if (this->filename.empty()) {
+		return;
+	}
+	save(this->filename, this->render());
+}
+
+string SessionMetadata::render() const {
+	ostringstream content;
+	size_t entries = this->fieldOrder.size() + this->sectionOrder.size();
+	size_t written = 0;
+
+	content << "{" << endl;
+	for (const string& key : this->fieldOrder) {
+		written++;
+		content << "    \"" << key << "\": " << this->fields.at(key) << (written < entries ? "," : "") << endl;
+	}
+
+	for (const string& section : this->sectionOrder) {
+		written++;
+		const vector<MetadataRecord>& records = this->sections.at(section);
+		content << "    \"" << section << "\": [";
+
+		for (size_t i = 0; i < records.size(); ++i) {
+			content << endl << "        {";
+			for (size_t j = 0; j < records[i].size(); ++j) {
+				content << "\"" << records[i][j].first << "\": " << records[i][j].second;
+				if (j + 1 < records[i].size()) {
+					content << ", ";
+				}
+			}
+			content << "}" << (i + 1 < records.size() ? "," : "");
+		}
+		content << endl << "    ]" << (written < entries ? "," : "") << endl;
+	}
+	content << "}" << endl;
+	return content.str();
+}
+
+void SessionMetadata::save(const string& filename, const string& content) {
+	std::lock_guard<std::mutex> guard(this->fileLock);
+	ofstream metadataFile;
+	metadataFile.open(filename);
+
+	if (!metadataFile.is_open()) {
+		std::cerr << "Failed to write session metadata to " << filename << endl;
+		return;
+	}
+	metadataFile << content;
+	metadataFile.close();
+}
+
+string SessionMetadata::number(double value) {
+	ostringstream formatted;
+	// Sensor timestamps are milliseconds since 1970 and need every digit.
+	if (std::fabs(value) >= 1e6) {
+		formatted << std::fixed << std::setprecision(3);
+	}
+	formatted << value;
+	return formatted.str();
+}
+
+string SessionMetadata::text(const string& value) {
+	string escaped = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped + "\"";
+}
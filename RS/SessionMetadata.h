@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#ifndef SESSIONMETADATA_H
+#define SESSIONMETADATA_H
+
+using namespace std;
+
+typedef vector<pair<string, string>> MetadataRecord;
+
+/*
+Collects everything we learn about a session while recording and keeps
+session_metadata.json up to date. The file is small and is rewritten on
+every change so it stays readable if the recorder dies. While deferred,
+changes only mark the file stale and flushPending() writes it, for callers
+on threads that must not wait for the disk.
+Values are stored already formatted as JSON, use number() and text().
+*/
+class SessionMetadata
+{
+	private:
+		string filename;
+		vector<string> fieldOrder;
+		map<string, string> fields;
+		vector<string> sectionOrder;
+		map<string, vector<MetadataRecord>> sections;
+		mutable std::mutex lock;
+		std::mutex fileLock;				// Held while the file is written, after lock where both are.
+		bool deferred = false;
+		bool stale = false;
+
+		void changed();
+		void writeFile();
+		string render() const;
+		void save(const string& filename, const string& content);
+
+	public:
+		SessionMetadata();
+		void setFile(const string& filename);
+		void clear();
+		void setField(const string& key, const string& jsonValue);
+		void appendRecord(const string& section, const MetadataRecord& record);
+		void flush();
+		void setDeferred(bool deferred);
+		void flushPending();
+
+		static string number(double value);
+		static string text(const string& value);
+};
+
+#endif // !
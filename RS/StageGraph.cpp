@@ -0,0 +1,361 @@
+#include "StageGraph.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+#include "Utilities.h"
+
+// Tasks a stage works through before it yields to the other tasks on its worker.
+static const int stageBatch = 8;
+
+// Worker of the pool the current thread belongs to, for scheduling onto its own deque.
+static thread_local WorkStealingPool* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+WorkStealingPool::WorkStealingPool() {
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	this->stop();
+}
+
+void WorkStealingPool::start(int workers, const ThreadPlacement& placement) {
+	if (this->running) {
+		return;
+	}
+	this->placement = placement;
+	this->running = true;
+	for (int i = 0; i < max(1, workers); ++i) {
+		this->queues.emplace_back(new WorkerQueue());
+	}
+	for (size_t i = 0; i < this->queues.size(); ++i) {
+		this->threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+	}
+}
+
+void WorkStealingPool::schedule(std::function<void()> task) {
+	this->enqueue(std::move(task), false);
+}
+
+// The owner takes its newest task first, so the oldest end makes this task wait for the others on its worker.
+void WorkStealingPool::yield(std::function<void()> task) {
+	this->enqueue(std::move(task), true);
+}
+
+void WorkStealingPool::enqueue(std::function<void()> task, bool oldest) {
+	bool own = currentPool == this;
+	size_t index = own ? currentWorker : this->nextQueue++ % this->queues.size();
+	{
+		std::lock_guard<std::mutex> guard(this->queues[index]->lock);
+		if (own && oldest) {
+			this->queues[index]->tasks.push_front(std::move(task));
+		}
+		else {
+			this->queues[index]->tasks.push_back(std::move(task));
+		}
+	}
+	this->pending++;
+
+	// Taking the lock orders this with a worker between its check and its wait.
+	{ std::lock_guard<std::mutex> guard(this->sleepLock); }
+	this->wake.notify_one();
+}
+
+// Own tasks newest first, they are the ones still in cache, other workers' oldest first.
+bool WorkStealingPool::take(size_t index, std::function<void()>& task) {
+	{
+		WorkerQueue& own = *this->queues[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (size_t offset = 1; offset < this->queues.size(); ++offset) {
+		WorkerQueue& other = *this->queues[(index + offset) % this->queues.size()];
+		std::lock_guard<std::mutex> guard(other.lock);
+		if (!other.tasks.empty()) {
+			task = std::move(other.tasks.front());
+			other.tasks.pop_front();
+			this->steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+	currentPool = this;
+	currentWorker = index;
+	if (this->placement.isSet()) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	std::function<void()> task;
+	while (true) {
+		if (this->take(index, task)) {
+			this->pending--;
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(this->sleepLock);
+		if (!this->running && this->pending == 0) {
+			break;
+		}
+		this->wake.wait_for(guard, std::chrono::milliseconds(5), [this]() { return this->pending > 0 || !this->running; });
+	}
+}
+
+// Runs what is still queued, then joins the workers.
+void WorkStealingPool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(this->sleepLock);
+		if (!this->running) {
+			return;
+		}
+		this->running = false;
+	}
+	this->wake.notify_all();
+	for (std::thread& thread : this->threads) {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+	this->threads.clear();
+	this->queues.clear();
+}
+
+int WorkStealingPool::size() const {
+	return static_cast<int>(this->threads.size());
+}
+
+long long WorkStealingPool::stolen() const {
+	return this->steals;
+}
+
+StageGraph::StageGraph() {
+}
+
+StageGraph::~StageGraph() {
+	this->stop();
+}
+
+int StageGraph::addStage(const string& name, StageFunction function, size_t capacity, int concurrency, WriterStatistics* statistics) {
+	this->stages.emplace_back(new Stage());
+	Stage& stage = *this->stages.back();
+	stage.name = name;
+	stage.function = function;
+	stage.capacity = max<size_t>(1, capacity);
+	stage.concurrency = max(1, concurrency);
+	stage.statistics = statistics;
+	return static_cast<int>(this->stages.size()) - 1;
+}
+
+void StageGraph::connect(int from, int to) {
+	this->stages[from]->successors.push_back(to);
+}
+
+void StageGraph::setMemoryAccount(MemoryAccount* memory) {
+	this->memory = memory;
+}
+
+void StageGraph::start(int workers, const ThreadPlacement& placement) {
+	this->startTime = std::chrono::steady_clock::now();
+	this->pool.start(workers, placement);
+}
+
+long long StageGraph::itemBytes(const StageItem& item) {
+	long long bytes = frameBytes(item.frame);
+	if (!item.image.empty() && (!item.frame || item.image.datastart != item.frame.get_data())) {
+		bytes += static_cast<long long>(item.image.total() * item.image.elemSize());
+	}
+	return bytes;
+}
+
+// Stage lock held by the caller.
+void StageGraph::held(Stage& stage, long long delta) {
+	stage.heldBytes += delta;
+	long long total = this->totalHeldBytes += delta;
+	if (this->memory != nullptr) {
+		this->memory->set(total);
+	}
+}
+
+void StageGraph::submit(int stage, const rs2::frame& frame) {
+	StageItem item;
+	item.frame = frame;
+	this->push(stage, item);
+}
+
+// Callers upstream hold their own stage's lock, so items reach a stage in the order they left the one before.
+void StageGraph::push(int index, StageItem item) {
+	Stage& stage = *this->stages[index];
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> guard(stage.lock);
+		if (stage.input.size() >= stage.capacity) {
+			this->held(stage, -itemBytes(stage.input.front()));
+			stage.input.pop_front();
+			stage.dropped++;
+		}
+		this->held(stage, itemBytes(item));
+		stage.input.push_back(std::move(item));
+		stage.peakQueue = max(stage.peakQueue, stage.input.size());
+
+		if (stage.running < stage.concurrency) {
+			stage.running++;
+			this->activeTasks++;
+			schedule = true;
+		}
+	}
+	if (schedule) {
+		this->pool.schedule([this, index]() { this->runStage(index); });
+	}
+}
+
+/*
+Items are numbered as they are taken off the input edge. Whatever finishes
+waits in finished until every item before it has, then they move on in
+order. An item a stage dropped only advances the count.
+*/
+void StageGraph::runStage(int index) {
+	Stage& stage = *this->stages[index];
+
+	for (int batch = 0; batch < stageBatch; ++batch) {
+		StageItem item;
+		unsigned long long sequence;
+		{
+			std::lock_guard<std::mutex> guard(stage.lock);
+			if (stage.input.empty()) {
+				stage.running--;
+				this->activeTasks--;
+				return;
+			}
+			item = std::move(stage.input.front());
+			stage.input.pop_front();
+			this->held(stage, -itemBytes(item));
+			sequence = stage.nextSequence++;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		bool keep = false;
+		try {
+			keep = stage.function(item);
+		}
+		catch (const cv::Exception& e) {
+			std::cerr << "Stage " << stage.name << " failed: " << e.what() << std::endl;
+			stage.failed++;
+		}
+		catch (const rs2::error& e) {
+			std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << ") in stage " << stage.name << ":\n    " << e.what() << std::endl;
+			stage.failed++;
+		}
+		catch (const std::exception& e) {
+			// Anything else, bad_alloc included, costs the item and not the pool's worker.
+			std::cerr << "Stage " << stage.name << " failed: " << e.what() << std::endl;
+			stage.failed++;
+		}
+		long long busy = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		stage.busyMicroseconds += busy;
+		stage.processed++;
+		if (stage.statistics != nullptr) {
+			stage.statistics->busyMicroseconds += busy;
+		}
+
+		std::lock_guard<std::mutex> guard(stage.lock);
+		stage.finished[sequence] = std::make_pair(keep, std::move(item));
+		while (!stage.finished.empty() && stage.finished.begin()->first == stage.nextRelease) {
+			pair<bool, StageItem>& next = stage.finished.begin()->second;
+			if (next.first) {
+				for (int successor : stage.successors) {
+					this->push(successor, next.second);
+				}
+			}
+			stage.finished.erase(stage.finished.begin());
+			stage.nextRelease++;
+		}
+	}
+
+	// Behind the worker's other tasks, so stages sharing a worker take turns.
+	this->pool.yield([this, index]() { this->runStage(index); });
+}
+
+bool StageGraph::idle() {
+	if (this->activeTasks > 0) {
+		return false;
+	}
+	for (unique_ptr<Stage>& stage : this->stages) {
+		std::lock_guard<std::mutex> guard(stage->lock);
+		if (!stage->input.empty() || !stage->finished.empty()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Waits until every item that was submitted has gone through the graph.
+void StageGraph::drain() {
+	while (!this->idle()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
+
+void StageGraph::stop() {
+	this->pool.stop();
+}
+
+int StageGraph::workers() const {
+	return this->pool.size();
+}
+
+// Fullest input edge from this stage on, a bottleneck further down fills up before the first edge does.
+float StageGraph::occupancy(int index) {
+	Stage& stage = *this->stages[index];
+	float fullest;
+	vector<int> successors;
+	{
+		std::lock_guard<std::mutex> guard(stage.lock);
+		fullest = static_cast<float>(stage.input.size()) / static_cast<float>(stage.capacity);
+		successors = stage.successors;
+	}
+	for (int successor : successors) {
+		fullest = max(fullest, this->occupancy(successor));
+	}
+	return fullest;
+}
+
+// Busy time of each stage as a share of one core.
+string StageGraph::describe() {
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->startTime).count();
+	ostringstream text;
+	text << std::fixed << std::setprecision(0);
+	for (size_t i = 0; i < this->stages.size(); ++i) {
+		const Stage& stage = *this->stages[i];
+		text << (i > 0 ? ", " : "") << stage.name << " " << stage.busyMicroseconds / 1e4 / max(elapsed, 1e-3) << "%";
+	}
+	return text.str();
+}
+
+void StageGraph::report(SessionMetadata& metadata) {
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->startTime).count();
+	metadata.setField("stage_graph_workers", SessionMetadata::number(this->pool.size()));
+	metadata.setField("stage_graph_steals", SessionMetadata::number(static_cast<double>(this->pool.stolen())));
+
+	for (unique_ptr<Stage>& stage : this->stages) {
+		std::lock_guard<std::mutex> guard(stage->lock);
+		metadata.appendRecord("stage_graph", { { "stage", SessionMetadata::text(stage->name) },
+											   { "concurrency", SessionMetadata::number(stage->concurrency) },
+											   { "items", SessionMetadata::number(static_cast<double>(stage->processed.load())) },
+											   { "dropped", SessionMetadata::number(static_cast<double>(stage->dropped.load())) },
+											   { "failed", SessionMetadata::number(static_cast<double>(stage->failed.load())) },
+											   { "busy_s", SessionMetadata::number(stage->busyMicroseconds / 1e6) },
+											   { "utilisation", SessionMetadata::number(stage->busyMicroseconds / 1e6 / max(elapsed, 1e-3)) },
+											   { "peak_queue", SessionMetadata::number(static_cast<double>(stage->peakQueue)) } });
+	}
+}
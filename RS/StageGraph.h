@@ -0,0 +1,141 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <librealsense2/rs.hpp>
+#include "opencv2/opencv.hpp"
+#include "ThreadPlacement.h"
+#include "SessionMetadata.h"
+#include "WriterStatistics.h"
+#include "MemoryBudget.h"
+
+#ifndef STAGEGRAPH_H
+#define STAGEGRAPH_H
+
+using namespace std;
+
+/*
+Fixed set of worker threads, each with its own deque of tasks. A worker
+takes its newest task first and when it has none steals the oldest task of
+another worker, so whichever stage is behind gets every idle core. Tasks
+scheduled from outside the pool are spread over the workers in turn. A
+task that yields goes behind its worker's other tasks instead.
+*/
+class WorkStealingPool
+{
+	private:
+		struct WorkerQueue {
+			std::mutex lock;
+			deque<std::function<void()>> tasks;
+		};
+
+		vector<unique_ptr<WorkerQueue>> queues;
+		vector<std::thread> threads;
+		std::mutex sleepLock;
+		std::condition_variable wake;
+		std::atomic<bool> running{ false };
+		std::atomic<int> pending{ 0 };
+		std::atomic<unsigned int> nextQueue{ 0 };
+		std::atomic<long long> steals{ 0 };
+		ThreadPlacement placement;
+
+		bool take(size_t index, std::function<void()>& task);
+		void enqueue(std::function<void()> task, bool oldest);
+		void workerLoop(size_t index);
+
+	public:
+		WorkStealingPool();
+		~WorkStealingPool();
+		void start(int workers, const ThreadPlacement& placement);
+		void schedule(std::function<void()> task);
+		void yield(std::function<void()> task);
+		void stop();
+		int size() const;
+		long long stolen() const;
+};
+
+// What travels along the edges: the frame keeps the SDK's memory alive for an image that only wraps it.
+struct StageItem {
+	rs2::frame frame;
+	cv::Mat image;
+};
+
+/*
+Small dataflow runtime for the recording pipeline. A stage is a function
+over a StageItem, false drops the item. Every stage has a bounded input
+edge, a full edge drops its oldest item like an rs2::frame_queue. A stage
+runs as tasks on the pool, one item at a time for stages that keep state,
+several at once when created with a concurrency above 1. Either way items
+leave a stage in the order they entered it, so every stream stays ordered.
+
+Busy time, items and drops are kept per stage for describe() and report().
+A stage created with WriterStatistics adds its busy time to them, that is
+what the LoadController reads.
+*/
+class StageGraph
+{
+	public:
+		typedef std::function<bool(StageItem&)> StageFunction;
+
+	private:
+		struct Stage {
+			string name;
+			StageFunction function;
+			size_t capacity = 2;
+			int concurrency = 1;
+			WriterStatistics* statistics = nullptr;
+			vector<int> successors;
+
+			std::mutex lock;
+			deque<StageItem> input;
+			int running = 0;
+			unsigned long long nextSequence = 0;
+			unsigned long long nextRelease = 0;
+			map<unsigned long long, pair<bool, StageItem>> finished;
+
+			std::atomic<long long> busyMicroseconds{ 0 };
+			std::atomic<long long> processed{ 0 };
+			std::atomic<long long> dropped{ 0 };
+			std::atomic<long long> failed{ 0 };
+			size_t peakQueue = 0;
+			long long heldBytes = 0;
+		};
+
+		vector<unique_ptr<Stage>> stages;
+		WorkStealingPool pool;
+		std::chrono::steady_clock::time_point startTime;
+		std::atomic<long long> activeTasks{ 0 };
+		MemoryAccount* memory = nullptr;
+		std::atomic<long long> totalHeldBytes{ 0 };
+
+		void push(int index, StageItem item);
+		void runStage(int index);
+		static long long itemBytes(const StageItem& item);
+		void held(Stage& stage, long long delta);
+
+	public:
+		StageGraph();
+		~StageGraph();
+		int addStage(const string& name, StageFunction function, size_t capacity = 2, int concurrency = 1, WriterStatistics* statistics = nullptr);
+		void connect(int from, int to);
+		void setMemoryAccount(MemoryAccount* memory);
+		void start(int workers, const ThreadPlacement& placement);
+		void submit(int stage, const rs2::frame& frame);
+		bool idle();
+		void drain();
+		void stop();
+		int workers() const;
+		float occupancy(int stage);
+		string describe();
+		void report(SessionMetadata& metadata);
+};
+
+#endif // !
@@ -0,0 +1,85 @@
+#include "StreamProfile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+string StreamProfile::describe() const {
+	ostringstream description;
+	description << "depth " << this->depthWidth << "x" << this->depthHeight << "@" << this->depthFps
+				<< ", color " << this->colorWidth << "x" << this->colorHeight << "@" << this->colorFps
+				<< ", " << this->fourcc;
+	return description.str();
+}
+
+bool loadStreamProfile(const string& filename, StreamProfile& profile) {
+	ifstream profileFile(filename);
+
+	if (!profileFile.is_open()) {
+		return false;
+	}
+
+	StreamProfile loaded = profile;
+	string line;
+
+	while (getline(profileFile, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+
+		istringstream entry(line);
+		string key, separator, value;
+		entry >> key >> separator >> value;
+
+		if (separator != "=" || value.empty()) {
+			std::cerr << "Ignoring malformed line in " << filename << ": " << line << endl;
+			continue;
+		}
+
+		try {
+			if (key == "depth_width") loaded.depthWidth = stoi(value);
+			else if (key == "depth_height") loaded.depthHeight = stoi(value);
+			else if (key == "depth_fps") loaded.depthFps = stoi(value);
+			else if (key == "color_width") loaded.colorWidth = stoi(value);
+			else if (key == "color_height") loaded.colorHeight = stoi(value);
+			else if (key == "color_fps") loaded.colorFps = stoi(value);
+			else if (key == "fourcc" && value.size() == 4) loaded.fourcc = value;
+			else std::cerr << "Ignoring unknown stream profile key " << key << endl;
+		}
+		catch (const std::exception&) {
+			std::cerr << "Invalid value for " << key << " in " << filename << endl;
+			return false;
+		}
+	}
+
+	profile = loaded;
+	std::cout << "Loaded stream profile " << profile.describe() << " from " << filename << endl;
+	return true;
+}
+
+bool saveStreamProfile(const string& filename, const StreamProfile& profile, const string& comment) {
+	ofstream profileFile;
+	profileFile.open(filename);
+
+	if (!profileFile.is_open()) {
+		std::cerr << "Failed to write stream profile to " << filename << endl;
+		return false;
+	}
+
+	istringstream commentLines(comment);
+	string line;
+	while (getline(commentLines, line)) {
+		profileFile << "# " << line << endl;
+	}
+
+	profileFile << "depth_width = " << profile.depthWidth << endl;
+	profileFile << "depth_height = " << profile.depthHeight << endl;
+	profileFile << "depth_fps = " << profile.depthFps << endl;
+	profileFile << "color_width = " << profile.colorWidth << endl;
+	profileFile << "color_height = " << profile.colorHeight << endl;
+	profileFile << "color_fps = " << profile.colorFps << endl;
+	profileFile << "fourcc = " << profile.fourcc << endl;
+	profileFile.close();
+
+	return true;
+}
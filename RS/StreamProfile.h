@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+
+#ifndef STREAMPROFILE_H
+#define STREAMPROFILE_H
+
+using namespace std;
+
+/*
+Stream resolutions, frame rates and encoder used for a recording.
+The defaults are the profile the recorder has always used, a calibrated
+profile for the machine is stored in stream_profile.cfg.
+*/
+struct StreamProfile {
+	int depthWidth = 848;
+	int depthHeight = 480;
+	int depthFps = 30;
+	int colorWidth = 1920;
+	int colorHeight = 1080;
+	int colorFps = 30;
+	string fourcc = "mp4v";
+
+	string describe() const;
+};
+
+bool loadStreamProfile(const string& filename, StreamProfile& profile);
+bool saveStreamProfile(const string& filename, const StreamProfile& profile, const string& comment);
+
+#endif // !
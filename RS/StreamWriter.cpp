@@ -0,0 +1,287 @@
+#include "StreamWriter.h"
+
+#include <iostream>
+#include "Utilities.h"
+
+#include <opencv-3.4/modules/videoio/include/opencv2/videoio/videoio_c.h>
+
+StreamWriter::StreamWriter(const WriterSettings& settings)
+	: settings(settings),
+	  preRoll(settings.preRollSeconds, settings.preRollBudgetBytes, settings.compressPreRoll, settings.preRollQuality),
+	  depthFilters(settings.minDepth, settings.maxDepth),
+	  alignTo(settings.alignTarget),
+	  alignInput(withoutInfrared()) {
+
+	const string& imageType = this->settings.imageType;
+
+	// Raw depth is 16 bit, which only a journal of PNG frames can hold. Infrared stays lossless in a journal too.
+	bool rawDepth = imageType == "depth_raw";
+	this->journal = rawDepth || this->settings.container == "journal";
+	this->journalCodec = rawDepth || imageType == "infrared" || (imageType == "depth" && this->settings.losslessDepthJournal) ? JOURNAL_PNG : JOURNAL_JPEG;
+	this->fourcc = CV_FOURCC(this->settings.fourcc[0], this->settings.fourcc[1], this->settings.fourcc[2], this->settings.fourcc[3]);
+	this->extension = this->journal ? ".rsj" : videoExtension(this->settings.fourcc);
+
+	// A crop is encoded at its own size.
+	this->crop = this->settings.crop & cv::Rect(cv::Point(0, 0), this->settings.resolution);
+	this->resolution = this->crop.area() > 0 ? this->crop.size() : this->settings.resolution;
+
+	// The manifest names a stream after its directory, "color/", "context/", ...
+	this->relativeDirectory = this->settings.directory.substr(min(this->settings.baseDirectory.size(), this->settings.directory.size()));
+	this->stream = this->relativeDirectory.substr(0, this->relativeDirectory.find_last_of('/'));
+	this->codec = this->journal ? (this->journalCodec == JOURNAL_PNG ? "rsj-png" : "rsj-jpeg") : this->settings.fourcc;
+
+	// This writer's share of the frame memory budget.
+	if (this->settings.memory != nullptr) {
+		this->preRollMemory = this->settings.memory->account(this->stream + " pre-roll");
+	}
+
+	cout << "Writing in directory:" << this->settings.directory << "for type:" << imageType << endl;
+	cout << "Maximum frames per video:" << static_cast<int>(this->settings.individualVideoLength * this->settings.fps) << endl;
+
+	this->openSegment();
+	this->segmentStart = std::chrono::high_resolution_clock::now();
+}
+
+StreamWriter::~StreamWriter() {
+	this->close();
+}
+
+void StreamWriter::openSegment() {
+	this->filename = this->settings.directory + to_string(this->videoID) + this->extension;
+	this->openFile();
+	if (this->settings.manifest != nullptr) {
+		this->settings.manifest->beginSegment(this->stream, this->videoID, this->relativeDirectory + to_string(this->videoID) + this->extension, this->codec);
+	}
+}
+
+void StreamWriter::openFile() {
+	// A journal takes the place of the video file.
+	if (this->journal) {
+		this->journalWriter.open(this->filename, this->resolution, this->settings.fps, this->journalCodec, this->settings.journalQuality);
+	}
+	else {
+		// Infrared goes in as one channel, FFV1 then keeps it as 8 bit gray.
+		this->writer.open(this->filename, this->fourcc, static_cast<double>(this->settings.fps), this->resolution, this->settings.imageType != "infrared");
+	}
+}
+
+void StreamWriter::nextSegment() {
+	this->videoID++;
+	this->writer.release();
+	this->journalWriter.close();
+	this->openSegment();
+
+	std::cout << "Starting to write video " << this->videoID << " of type: " << this->settings.imageType << " at " << this->settings.fps << " fps." << endl;
+
+	if (this->settings.statistics != nullptr) {
+		this->settings.statistics->currentSegment = this->videoID;
+	}
+
+	this->segmentFrames = 0;
+	this->segmentStart = std::chrono::high_resolution_clock::now();
+}
+
+// A file plays at the rate it was opened with, so a new sampling rate gets a segment of its own. A segment without frames yet is opened again in place.
+void StreamWriter::followSampledFps() {
+	if (this->settings.sampledFps == nullptr) {
+		return;
+	}
+	float fps = this->settings.sampledFps->load();
+	if (fps <= 0.0f || fps == this->settings.fps) {
+		return;
+	}
+	this->settings.fps = fps;
+	if (this->segmentFrames > 0) {
+		this->nextSegment();
+	}
+	else {
+		this->writer.release();
+		this->journalWriter.close();
+		this->openFile();
+	}
+}
+
+// A segment's clock starts with its first frame, so a writer that waits behind a closed gate doesn't roll over empty files.
+void StreamWriter::append(double timestamp, const cv::Mat& image) {
+	if (!this->segmentStarted) {
+		this->segmentStarted = true;
+		this->segmentStart = std::chrono::high_resolution_clock::now();
+	}
+	if (this->journal) {
+		this->journalWriter.write(image, timestamp);
+	}
+	else {
+		this->writer.write(image);
+	}
+	if (this->settings.synchronizer != nullptr) {
+		this->settings.synchronizer->report(this->settings.imageType, this->videoID, this->segmentFrames, timestamp);
+	}
+	if (this->settings.manifest != nullptr) {
+		this->settings.manifest->addFrame(this->stream, timestamp, this->frameNumber);
+	}
+	this->segmentFrames++;
+}
+
+// Frames kept from the preview go to the start of the first segment.
+void StreamWriter::writeCarryOver() {
+	FrameRingBuffer* carryOver = this->settings.carryOver;
+	if (carryOver == nullptr || carryOver->empty()) {
+		return;
+	}
+
+	cout << "Writing " << carryOver->size() << " " << this->settings.imageType << " frames kept from the preview." << endl;
+	carryOver->drain([this](double timestamp, const cv::Mat& image) {
+		this->append(timestamp, this->crop.area() > 0 && image.size() == this->settings.resolution ? image(this->crop) : image);
+	});
+	if (this->settings.memory != nullptr) {
+		this->settings.memory->account(this->stream + " preview pre-roll")->set(0);
+	}
+}
+
+// Framesets handed over by the capture callback are aligned here, single frames pass through.
+rs2::frame StreamWriter::select(const rs2::frame& frame) {
+	if (!frame.is<rs2::frameset>()) {
+		return frame;
+	}
+	// Infrared is in the depth sensor's own pixels, it is never aligned.
+	if (this->settings.imageType == "infrared") {
+		return frame.as<rs2::frameset>().get_infrared_frame(this->settings.streamIndex);
+	}
+	rs2::frameset frameSet = this->settings.alignFrames ? this->alignTo.process(this->alignInput.process(frame)).as<rs2::frameset>() : frame.as<rs2::frameset>();
+	if (this->settings.imageType == "color") {
+		return frameSet.get_color_frame();
+	}
+	return frameSet.get_depth_frame();
+}
+
+bool StreamWriter::admits(const rs2::frame& frame) {
+	const ActivityGate* gate = this->settings.activityGate;
+	if (gate == nullptr || this->settings.preRollSeconds > 0.0f) {
+		return true;
+	}
+	if (gate->isLive(frame.get_timestamp())) {
+		this->idleAdmitted = 0;
+		return true;
+	}
+	return this->settings.idleFrameInterval > 0 && this->idleAdmitted++ % this->settings.idleFrameInterval == 0;
+}
+
+rs2::frame StreamWriter::filter(const rs2::frame& frame) {
+	if (this->settings.imageType != "depth") {
+		return frame;
+	}
+	return this->depthFilters.filter(frame);
+}
+
+rs2::frame StreamWriter::colorize(const rs2::frame& frame) {
+	if (this->settings.imageType != "depth") {
+		return frame;
+	}
+	return this->depthFilters.colorize(frame);
+}
+
+DepthFilterChain* StreamWriter::acquireChain() {
+	std::lock_guard<std::mutex> guard(this->chainLock);
+	if (this->freeChains.empty()) {
+		this->chains.emplace_back(new DepthFilterChain(this->settings.minDepth, this->settings.maxDepth));
+		return this->chains.back().get();
+	}
+	DepthFilterChain* chain = this->freeChains.back();
+	this->freeChains.pop_back();
+	return chain;
+}
+
+void StreamWriter::releaseChain(DepthFilterChain* chain) {
+	std::lock_guard<std::mutex> guard(this->chainLock);
+	this->freeChains.push_back(chain);
+}
+
+// colorize, safe to call from several threads.
+rs2::frame StreamWriter::colorizeConcurrent(const rs2::frame& frame) {
+	if (this->settings.imageType != "depth") {
+		return frame;
+	}
+	DepthFilterChain* chain = this->acquireChain();
+	rs2::frame colorized;
+	try {
+		colorized = chain->colorize(frame);
+	}
+	catch (...) {
+		this->releaseChain(chain);
+		throw;
+	}
+	this->releaseChain(chain);
+	return colorized;
+}
+
+// The image shares the frame's memory where the format allows, the frame has to outlive it.
+cv::Mat StreamWriter::convert(const rs2::frame& frame) const {
+	cv::Mat image = frame_to_mat(frame);
+	if (this->crop.area() > 0) {
+		image = image(this->crop);		// A view into the frame, nothing is copied.
+	}
+	return image;
+}
+
+void StreamWriter::write(const rs2::frame& frame, const cv::Mat& image) {
+	std::chrono::duration<float> segmentElapsed = std::chrono::high_resolution_clock::now() - this->segmentStart;
+	if (this->segmentStarted && this->settings.individualVideoLength <= segmentElapsed.count()) {
+		this->nextSegment();
+	}
+	this->followSampledFps();
+
+	double timestamp = frame.get_timestamp();
+	auto appendPreRoll = [this](double timestamp, const cv::Mat& image) { this->append(timestamp, image); };
+
+	if (this->settings.activityGate == nullptr || this->settings.activityGate->isLive(timestamp)) {
+		// Activity started, the frames leading up to it go first.
+		this->frameNumber = 0;
+		this->preRoll.drain(appendPreRoll);
+		this->idleFrames = 0;
+
+		this->frameNumber = frame.get_frame_number();
+		this->append(timestamp, image);
+	}
+	else if (this->settings.preRollSeconds <= 0.0f || (this->settings.idleFrameInterval > 0 && this->idleFrames++ % this->settings.idleFrameInterval == 0)) {
+		// Without a pre-roll admits already picked the idle frames to keep.
+		this->preRoll.clear();
+		this->frameNumber = frame.get_frame_number();
+		this->append(timestamp, image);
+	}
+	else {
+		this->preRoll.push(timestamp, image);
+		if (this->preRoll.truncated() && !this->truncationReported) {
+			this->truncationReported = true;
+			std::cerr << "Pre-roll of " << this->stream << " holds only " << this->preRoll.heldSeconds() << " of " << this->preRoll.spanSeconds()
+					  << " seconds within pre_roll_budget_mb, raise it or set pre_roll_jpeg." << endl;
+		}
+	}
+
+	if (this->preRollMemory != nullptr) {
+		this->preRollMemory->set(static_cast<long long>(this->preRoll.bytes()));
+	}
+
+	if (this->settings.statistics != nullptr) {
+		this->settings.statistics->framesWritten++;
+	}
+}
+
+void StreamWriter::close() {
+	if (this->closed) {
+		return;
+	}
+	this->closed = true;
+	this->writer.release();
+	this->journalWriter.close();
+	if (this->settings.manifest != nullptr) {
+		this->settings.manifest->endSegment(this->stream);
+	}
+}
+
+const string& StreamWriter::streamName() const {
+	return this->stream;
+}
+
+const string& StreamWriter::currentFile() const {
+	return this->filename;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <librealsense2/rs.hpp>
+#include "opencv2/opencv.hpp"
+#include "WriterSettings.h"
+#include "FrameRingBuffer.h"
+#include "DepthFilterChain.h"
+#include "FrameJournal.h"
+
+#ifndef STREAMWRITER_H
+#define STREAMWRITER_H
+
+using namespace std;
+
+/*
+The steps from a captured frame to a segment file, one method per step so
+writeFrames can run them on its own thread and a StageGraph as separate
+stages: select (align a frameset, take this stream's frame), filter and
+colorize (depth only), convert to an image and crop, write. select, filter,
+colorize and write keep state and take the frames of a stream in order.
+colorizeConcurrent and convert can run on any number of threads at once,
+colorizeConcurrent on colorizers of its own from a pool.
+
+admits runs once per frame, in order, after select, and tells before any
+of the work whether a frame behind a closed activity gate is going to be
+written or held at all: without a pre-roll only the idle frames kept every
+idleFrameInterval are. write applies the gate and pre-roll, reports to the
+synchronizer and the manifest, and starts a new segment every
+individualVideoLength seconds, counted from a segment's first frame.
+*/
+class StreamWriter
+{
+	private:
+		WriterSettings settings;
+		bool journal = false;
+		JournalCodec journalCodec = JOURNAL_JPEG;
+		int fourcc = 0;
+		string extension;
+		string filename;
+		string relativeDirectory;
+		string stream;
+		string codec;
+		cv::Rect crop;
+		cv::Size resolution;
+
+		cv::VideoWriter writer;
+		FrameJournal journalWriter;
+		int videoID = 1;
+		bool segmentStarted = false;
+		uint32_t segmentFrames = 0;
+		std::chrono::high_resolution_clock::time_point segmentStart;
+		unsigned long long frameNumber = 0;		// Of the live frame, pre-roll frames go without.
+
+		// Frames held back while the scene is idle, see ActivityGate.
+		FrameRingBuffer preRoll;
+		int idleFrames = 0;
+		int idleAdmitted = 0;
+		bool truncationReported = false;
+		MemoryAccount* preRollMemory = nullptr;
+
+		DepthFilterChain depthFilters;
+		vector<unique_ptr<DepthFilterChain>> chains;	// For colorizeConcurrent, one per thread using it.
+		vector<DepthFilterChain*> freeChains;
+		std::mutex chainLock;
+		rs2::align alignTo;
+		rs2::filter alignInput;
+		bool closed = false;
+
+		void openSegment();
+		void openFile();
+		void nextSegment();
+		void followSampledFps();
+		void append(double timestamp, const cv::Mat& image);
+		DepthFilterChain* acquireChain();
+		void releaseChain(DepthFilterChain* chain);
+
+	public:
+		StreamWriter(const WriterSettings& settings);
+		~StreamWriter();
+		void writeCarryOver();
+		rs2::frame select(const rs2::frame& frame);
+		bool admits(const rs2::frame& frame);
+		rs2::frame filter(const rs2::frame& frame);
+		rs2::frame colorize(const rs2::frame& frame);
+		rs2::frame colorizeConcurrent(const rs2::frame& frame);
+		cv::Mat convert(const rs2::frame& frame) const;
+		void write(const rs2::frame& frame, const cv::Mat& image);
+		void close();
+		const string& streamName() const;
+		const string& currentFile() const;
+};
+
+#endif // !
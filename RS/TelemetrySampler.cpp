@@ -0,0 +1,185 @@
+#include "TelemetrySampler.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+
+// Options that say something about the health of the camera rather than its image settings.
+static const rs2_option healthOptions[] = {
+	RS2_OPTION_ASIC_TEMPERATURE,
+	RS2_OPTION_PROJECTOR_TEMPERATURE,
+	RS2_OPTION_MOTION_MODULE_TEMPERATURE,
+	RS2_OPTION_LASER_POWER,
+	RS2_OPTION_EMITTER_ENABLED,
+	RS2_OPTION_EXPOSURE,
+	RS2_OPTION_GAIN
+};
+
+TelemetrySampler::TelemetrySampler() {
+}
+
+TelemetrySampler::~TelemetrySampler() {
+	this->stop();
+}
+
+void TelemetrySampler::addSensor(const rs2::sensor& sensor, const string& prefix) {
+	for (rs2_option option : healthOptions) {
+		if (sensor.supports(option)) {
+			this->channels.push_back({ sensor, option, prefix + "." + rs2_option_to_string(option) });
+		}
+	}
+
+	sensor.set_notifications_callback([this](const rs2::notification& notification) {
+		this->countNotification(notification);
+	});
+}
+
+// Runs on an SDK thread.
+void TelemetrySampler::countNotification(const rs2::notification& notification) {
+	switch (notification.get_category()) {
+		case RS2_NOTIFICATION_CATEGORY_FRAMES_TIMEOUT:
+			this->frameTimeouts++;
+			break;
+		case RS2_NOTIFICATION_CATEGORY_FRAME_CORRUPTED:
+			this->corruptedFrames++;
+			break;
+		case RS2_NOTIFICATION_CATEGORY_HARDWARE_ERROR:
+			this->hardwareErrors++;
+			break;
+		default:
+			if (notification.get_severity() >= RS2_LOG_SEVERITY_ERROR) {
+				this->otherErrors++;
+			}
+			return;
+	}
+	std::cerr << "Camera notification: " << notification.get_description() << endl;
+}
+
+bool TelemetrySampler::start(const rs2::device& device, const string& filename, float intervalSeconds) {
+	if (this->running) {
+		return false;
+	}
+
+	this->channels.clear();
+	try {
+		this->addSensor(device.first<rs2::depth_sensor>(), "depth");
+		this->addSensor(device.first<rs2::color_sensor>(), "color");
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+	}
+
+	this->output.open(filename, std::ios::binary | std::ios::trunc);
+	if (!this->output.is_open()) {
+		std::cerr << "Failed to open telemetry file " << filename << endl;
+		return false;
+	}
+	this->writeHeader();
+
+	this->intervalSeconds = intervalSeconds > 0.0f ? intervalSeconds : 1.0f;
+	this->lastValues.assign(this->channels.size(), std::numeric_limits<float>::quiet_NaN());
+	this->startTime = std::chrono::high_resolution_clock::now();
+	this->running = true;
+	this->worker = std::thread(&TelemetrySampler::workerLoop, this);
+	return true;
+}
+
+void TelemetrySampler::writeHeader() {
+	uint32_t version = 1;
+	uint32_t count = static_cast<uint32_t>(this->channels.size());
+	this->output.write("RSTM", 4);
+	this->output.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	this->output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+	for (const Channel& channel : this->channels) {
+		uint32_t length = static_cast<uint32_t>(channel.name.size());
+		this->output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		this->output.write(channel.name.data(), length);
+	}
+}
+
+// Called by the capture loop for every frameset, two atomic stores.
+void TelemetrySampler::noteFrame(double timestamp) {
+	this->lastFrameTimestamp.store(timestamp, std::memory_order_relaxed);
+	this->framesSeen.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TelemetrySampler::sample() {
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - this->startTime;
+	double seconds = elapsed.count();
+	double frameTimestamp = this->lastFrameTimestamp.load();
+	uint64_t frames = this->framesSeen.load();
+	uint32_t counters[4] = { this->frameTimeouts.load(), this->corruptedFrames.load(), this->hardwareErrors.load(), this->otherErrors.load() };
+
+	vector<float> values(this->channels.size(), std::numeric_limits<float>::quiet_NaN());
+	for (size_t i = 0; i < this->channels.size(); ++i) {
+		try {
+			values[i] = this->channels[i].sensor.get_option(this->channels[i].option);
+		}
+		catch (const rs2::error&) {
+			// Unreadable while the camera resets, the gap shows as NaN.
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->lastValues = values;
+	}
+
+	this->output.write(reinterpret_cast<const char*>(&seconds), sizeof(seconds));
+	this->output.write(reinterpret_cast<const char*>(&frameTimestamp), sizeof(frameTimestamp));
+	this->output.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+	this->output.write(reinterpret_cast<const char*>(counters), sizeof(counters));
+	this->output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+	this->output.flush();
+}
+
+void TelemetrySampler::workerLoop() {
+	if (this->placement.isSet()) {
+		std::cout << "Thread placement " << this->placement.apply() << endl;
+	}
+
+	std::unique_lock<std::mutex> guard(this->lock);
+	while (this->running) {
+		guard.unlock();
+		this->sample();
+		guard.lock();
+
+		this->wake.wait_for(guard, std::chrono::duration<float>(this->intervalSeconds), [this]() { return !this->running; });
+	}
+}
+
+void TelemetrySampler::setPlacement(const ThreadPlacement& placement) {
+	this->placement = placement;
+}
+
+void TelemetrySampler::stop() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		if (!this->running) {
+			return;
+		}
+		this->running = false;
+	}
+	this->wake.notify_all();
+
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	this->sample();
+	this->output.close();
+}
+
+// Latest temperatures for the preview and error messages, e.g. "depth.Asic Temperature 41.0".
+string TelemetrySampler::describe() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	ostringstream text;
+	text << std::fixed << std::setprecision(1);
+	for (size_t i = 0; i < this->channels.size() && i < this->lastValues.size(); ++i) {
+		if (this->channels[i].option == RS2_OPTION_ASIC_TEMPERATURE || this->channels[i].option == RS2_OPTION_PROJECTOR_TEMPERATURE) {
+			text << (text.tellp() > 0 ? ", " : "") << this->channels[i].name << " " << this->lastValues[i];
+		}
+	}
+	return text.str();
+}
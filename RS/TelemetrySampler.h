@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <chrono>
+#include <librealsense2/rs.hpp>
+#include "ThreadPlacement.h"
+
+#ifndef TELEMETRYSAMPLER_H
+#define TELEMETRYSAMPLER_H
+
+using namespace std;
+
+/*
+Reads the health options of the camera (temperatures, laser power, ...) on a
+thread of its own, so a slow USB control transfer never holds up capture.
+The sensors and the list of supported options are looked up once. Frame
+timestamps reach the sampler through an atomic the capture loop sets, SDK
+notifications are counted per category.
+
+telemetry.bin, little endian:
+	header	char[4] "RSTM", uint32 version, uint32 channels, then per channel
+			uint32 name length and the name ("depth.Asic Temperature", ...)
+	record	double seconds since start, double last frame timestamp (ms),
+			uint64 framesets seen, uint32 frame timeouts, uint32 corrupted frames,
+			uint32 hardware errors, uint32 other errors, float per channel (NaN if unreadable)
+*/
+class TelemetrySampler
+{
+	private:
+		struct Channel {
+			rs2::sensor sensor;
+			rs2_option option;
+			string name;
+		};
+
+		vector<Channel> channels;
+		float intervalSeconds = 1.0f;
+
+		std::atomic<double> lastFrameTimestamp{ 0.0 };
+		std::atomic<unsigned long long> framesSeen{ 0 };
+		std::atomic<unsigned int> frameTimeouts{ 0 };
+		std::atomic<unsigned int> corruptedFrames{ 0 };
+		std::atomic<unsigned int> hardwareErrors{ 0 };
+		std::atomic<unsigned int> otherErrors{ 0 };
+
+		ofstream output;
+		std::thread worker;
+		std::mutex lock;
+		std::condition_variable wake;
+		bool running = false;
+		std::chrono::high_resolution_clock::time_point startTime;
+		vector<float> lastValues;
+
+		void addSensor(const rs2::sensor& sensor, const string& prefix);
+		void countNotification(const rs2::notification& notification);
+		void writeHeader();
+		void sample();
+		ThreadPlacement placement;
+
+		void workerLoop();
+
+	public:
+		TelemetrySampler();
+		~TelemetrySampler();
+		bool start(const rs2::device& device, const string& filename, float intervalSeconds);
+		void noteFrame(double timestamp);
+		void stop();
+		void setPlacement(const ThreadPlacement& placement);
+		string describe();
+};
+
+#endif // !
@@ -0,0 +1,145 @@
+#include "ThreadPlacement.h"
+
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+bool ThreadPlacement::isSet() const {
+	return !this->cores.empty() || !this->priority.empty();
+}
+
+string ThreadPlacement::describe() const {
+	return this->role + ": cores " + (this->cores.empty() ? "any" : this->cores) + ", priority " + (this->priority.empty() ? "default" : this->priority);
+}
+
+// "1-3,5" -> 1 2 3 5, cores the machine doesn't have are left out.
+vector<int> parseCoreList(const string& cores) {
+	vector<int> parsed;
+	int available = static_cast<int>(std::thread::hardware_concurrency());
+	stringstream list(cores);
+	string range;
+
+	while (getline(list, range, ',')) {
+		try {
+			size_t dash = range.find('-');
+			int first = stoi(range.substr(0, dash));
+			int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+			for (int core = first; core <= last; ++core) {
+				if (core >= 0 && (available == 0 || core < available)) {
+					parsed.push_back(core);
+				}
+			}
+		}
+		catch (const std::exception&) {
+			continue;
+		}
+	}
+	return parsed;
+}
+
+// Every core of the machine that is not in the list, "" when that leaves none.
+string otherCores(const string& cores) {
+	vector<int> taken = parseCoreList(cores);
+	int available = static_cast<int>(std::thread::hardware_concurrency());
+	string others;
+
+	for (int core = 0; core < available; ++core) {
+		if (std::find(taken.begin(), taken.end(), core) == taken.end()) {
+			others += (others.empty() ? "" : ",") + to_string(core);
+		}
+	}
+	return others;
+}
+
+string ThreadPlacement::apply() const {
+	ostringstream report;
+	report << this->role << ":";
+
+	vector<int> coreList = parseCoreList(this->cores);
+
+#ifdef _WIN32
+	if (!coreList.empty()) {
+		DWORD_PTR mask = 0;
+		for (int core : coreList) {
+			if (core < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+				mask |= static_cast<DWORD_PTR>(1) << core;
+			}
+		}
+		report << (SetThreadAffinityMask(GetCurrentThread(), mask) != 0 ? " pinned to " : " could not pin to ") << this->cores;
+	}
+
+	if (!this->priority.empty()) {
+		int level = THREAD_PRIORITY_NORMAL;
+		if (this->priority == "realtime") level = THREAD_PRIORITY_TIME_CRITICAL;
+		else if (this->priority == "high") level = THREAD_PRIORITY_HIGHEST;
+		else if (this->priority == "low") level = THREAD_PRIORITY_BELOW_NORMAL;
+		report << (SetThreadPriority(GetCurrentThread(), level) ? " priority " : " could not set priority ") << this->priority;
+	}
+#else
+	if (!coreList.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int core : coreList) {
+			CPU_SET(core, &set);
+		}
+		report << (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? " pinned to " : " could not pin to ") << this->cores;
+	}
+
+	if (this->priority == "realtime") {
+		sched_param parameters;
+		parameters.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+		report << (pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0 ? " SCHED_FIFO" : " SCHED_FIFO not permitted, priority unchanged");
+	}
+	else if (!this->priority.empty()) {
+		// The nice value of a Linux thread is set through its thread id.
+		int niceness = this->priority == "high" ? -10 : this->priority == "low" ? 10 : 0;
+		pid_t thread = static_cast<pid_t>(syscall(SYS_gettid));
+		report << (setpriority(PRIO_PROCESS, thread, niceness) == 0 ? " nice " : " could not set nice ") << niceness;
+	}
+#endif
+
+	if (coreList.empty() && this->priority.empty()) {
+		report << " left to the OS";
+	}
+	return report.str();
+}
+
+string setProcessPriority(const string& priority) {
+#ifdef _WIN32
+	DWORD priorityClass = NORMAL_PRIORITY_CLASS;
+	if (priority == "high") priorityClass = HIGH_PRIORITY_CLASS;
+	else if (priority == "realtime") priorityClass = REALTIME_PRIORITY_CLASS;	// Windows quietly gives HIGH without the privilege.
+	return SetPriorityClass(GetCurrentProcess(), priorityClass) ? "process priority " + priority : "could not set process priority " + priority;
+#else
+	return "process priority is set per thread on this platform";
+#endif
+}
+
+// Writers default to the cores the capture thread leaves free, analytics to the writer cores.
+RecorderPlacement recorderPlacement(const RecorderOptions& options) {
+	RecorderPlacement placement;
+	placement.capture.role = "capture";
+	placement.capture.cores = options.captureCores;
+	placement.capture.priority = options.capturePriority;
+
+	placement.writer.role = "writer";
+	placement.writer.cores = options.writerCores.empty() ? otherCores(options.captureCores) : options.writerCores;
+	placement.writer.priority = options.writerPriority;
+
+	placement.analytics.role = "analytics";
+	placement.analytics.cores = options.analyticsCores.empty() ? placement.writer.cores : options.analyticsCores;
+	placement.analytics.priority = options.analyticsPriority;
+	return placement;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "RecorderOptions.h"
+
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+using namespace std;
+
+/*
+Where a thread may run and how urgently. apply() is called by the thread
+itself; an empty field leaves that part to the OS. Real-time priority is
+SCHED_FIFO on Linux and THREAD_PRIORITY_TIME_CRITICAL on Windows, where
+the OS refuses it the thread keeps its priority and the report says so.
+*/
+struct ThreadPlacement {
+	string role;
+	string cores;		// "0", "1-3", "0,2,4"
+	string priority;	// "realtime", "high", "normal" or "low"
+
+	bool isSet() const;
+	string apply() const;
+	string describe() const;
+};
+
+// The three kinds of recorder threads, from the thread placement options.
+struct RecorderPlacement {
+	ThreadPlacement capture;
+	ThreadPlacement writer;
+	ThreadPlacement analytics;
+};
+
+vector<int> parseCoreList(const string& cores);
+string otherCores(const string& cores);
+string setProcessPriority(const string& priority);
+RecorderPlacement recorderPlacement(const RecorderOptions& options);
+
+#endif // !
@@ -0,0 +1,76 @@
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned int threadCount, size_t maxPending) {
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+	this->maxPending = maxPending == 0 ? 1 : maxPending;
+
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		this->workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->stopping = true;
+	}
+	this->taskAvailable.notify_all();
+
+	for (std::thread& worker : this->workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->taskFinished.wait(guard, [this] { return this->tasks.size() < this->maxPending; });
+	this->tasks.push(std::move(task));
+	guard.unlock();
+	this->taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->taskFinished.wait(guard, [this] { return this->tasks.empty() && this->running == 0; });
+}
+
+unsigned int ThreadPool::size() const {
+	return static_cast<unsigned int>(this->workers.size());
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(this->lock);
+			this->taskAvailable.wait(guard, [this] { return this->stopping || !this->tasks.empty(); });
+
+			if (this->tasks.empty()) {
+				return;
+			}
+			task = std::move(this->tasks.front());
+			this->tasks.pop();
+			this->running++;
+		}
+		// A slot in the queue is free again.
+		this->taskFinished.notify_all();
+
+		try {
+			task();
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Worker task failed: " << e.what() << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->running--;
+		}
+		this->taskFinished.notify_all();
+	}
+}
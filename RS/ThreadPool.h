@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+using namespace std;
+
+/*
+Fixed set of worker threads for the offline tools. submit() blocks while
+maxPending tasks are waiting, so a fast producer can't queue unbounded
+amounts of frame data.
+*/
+class ThreadPool
+{
+	private:
+		vector<std::thread> workers;
+		std::queue<std::function<void()>> tasks;
+		std::mutex lock;
+		std::condition_variable taskAvailable;
+		std::condition_variable taskFinished;
+		size_t maxPending;
+		size_t running = 0;
+		bool stopping = false;
+
+		void workerLoop();
+
+	public:
+		ThreadPool(unsigned int threadCount, size_t maxPending);
+		~ThreadPool();
+		void submit(std::function<void()> task);
+		void wait();
+		unsigned int size() const;
+};
+
+#endif // !
@@ -5,6 +5,17 @@
 #include <opencv2/opencv.hpp>   // Include OpenCV API
 #include "opencv2/videoio.hpp"
 #include <exception>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include "WriterSettings.h"
+#include "StreamWriter.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 #include <opencv-3.4/modules/videoio/include/opencv2/videoio/videoio_c.h>
 
 using namespace cv;
@@ -18,6 +29,35 @@ long long get_exposure_time(const rs2::frame& f) {
         return 0; // unknown
 }
 
+// MJPG is not supported by the mp4 container.
+std::string videoExtension(const std::string& fourcc) {
+    if (fourcc == "MJPG") {
+        return ".avi";
+    }
+    if (fourcc == "FFV1") {
+        return ".mkv";
+    }
+    return ".mp4";
+}
+
+// CPU time used by all threads of this process, in seconds.
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return 0.0;
+    }
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return static_cast<double>(kernel.QuadPart + user.QuadPart) * 1e-7;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
 // Convert rs2::frame to cv::Mat
 cv::Mat frame_to_mat(const rs2::frame& f)
 {
@@ -54,103 +94,94 @@ cv::Mat frame_to_mat(const rs2::frame& f)
 }
 
 
-void writeFrames(rs2::frame_queue queue,
-    std::string imageType,
-    std::string directory,
-    std::string baseDirectory,
-    int videoCount,
-    float individualVideoLength,
-    float fps,
-    float min_depth,
-    float max_depth) {
-
-    cout << "Writing in directory:" << directory << "for type:" << imageType << endl;
-    int videoID = 1;
-    //Define video output
-    auto fourcc = CV_FOURCC('m', 'p', '4', 'v');
-
-    //Define file name
-    string filename = directory + to_string(videoID) + ".mp4";
+// Pixel bytes a frame keeps alive, of every frame for a frameset.
+long long frameBytes(const rs2::frame& frame)
+{
+    if (!frame) {
+        return 0;
+    }
+    if (frame.is<rs2::frameset>()) {
+        rs2::frameset frameSet = frame.as<rs2::frameset>();
+        long long bytes = 0;
+        for (size_t i = 0; i < frameSet.size(); ++i) {
+            bytes += frameSet[i].get_data_size();
+        }
+        return bytes;
+    }
+    return frame.get_data_size();
+}
 
-    //Define Size
-    cv::Size resolution = cv::Size(1920, 1080);
 
-    //Define writer
-    cv::VideoWriter writer(filename, fourcc, static_cast<double>(fps), resolution, true);
+// Framesets minus their infrared frames, for rs2::align, which would reproject every one of them to depth.
+// One per thread, framesets without infrared pass as they are.
+rs2::filter withoutInfrared()
+{
+    return rs2::filter([](rs2::frame frame, rs2::frame_source& source) {
+        rs2::frameset frameSet = frame.as<rs2::frameset>();
+        if (!frameSet || !frameSet.first_or_default(RS2_STREAM_INFRARED)) {
+            source.frame_ready(frame);
+            return;
+        }
+        std::vector<rs2::frame> kept;
+        for (size_t i = 0; i < frameSet.size(); ++i) {
+            if (frameSet[i].get_profile().stream_type() != RS2_STREAM_INFRARED) {
+                kept.push_back(frameSet[i]);
+            }
+        }
+        source.frame_ready(source.allocate_composite_frame(kept));
+    });
+}
 
-    cv::Mat currentFrame;
-    rs2::frame frame;
 
-    int frameCount = 0;
+void writeFrames(rs2::frame_queue queue, WriterSettings settings) {
 
-    int maxVideoFrames = static_cast<int>(individualVideoLength * fps);
+    const std::string& imageType = settings.imageType;
+    WriterStatistics* statistics = settings.statistics;
 
-    cout << "Maximum frames per video:" << maxVideoFrames << endl;
+    if (settings.placement.isSet()) {
+        cout << "Thread placement " << settings.placement.apply() << endl;
+    }
 
-    rs2::decimation_filter dec_filter;  // Decimation - reduces depth frame density
-    rs2::threshold_filter thr_filter;   // Threshold  - removes values outside recommended range
-    rs2::spatial_filter spat_filter;    // Spatial    - edge-preserving spatial smoothing
-    rs2::temporal_filter temp_filter;   // Temporal   - reduces temporal noise
+    StreamWriter writer(settings);
+    writer.writeCarryOver();
 
-    rs2::disparity_transform depth_to_disparity(true);
-    rs2::disparity_transform disparity_to_depth(false);
-    rs2::colorizer color_filter;
+    // The capture side accounts for the same queue.
+    MemoryAccount* queueMemory = settings.memory != nullptr ? settings.memory->account(writer.streamName() + " queue") : nullptr;
 
-    // filter settings
-    thr_filter.set_option(RS2_OPTION_MIN_DISTANCE, min_depth);
-    thr_filter.set_option(RS2_OPTION_MAX_DISTANCE, max_depth);
-    color_filter.set_option(RS2_OPTION_HISTOGRAM_EQUALIZATION_ENABLED, 0);
-    color_filter.set_option(RS2_OPTION_COLOR_SCHEME, 9.0f);		// Hue colorization
-    color_filter.set_option(RS2_OPTION_MAX_DISTANCE, max_depth);
-    color_filter.set_option(RS2_OPTION_MIN_DISTANCE, min_depth);
+    rs2::frame frame;
 
     // Create clock
     std::chrono::high_resolution_clock Clock;
-    // Keep track of time in video.
-    std::chrono::duration<float> timeElapsed;
-    auto startTime = Clock.now();
-    timeElapsed = Clock.now() - startTime;
-
 
     while (true) {
 
-        timeElapsed = Clock.now() - startTime;
-        
         if (queue.capacity() == queue.size()) {
             cout << "Queue for " << imageType << "is full. Frame dropping might occur." << endl;
         }
 
-        if (individualVideoLength <= timeElapsed.count()) {
-
-            videoID++;
-            writer.release();
-
-            filename = directory + to_string(videoID) + ".mp4";
+        try {
+            frame = queue.wait_for_frame(settings.queueTimeoutMs); // we wait at most queueTimeoutMs (15 seconds by default) otherwise we know the frames have ended and we can stop.
 
-            writer = cv::VideoWriter(filename, fourcc, static_cast<double>(fps), resolution);
+            if (queueMemory != nullptr) {
+                queueMemory->set(static_cast<long long>(queue.size()) * frameBytes(frame));
+            }
 
-            std::cout << "Starting to write video " << videoID << " of type: " << imageType <<  "." << endl;
+            auto busyStart = Clock.now();
 
-            startTime = Clock.now();
-        }
+            // A frameset can come without this writer's stream, the infrared ones in particular.
+            frame = writer.select(frame);
+            if (!frame || !writer.admits(frame)) {
+                continue;
+            }
+            frame = writer.colorize(writer.filter(frame));
+            writer.write(frame, writer.convert(frame));
 
-        try {
-            frame = queue.wait_for_frame(15000); // we wait at most 15 seconds otherwise we know the frames have ended and we can stop.
-            frameCount += 1;
-
-            if (imageType == "depth") {
-                frame = thr_filter.process(frame);
-                frame = depth_to_disparity.process(frame);
-                frame = spat_filter.process(frame);
-                frame = temp_filter.process(frame);
-                frame = disparity_to_depth.process(frame);
-                frame = color_filter.process(frame);
+            if (statistics != nullptr) {
+                statistics->busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(Clock.now() - busyStart).count();
             }
-            currentFrame = frame_to_mat(frame);
-            writer.write(currentFrame);
         }
         catch (const cv::Exception& e) {
-            std::cout << "Exception caught while writing:" << filename << "Exception msg:" << e.what() << std::endl;
+            std::cout << "Exception caught while writing:" << writer.currentFile() << "Exception msg:" << e.what() << std::endl;
             break;
         }
         catch (const rs2::error& e) {
@@ -159,12 +190,105 @@ void writeFrames(rs2::frame_queue queue,
             break;
         }
     }
-    writer.release();
-    writer.~VideoWriter();
+    writer.close();
     return;
 }
 
 
+static bool readFileToString(const std::string& filename, std::string& content) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+// Position right after the ':' that follows key, or npos.
+static size_t findJsonValue(const std::string& content, const std::string& key) {
+    size_t position = content.find("\"" + key + "\"");
+    if (position == std::string::npos) {
+        // depth_parameters.json of older sessions has a space inside the quotes.
+        position = content.find(key + "\"");
+    }
+    if (position == std::string::npos) {
+        return std::string::npos;
+    }
+    size_t colon = content.find(':', position);
+    return colon == std::string::npos ? colon : colon + 1;
+}
+
+// Minimal reader for the flat JSON files the recorder writes itself.
+bool readJsonNumber(const std::string& filename, const std::string& key, double& value) {
+    std::string content;
+    if (!readFileToString(filename, content)) {
+        return false;
+    }
+    size_t position = findJsonValue(content, key);
+    if (position == std::string::npos) {
+        return false;
+    }
+    char* end = nullptr;
+    const char* start = content.c_str() + position;
+    double parsed = strtod(start, &end);
+    if (end == start) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool readIntrinsics(const std::string& filename, rs2_intrinsics& intrinsics) {
+    std::string content;
+    if (!readFileToString(filename, content)) {
+        return false;
+    }
+
+    double fx, fy, ppx, ppy, width, height;
+    if (!readJsonNumber(filename, "fx", fx) || !readJsonNumber(filename, "fy", fy) ||
+        !readJsonNumber(filename, "ppx", ppx) || !readJsonNumber(filename, "ppy", ppy) ||
+        !readJsonNumber(filename, "width", width) || !readJsonNumber(filename, "height", height)) {
+        return false;
+    }
+
+    intrinsics.fx = static_cast<float>(fx);
+    intrinsics.fy = static_cast<float>(fy);
+    intrinsics.ppx = static_cast<float>(ppx);
+    intrinsics.ppy = static_cast<float>(ppy);
+    intrinsics.width = static_cast<int>(width);
+    intrinsics.height = static_cast<int>(height);
+
+    bool distorted = false;
+    size_t position = findJsonValue(content, "coeffs");
+    if (position != std::string::npos) {
+        position = content.find('[', position);
+    }
+    for (int i = 0; i < 5; ++i) {
+        intrinsics.coeffs[i] = 0.0f;
+        if (position == std::string::npos) {
+            continue;
+        }
+        const char* start = content.c_str() + position + 1;
+        char* end = nullptr;
+        intrinsics.coeffs[i] = static_cast<float>(strtod(start, &end));
+        distorted = distorted || intrinsics.coeffs[i] != 0.0f;
+        position = content.find(',', end - content.c_str());
+    }
+
+    // Files of older sessions have no model. Of the D400 streams we record only color has coefficients, and they are inverse Brown-Conrady.
+    double model;
+    if (readJsonNumber(filename, "model", model) && model >= 0 && model < RS2_DISTORTION_COUNT) {
+        intrinsics.model = static_cast<rs2_distortion>(static_cast<int>(model));
+    }
+    else {
+        intrinsics.model = distorted ? RS2_DISTORTION_INVERSE_BROWN_CONRADY : RS2_DISTORTION_NONE;
+    }
+
+    return true;
+}
+
 bool isPathExist(const std::string& s)
 {
     struct stat buffer;
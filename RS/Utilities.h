@@ -2,14 +2,19 @@
 #include "opencv2/opencv.hpp"
 #include <librealsense2/rs.hpp>
 #include <concurrent_queue.h>
+#include "WriterSettings.h"
 
 #ifndef UTILITIES_H
 #define UTILITIES_H
 
 bool isPathExist(const std::string& filename);
 cv::Mat frame_to_mat(const rs2::frame& f);
-void writeFrames(rs2::frame_queue queue, std::string imageType, 
-				 std::string directory, std::string baseDirectory, 
-				 int videoCount, float individualVideoLength, float fps, float min_depth, float max_depth);
+long long frameBytes(const rs2::frame& frame);
+rs2::filter withoutInfrared();
+void writeFrames(rs2::frame_queue queue, WriterSettings settings);
 long long get_exposure_time(const rs2::frame& f);
+std::string videoExtension(const std::string& fourcc);
+double processCpuSeconds();
+bool readJsonNumber(const std::string& filename, const std::string& key, double& value);
+bool readIntrinsics(const std::string& filename, rs2_intrinsics& intrinsics);
 #endif // !
\ No newline at end of file
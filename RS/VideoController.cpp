@@ -44,7 +44,36 @@ void VideoController::createCVWindow() {
 	cv::namedWindow(this->windowName, WINDOW_AUTOSIZE);
 	this->is_video_destroyed = false;
 	this->is_showing_video = true;
-	//cv::setMouseCallback(this->windowName, depthROICallback, (void*)&this->depthROI);
+
+	if (this->roi != nullptr) {
+		cv::setMouseCallback(this->windowName, depthROICallback, (void*)this->roi);
+	}
+}
+
+void VideoController::setROIHolder(ROIHolder* roi) {
+	this->roi = roi;
+
+	if (!this->is_video_destroyed && this->roi != nullptr) {
+		cv::setMouseCallback(this->windowName, depthROICallback, (void*)this->roi);
+	}
+}
+
+void VideoController::setStatusText(const string& key, const string& text) {
+	this->statusLines[key] = text;
+}
+
+void VideoController::setProxyWriter(ProxyWriter* proxy) {
+	this->proxy = proxy;
+}
+
+void VideoController::drawStatusText(cv::Mat& image) {
+	int line = 0;
+	for (const auto& status : this->statusLines) {
+		cv::Point position(50, 125 + 25 * line);
+		cv::putText(image, status.second, position, cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar(255, 255, 255));
+		cv::putText(image, status.second, position + cv::Point(1, 1), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar(0, 0, 0));
+		line++;
+	}
 }
 
 void VideoController::setFilterSettings() {
@@ -178,7 +207,10 @@ void VideoController::handleInput() {
 
 void VideoController::showVideo(rs2::frame& colorFrame, rs2::frame& depthFrame) {
 
-	if (this->is_showing_video) {
+	// The proxy takes the blend at its own rate, also while the window shows nothing.
+	bool proxyFrame = this->proxy != nullptr && colorFrame && this->proxy->wants(colorFrame.get_timestamp());
+
+	if (this->is_showing_video || proxyFrame) {
 
 		depthFrame = this->depth_to_disparity.process(depthFrame);
 		depthFrame = this->spat_filter.process(depthFrame);
@@ -201,10 +233,16 @@ void VideoController::showVideo(rs2::frame& colorFrame, rs2::frame& depthFrame)
 
 			cv::addWeighted(color_image, 1, depth_image, 0.5, 0.0, blendedImage);
 
+			if (proxyFrame) {
+				this->proxy->submit(colorFrame.get_timestamp(), blendedImage);
+			}
+			if (!this->is_showing_video) {
+				return;
+			}
 
-			/*if (this->auto_exposure_is_enabled) {
-				this->depthROI.drawROI(blendedImage);
-			}*/
+			if (this->roi != nullptr) {
+				this->roi->drawROI(blendedImage);
+			}
 
 			switch (this->controlling_mode) {
 				case controlling_types::automatic:
@@ -233,6 +271,8 @@ void VideoController::showVideo(rs2::frame& colorFrame, rs2::frame& depthFrame)
 					break;
 			}
 			
+			this->drawStatusText(blendedImage);
+
 			cv::imshow(this->windowName, blendedImage);
 		}
 	}
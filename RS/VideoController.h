@@ -6,6 +6,9 @@
 #include <iostream>
 #include <string>
 #include "ControllingTypes.h"
+#include "ROIHolder.h"
+#include "ProxyWriter.h"
+#include <map>
 
 #ifndef VIDEOCONTROLLER_H
 #define VIDEOCONTROLLER_H
@@ -49,6 +52,10 @@ private:
 
 	controlling_types controlling_mode = controlling_types::automatic;
 
+	ROIHolder* roi = nullptr;
+	map<string, string> statusLines;
+	ProxyWriter* proxy = nullptr;
+
 	rs2::decimation_filter dec_filter;  // Decimation - reduces depth frame density
 	rs2::threshold_filter thr_filter;   // Threshold  - removes values outside recommended range
 	rs2::spatial_filter spat_filter;    // Spatial    - edge-preserving spatial smoothing
@@ -68,6 +75,10 @@ public:
 	void createCVWindow();
 	int update(rs2::frame& colorFrame, rs2::frame& depthFrame);
 	void showVideo(rs2::frame& colorFrame, rs2::frame& depthFrame);
+	void setROIHolder(ROIHolder* roi);
+	void setStatusText(const string& key, const string& text);
+	void setProxyWriter(ProxyWriter* proxy);
+	void drawStatusText(cv::Mat& image);
 	string windowName;
 };
 
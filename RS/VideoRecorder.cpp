@@ -8,11 +8,16 @@
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <atomic>
 #include <fstream>
 
 #include "Utilities.h"
 #include "ROIHolder.h"
 #include "VideoController.h"
+#include "LoadController.h"
+#include "WriterStatistics.h"
+#include "ExposureSettler.h"
+#include "DepthFilterChain.h"
 //#include <WinUser.h>
 //#include <opencv-3.4/modules/imgproc/include/opencv2/imgproc.hpp>
 
@@ -40,6 +45,9 @@ VideoRecorder::VideoRecorder (float individualVideoLength,float fullSessionLengt
 	this->enableDepth = enableDepth;
 	this->enableRGB = enableRGB;
 
+	loadRecorderOptions(this->parentDir + "recorder_options.cfg", this->options);
+	this->applyStreamProfile();
+
 	this->calculateSessionLength(fullSessionLength);
 	this->calculateIndividualVidLength(individualVideoLength);
 	this->determineOutputVideoCount();
@@ -48,11 +56,28 @@ VideoRecorder::VideoRecorder (float individualVideoLength,float fullSessionLengt
 	rs2::config rsConfig = this->createContext();
 	this->startPipeline(rsConfig);
 	this->controlSensorSettings();
+	this->setUpMemoryBudget();
 	this->createVideoController();
 	this->writeIntrinsics();
 	this->writeExtrinsics();
 	this->writeDepthDeviceInformation();
+	this->writeSessionInformation();
 	this->setDepthROIDefault(1080, 720);
+	this->createROIMeasurement();
+
+	// The crop follows the ROI drawn during set up.
+	if (this->options.roiCropRecording) {
+		this->videoController.setROIHolder(&this->depthROI);
+	}
+}
+
+void VideoRecorder::applyStreamProfile() {
+	if (!loadStreamProfile(this->parentDir + "stream_profile.cfg", this->streamProfile)) {
+		std::cout << "No calibrated stream profile found, using " << this->streamProfile.describe() << endl;
+	}
+
+	this->RGB_FPS = static_cast<float>(this->streamProfile.colorFps);
+	this->Depth_FPS = static_cast<float>(this->streamProfile.depthFps);
 }
 
 void VideoRecorder::createVideoController() {
@@ -61,6 +86,197 @@ void VideoRecorder::createVideoController() {
 	this->videoController = VideoController(colorSensor, depthSensor, "Preview");
 }
 
+void VideoRecorder::createROIMeasurement() {
+	if (!this->options.roiMeasurement || !this->enableDepth || !this->enableRGB) {
+		return;
+	}
+
+	rs2::depth_sensor depthSensor = this->rsPLProfile.get_device().first<rs2::depth_sensor>();
+	this->roiMeasurement.setDepthScale(depthSensor.get_depth_scale());
+	this->roiMeasurement.setReferencePlane(cv::Point3f(0.0f, 0.0f, 1.0f), this->options.roiReferencePlane);
+
+	// Let the operator draw the ROI on the preview.
+	this->videoController.setROIHolder(&this->depthROI);
+	this->updateMeasurementROI();
+}
+
+void VideoRecorder::updateMeasurementROI() {
+	auto depthStream = this->rsPipeline.get_active_profile().get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+	auto colorStream = this->rsPipeline.get_active_profile().get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+
+	// Aligned to depth, the preview already is in depth pixels.
+	if (this->alignTarget() == RS2_STREAM_DEPTH) {
+		rs2_intrinsics depthIntrinsics = depthStream.get_intrinsics();
+		cv::Size depthSize(depthIntrinsics.width, depthIntrinsics.height);
+		this->measurementROI = ROIMeasurement::previewToColor(this->depthROI, cv::Size(1080, 720), depthSize) & cv::Rect(cv::Point(0, 0), depthSize);
+		return;
+	}
+
+	rs2_intrinsics colorIntrinsics = colorStream.get_intrinsics();
+
+	cv::Rect colorRect = ROIMeasurement::previewToColor(this->depthROI, cv::Size(1080, 720), cv::Size(colorIntrinsics.width, colorIntrinsics.height));
+	float distance = this->options.roiReferencePlane > 0.0f ? this->options.roiReferencePlane : 1.0f;
+
+	this->measurementROI = ROIMeasurement::colorToDepth(colorRect, colorIntrinsics, depthStream.get_intrinsics(),
+														colorStream.get_extrinsics_to(depthStream), distance);
+}
+
+// Runs on the raw depth of every frameset, before alignment.
+void VideoRecorder::measureROI(const rs2::frameset& frameSet) {
+	if (!this->options.roiMeasurement || !this->enableDepth || !this->enableRGB) {
+		return;
+	}
+
+	rs2::depth_frame depthFrame = frameSet.get_depth_frame();
+	if (!depthFrame) {
+		return;
+	}
+
+	if (this->depthROI.hasUpdated && !this->depthROI.dragging) {
+		this->updateMeasurementROI();
+		this->depthROI.hasUpdated = false;
+
+		// The time series follows the operator's ROI as its first region.
+		if (this->options.roiSeries) {
+			this->roiSeries.setRegion(0, this->measurementROI);
+			this->sessionMetadata.appendRecord("roi_series_regions", {
+				{ "region", "0" },
+				{ "from_timestamp_ms", SessionMetadata::number(depthFrame.get_timestamp()) },
+				{ "x", SessionMetadata::number(this->measurementROI.x) },
+				{ "y", SessionMetadata::number(this->measurementROI.y) },
+				{ "width", SessionMetadata::number(this->measurementROI.width) },
+				{ "height", SessionMetadata::number(this->measurementROI.height) }
+			});
+		}
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ROIStatistics3D statistics = this->roiMeasurement.measure(depthFrame, this->measurementROI);
+	this->measurementMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	this->measurementCount++;
+
+	this->videoController.setStatusText("roi", ROIMeasurement::describe(statistics));
+}
+
+// Stream the other one is aligned to, see align_to.
+rs2_stream VideoRecorder::alignTarget() const {
+	return this->options.alignTo == "depth" ? RS2_STREAM_DEPTH : RS2_STREAM_COLOR;
+}
+
+// Size of every aligned frame, as the camera actually streams it.
+cv::Size VideoRecorder::outputResolution() {
+	try {
+		rs2::video_stream_profile stream = this->rsPLProfile.get_stream(this->alignTarget()).as<rs2::video_stream_profile>();
+		if (stream) {
+			return cv::Size(stream.width(), stream.height());
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Failed to read the aligned stream's resolution. (" << e.what() << ")" << std::endl;
+	}
+	if (this->alignTarget() == RS2_STREAM_DEPTH) {
+		return cv::Size(this->streamProfile.depthWidth, this->streamProfile.depthHeight);
+	}
+	return cv::Size(this->streamProfile.colorWidth, this->streamProfile.colorHeight);
+}
+
+// Infrared 1 is the left imager, 2 the right one, both only come with depth.
+bool VideoRecorder::recordsInfrared(int index) const {
+	const string& infrared = this->options.infrared;
+	return this->enableDepth && (infrared == "both" || (index == 1 && infrared == "left") || (index == 2 && infrared == "right"));
+}
+
+// The imagers stream at the depth resolution, infrared is never aligned.
+cv::Size VideoRecorder::infraredResolution(int index) {
+	try {
+		rs2::video_stream_profile stream = this->rsPLProfile.get_stream(RS2_STREAM_INFRARED, index).as<rs2::video_stream_profile>();
+		if (stream) {
+			return cv::Size(stream.width(), stream.height());
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Failed to read the infrared stream's resolution. (" << e.what() << ")" << std::endl;
+	}
+	return cv::Size(this->streamProfile.depthWidth, this->streamProfile.depthHeight);
+}
+
+// ROI of the preview in pixels of the aligned frames, grown by the margin and rounded up to whole 16x16 macroblocks.
+cv::Rect VideoRecorder::recordingCrop() {
+	cv::Rect frame(cv::Point(0, 0), this->outputResolution());
+	cv::Rect crop = ROIMeasurement::previewToColor(this->depthROI, cv::Size(1080, 720), frame.size());
+
+	int margin = static_cast<int>(this->options.roiCropMargin * max(crop.width, crop.height));
+	crop = cv::Rect(crop.x - margin, crop.y - margin, crop.width + 2 * margin, crop.height + 2 * margin) & frame;
+	if (crop.area() == 0) {
+		return crop;
+	}
+
+	int width = min(frame.width, (crop.width + 15) / 16 * 16);
+	int height = min(frame.height, (crop.height + 15) / 16 * 16);
+	int x = min(crop.x, frame.width - width);
+	int y = min(crop.y, frame.height - height);
+	return cv::Rect(x, y, width, height);
+}
+
+// Region 0 is the operator's ROI when ROI measurement is on, the configured regions follow.
+void VideoRecorder::startROITimeSeries() {
+	if (!this->options.roiSeries || !this->enableDepth) {
+		return;
+	}
+
+	this->roiSeries.clearRegions();
+	if (this->options.roiMeasurement && this->enableRGB) {
+		this->roiSeries.addRegion(this->measurementROI);
+	}
+	for (const cv::Rect& region : ROITimeSeries::parseRegions(this->options.roiSeriesRegions)) {
+		this->roiSeries.addRegion(region);
+	}
+
+	rs2::depth_sensor depthSensor = this->rsPLProfile.get_device().first<rs2::depth_sensor>();
+	if (!this->roiSeries.start(this->baseDir + "roi_series.bin", depthSensor.get_depth_scale())) {
+		std::cerr << "ROI time series is enabled but has no regions to follow." << endl;
+		return;
+	}
+	this->sessionMetadata.setField("roi_series_file", SessionMetadata::text("roi_series.bin"));
+	this->sessionMetadata.setField("roi_series_region_count", SessionMetadata::number(static_cast<double>(this->roiSeries.regionCount())));
+}
+
+// Called on the capture thread before the writers start, they place themselves.
+void VideoRecorder::placeThreads() {
+	if (!this->options.threadPlacement) {
+		return;
+	}
+
+	this->placement = recorderPlacement(this->options);
+	std::cout << setProcessPriority(this->options.processPriority) << endl;
+
+	// In callback mode the SDK's thread captures and this one only runs the preview.
+	string applied;
+	if (this->options.captureMode == "callback") {
+		this->captureDispatcher.setPlacement(this->placement.capture);
+		ThreadPlacement preview = this->placement.analytics;
+		preview.role = "preview";
+		applied = preview.apply();
+	}
+	else {
+		applied = this->placement.capture.apply();
+	}
+	std::cout << "Thread placement " << applied << endl;
+
+	this->roiSeries.setPlacement(this->placement.analytics);
+	this->telemetry.setPlacement(this->placement.analytics);
+	this->imu.setPlacement(this->placement.analytics);
+	this->proxy.setPlacement(this->placement.analytics);
+
+	this->sessionMetadata.setField("process_priority", SessionMetadata::text(this->options.processPriority));
+	this->sessionMetadata.appendRecord("thread_placement", { { "role", SessionMetadata::text("main") }, { "applied", SessionMetadata::text(applied) } });
+	for (const ThreadPlacement* thread : { &this->placement.writer, &this->placement.analytics }) {
+		this->sessionMetadata.appendRecord("thread_placement", { { "role", SessionMetadata::text(thread->role) },
+																 { "cores", SessionMetadata::text(thread->cores) },
+																 { "priority", SessionMetadata::text(thread->priority) } });
+	}
+}
+
 void VideoRecorder::stopPipeline() {
 	this->rsPipeline.stop();
 }
@@ -133,6 +349,7 @@ void VideoRecorder::saveIntrinsics(rs2_intrinsics intrinsics, string filename) {
 	intrinsicsFile << "    \"fx\": " << intrinsics.fx << "," << endl;
 	intrinsicsFile << "    \"fy\": " << intrinsics.fy << "," << endl;
 	intrinsicsFile << "    \"height\": " << intrinsics.height << "," << endl;
+	intrinsicsFile << "    \"model\": " << static_cast<int>(intrinsics.model) << "," << endl;
 	intrinsicsFile << "    \"ppx\": " << intrinsics.ppx << "," << endl;
 	intrinsicsFile << "    \"ppy\": " << intrinsics.ppy << "," << endl;
 	intrinsicsFile << "    \"width\": " << intrinsics.width << endl;
@@ -162,6 +379,18 @@ void VideoRecorder::writeDepthDeviceInformation() {
 	depthFile.close();
 }
 
+void VideoRecorder::writeSessionInformation() {
+	this->sessionMetadata.setFile(this->baseDir + "session_metadata.json");
+	this->sessionMetadata.setField("session_length_s", SessionMetadata::number(this->fullSessionLength));
+	this->sessionMetadata.setField("segment_length_s", SessionMetadata::number(this->individualVideoLength));
+	this->sessionMetadata.setField("color_fps", SessionMetadata::number(this->RGB_FPS));
+	this->sessionMetadata.setField("depth_fps", SessionMetadata::number(this->Depth_FPS));
+	this->sessionMetadata.setField("stream_profile", SessionMetadata::text(this->streamProfile.describe()));
+	this->sessionMetadata.setField("min_depth_m", SessionMetadata::number(this->minDepth));
+	this->sessionMetadata.setField("max_depth_m", SessionMetadata::number(this->maxDepth));
+	this->sessionMetadata.setField("segment_container", SessionMetadata::text(this->options.segmentContainer));
+	this->sessionMetadata.setField("memory_policy", SessionMetadata::text(this->options.memoryPolicy));
+}
 
 bool VideoRecorder::verifyOptionSupport(rs2::sensor rsSensor, rs2_option optionType) {
 	if (!rsSensor.supports(optionType))
@@ -173,6 +402,47 @@ bool VideoRecorder::verifyOptionSupport(rs2::sensor rsSensor, rs2_option optionT
 	return true;
 }
 
+/*
+The SDK keeps its own queue of frames per sensor, those can't be measured
+from here, so the budget is charged what they can hold at most.
+*/
+void VideoRecorder::setUpMemoryBudget() {
+	this->memoryBudget.setLimit(static_cast<long long>(max(0, this->options.memoryBudgetMb)) * 1024 * 1024);
+
+	int queueSize = 16;
+	long long queueBytes = 0;
+	try {
+		for (rs2::sensor sensor : this->rsPLProfile.get_device().query_sensors()) {
+			if (this->options.sdkFramesQueueSize > 0 && sensor.supports(RS2_OPTION_FRAMES_QUEUE_SIZE)) {
+				sensor.set_option(RS2_OPTION_FRAMES_QUEUE_SIZE, static_cast<float>(this->options.sdkFramesQueueSize));
+			}
+			if (sensor.supports(RS2_OPTION_FRAMES_QUEUE_SIZE)) {
+				queueSize = static_cast<int>(sensor.get_option(RS2_OPTION_FRAMES_QUEUE_SIZE));
+			}
+		}
+	}
+	catch (const rs2::error& e) {
+		std::cerr << "Failed to set the SDK frame queue size. (" << e.what() << ")" << std::endl;
+	}
+
+	for (const rs2::stream_profile& profile : this->rsPLProfile.get_streams()) {
+		if (rs2::video_stream_profile video = profile.as<rs2::video_stream_profile>()) {
+			int bytesPerPixel = profile.format() == RS2_FORMAT_Z16 ? 2 : profile.format() == RS2_FORMAT_Y8 ? 1 : 3;
+			queueBytes += static_cast<long long>(queueSize) * video.width() * video.height() * bytesPerPixel;
+		}
+	}
+	this->memoryBudget.account("sdk frame queues", true)->set(queueBytes);
+	this->roiSeries.setMemoryAccount(this->memoryBudget.account("roi series queue"));
+	this->proxy.setMemoryAccount(this->memoryBudget.account("proxy frame"));
+
+	this->sdkFramesQueueSize = queueSize;
+	this->sessionMetadata.setField("sdk_frames_queue_size", SessionMetadata::number(queueSize));
+	std::cout << "Frame memory budget " << this->options.memoryBudgetMb << " MB, " << queueBytes / 1048576 << " MB of it for the SDK's queues." << endl;
+	if (!this->memoryBudget.limitReachable()) {
+		std::cerr << "memory_budget_mb is not above the SDK's queues, raise it or lower sdk_frames_queue_size. Over the budget the recorder only sheds load." << endl;
+	}
+}
+
 void VideoRecorder::controlSensorSettings() {
 	try {
 
@@ -224,19 +494,43 @@ void VideoRecorder::controlSensorSettings() {
 
 }
 
+// A restarted pipeline calls back on a new SDK thread, which is placed again.
 void VideoRecorder::startPipeline(rs2::config config) {
-	this->rsPLProfile = this->rsPipeline.start(config);
+	if (this->options.captureMode == "callback") {
+		this->captureDispatcher.rearmPlacement();
+		this->rsPLProfile = this->rsPipeline.start(config, [this](rs2::frame frame) { this->captureDispatcher.dispatch(frame); });
+		std::cout << "Capturing with a frame callback." << endl;
+	}
+	else {
+		this->rsPLProfile = this->rsPipeline.start(config);
+	}
+}
+
+// A pipeline started with a callback can't be polled, its framesets come through the dispatcher.
+rs2::frameset VideoRecorder::nextFrameset() {
+	if (this->options.captureMode == "callback") {
+		return this->captureDispatcher.waitForFrames(10000);
+	}
+	return this->rsPipeline.wait_for_frames(10000);
 }
 
-rs2::config VideoRecorder::createContext() { 
+// fps other than 0 replaces the profile's rates, for the daemon's idle stream.
+rs2::config VideoRecorder::createContext(int fps) { 
 	rs2:config rsConfig;
 
 	if (this->enableDepth) {
-		rsConfig.enable_stream(RS2_STREAM_DEPTH, 0, 848, 480, RS2_FORMAT_Z16, this->Depth_FPS);
+		rsConfig.enable_stream(RS2_STREAM_DEPTH, 0, this->streamProfile.depthWidth, this->streamProfile.depthHeight, RS2_FORMAT_Z16, fps > 0 ? fps : this->streamProfile.depthFps);
 	}
 
 	if (this->enableRGB) {
-		rsConfig.enable_stream(RS2_STREAM_COLOR, 0, 1920, 1080, RS2_FORMAT_BGR8, this->RGB_FPS);
+		rsConfig.enable_stream(RS2_STREAM_COLOR, 0, this->streamProfile.colorWidth, this->streamProfile.colorHeight, RS2_FORMAT_BGR8, fps > 0 ? fps : this->streamProfile.colorFps);
+	}
+
+	// Same sensor as depth, so each infrared frame shares its depth frame's timestamp and number.
+	for (int index = 1; index <= 2; ++index) {
+		if (this->recordsInfrared(index)) {
+			rsConfig.enable_stream(RS2_STREAM_INFRARED, index, this->streamProfile.depthWidth, this->streamProfile.depthHeight, RS2_FORMAT_Y8, fps > 0 ? fps : this->streamProfile.depthFps);
+		}
 	}
 
 	return rsConfig;
@@ -274,6 +568,23 @@ void VideoRecorder::createDirectories() {
 								   this->colorDir,
 								   this->depthDir};
 
+	if (this->options.roiCropRecording && this->options.contextInterval > 0) {
+		directories.push_back(this->contextDir);
+	}
+	if (this->options.rawDepthArchive) {
+		directories.push_back(this->rawDepthDir);
+	}
+	if (this->recordsInfrared(1)) {
+		directories.push_back(this->infraredLeftDir);
+	}
+	if (this->recordsInfrared(2)) {
+		directories.push_back(this->infraredRightDir);
+	}
+	if (this->options.proxyStream) {
+		directories.push_back(this->proxyDir);
+		directories.push_back(this->thumbnailDir);
+	}
+
 	int failure = 0;
 
 	for(string dir : directories)
@@ -304,17 +615,28 @@ void VideoRecorder::setDirectories() {
 
 	strftime(time_buffer, 80, "%Y_%m_%d-%H_%M", timeinfo);
 
-	this->baseDir = this->parentDir +  "output_" + string(time_buffer) + "/";
+	// A second session within the same minute gets a numbered directory of its own.
+	string name = "output_" + string(time_buffer);
+	this->baseDir = this->parentDir + name + "/";
+	for (int suffix = 2; isPathExist(this->baseDir); ++suffix) {
+		this->baseDir = this->parentDir + name + "_" + to_string(suffix) + "/";
+	}
 	this->colorDir = this->baseDir + "color/";
 	this->depthDir = this->baseDir + "depth/";
+	this->contextDir = this->baseDir + "context/";
+	this->rawDepthDir = this->baseDir + "depth_raw/";
+	this->infraredLeftDir = this->baseDir + "ir_left/";
+	this->infraredRightDir = this->baseDir + "ir_right/";
+	this->proxyDir = this->baseDir + "proxy/";
+	this->thumbnailDir = this->baseDir + "thumbnails/";
 }
 
 
 void VideoRecorder::setNewDepthROI(){
 	// Here make the call to the sensor
 
-	float x_scaling = (840.0f / 1080.0f);
-	float y_scaling = (480.0f / 720.0f);
+	float x_scaling = (static_cast<float>(this->streamProfile.depthWidth) / 1080.0f);
+	float y_scaling = (static_cast<float>(this->streamProfile.depthHeight) / 720.0f);
 
 	rs2::region_of_interest roi;
 	rs2::roi_sensor roi_sensor(this->rsPLProfile.get_device().first<rs2::depth_sensor>());
@@ -341,8 +663,147 @@ void VideoRecorder::setNewDepthROI(){
 	//	}
 
 
+WriterSettings VideoRecorder::createWriterSettings(string imageType, string directory, float fps, WriterStatistics* statistics) {
+	WriterSettings settings;
+	settings.imageType = imageType;
+	settings.directory = directory;
+	settings.baseDirectory = this->baseDir;
+	settings.videoCount = this->videoCount;
+	settings.individualVideoLength = this->individualVideoLength;
+	settings.fps = fps;
+	settings.minDepth = this->minDepth;
+	settings.maxDepth = this->maxDepth;
+	settings.resolution = this->outputResolution();
+	settings.alignTarget = this->alignTarget();
+	settings.fourcc = this->streamProfile.fourcc;
+	settings.statistics = statistics;
+	settings.preRollBudgetBytes = static_cast<size_t>(max(0, this->options.preRollBudgetMb)) * 1024 * 1024;
+	settings.compressPreRoll = this->options.preRollJpeg;
+	settings.preRollQuality = this->options.preRollJpegQuality;
+	settings.container = this->options.segmentContainer;
+	settings.losslessDepthJournal = this->options.journalLosslessDepth;
+	settings.journalQuality = this->options.journalJpegQuality;
+	settings.memory = &this->memoryBudget;
+	if (this->options.threadPlacement) {
+		settings.placement = this->placement.writer;
+	}
+	return settings;
+}
+
+/*
+Stages of one writer, returns the one frames are submitted to. The colorizer
+and conversion run on as many workers as the pool has, the graph hands their
+results on in capture order. select (one align block), filter and encode
+keep state from frame to frame and stay one at a time: the temporal filter
+starts over on every change of its input's stream profile, so threshold,
+disparity and spatial filter run on the same chain before it. encode bounds
+a stream's rate. Only encode reports to
+the writer statistics, the load controller sees the stages before it
+through their edges filling up.
+*/
+int VideoRecorder::addWriterStages(StageGraph& graph, StreamWriter* writer, const WriterSettings& settings, int workers) {
+	size_t edge = static_cast<size_t>(max(1, this->options.graphQueue));
+	const string& name = writer->streamName();
+	vector<int> chain;
+
+	if (this->options.captureMode == "callback") {
+		chain.push_back(graph.addStage(name + " select", [writer](StageItem& item) {
+			item.frame = writer->select(item.frame);
+			return item.frame && writer->admits(item.frame);
+		}, edge));
+	}
+	else if (settings.activityGate != nullptr) {
+		chain.push_back(graph.addStage(name + " gate", [writer](StageItem& item) { return writer->admits(item.frame); }, edge));
+	}
+	if (settings.imageType == "depth") {
+		chain.push_back(graph.addStage(name + " filter", [writer](StageItem& item) { item.frame = writer->filter(item.frame); return true; }, edge));
+		chain.push_back(graph.addStage(name + " colorize", [writer](StageItem& item) { item.frame = writer->colorizeConcurrent(item.frame); return true; }, edge, workers));
+	}
+	chain.push_back(graph.addStage(name + " convert", [writer](StageItem& item) { item.image = writer->convert(item.frame); return true; }, edge, workers));
+	chain.push_back(graph.addStage(name + " encode", [writer](StageItem& item) {
+		writer->writeCarryOver();
+		writer->write(item.frame, item.image);
+		return true;
+	}, edge, 1, settings.statistics));
+
+	for (size_t i = 1; i < chain.size(); ++i) {
+		graph.connect(chain[i - 1], chain[i]);
+	}
+	return chain.front();
+}
+
+/*
+Next session of a recorder that keeps running: new output directories and
+session files, the device, pipeline, sensor options and filters stay as
+they are. The first session uses the directory the constructor made.
+*/
+void VideoRecorder::startSession(float sessionMinutes, std::chrono::steady_clock::time_point trigger) {
+	if (sessionMinutes > 0.0f) {
+		this->calculateSessionLength(sessionMinutes);
+		this->determineOutputVideoCount();
+	}
+
+	if (this->sessionsRecorded > 0) {
+		this->setDirectories();
+		this->createDirectories();
+		this->sessionMetadata.clear();
+		this->writeIntrinsics();
+		this->writeExtrinsics();
+		this->writeDepthDeviceInformation();
+		this->writeSessionInformation();
+		this->sessionMetadata.setField("sdk_frames_queue_size", SessionMetadata::number(this->sdkFramesQueueSize));
+	}
+	this->sessionMetadata.setField("session_length_s", SessionMetadata::number(this->fullSessionLength));
+	this->sessionMetadata.setField("session_index", SessionMetadata::number(this->sessionsRecorded + 1));
+
+	this->memoryBudget.resetPeaks();
+	this->measurementMicroseconds = 0.0;
+	this->measurementCount = 0;
+	this->stopRequested = false;
+	this->hasSessionTrigger = true;
+	this->sessionTrigger = trigger;
+	std::cout << "Starting session " << this->sessionsRecorded + 1 << " in " << this->baseDir << endl;
+}
+
+/*
+Between sessions: framesets are taken off the pipeline so the SDK's queues
+don't fill, and auto-exposure keeps following the scene, which lets the next
+session skip the settle. idleFps other than 0 restreams at that rate (6 or
+15 on a D400) until startNow() says so, the session then pays one restart
+and a settle for the lower load in between.
+*/
+void VideoRecorder::idle(const std::function<bool()>& startNow, int idleFps) {
+	bool restream = idleFps > 0 && idleFps != this->streamProfile.colorFps;
+	if (restream) {
+		this->rsPipeline.stop();
+		this->startPipeline(this->createContext(idleFps));
+		std::cout << "Idle at " << idleFps << " fps." << endl;
+	}
+
+	while (!startNow()) {
+		try {
+			this->nextFrameset();
+		}
+		catch (const rs2::error& e) {
+			std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+		}
+	}
+
+	if (restream) {
+		this->rsPipeline.stop();
+		this->startPipeline(this->createContext());
+	}
+	this->exposureWarm = !restream;
+}
+
+// Ends the running session early, from any thread.
+void VideoRecorder::requestStop() {
+	this->stopRequested = true;
+}
+
 void VideoRecorder::verifySetUp() {
-	rs2::align alignTo(RS2_STREAM_COLOR);
+	rs2::align alignTo(this->alignTarget());
+	rs2::filter alignInput = withoutInfrared();
 
 	rs2::frameset frameSet;
 
@@ -353,18 +814,48 @@ void VideoRecorder::verifySetUp() {
 	auto startTime = Clock.now();
 	timeElapsed = Clock.now() - startTime;
 
+	// The last seconds of the preview become the start of the recording.
+	bool keepPreview = this->options.previewPreRoll > 0.0f;
+	size_t previewBudget = static_cast<size_t>(max(0, this->options.preRollBudgetMb)) * 1024 * 1024;
+	this->previewColorFrames = FrameRingBuffer(this->options.previewPreRoll, previewBudget, this->options.preRollJpeg, this->options.preRollJpegQuality);
+	this->previewDepthFrames = FrameRingBuffer(this->options.previewPreRoll, previewBudget, this->options.preRollJpeg, this->options.preRollJpegQuality);
+	DepthFilterChain previewDepthFilters(this->minDepth, this->maxDepth);
+	MemoryAccount* previewColorMemory = this->memoryBudget.account("color preview pre-roll", true);
+	MemoryAccount* previewDepthMemory = this->memoryBudget.account("depth preview pre-roll", true);
+	bool previewTruncationReported = false;
+
 	int frame_count = 0;
 	while (true) {
 
 		timeElapsed = Clock.now() - startTime;
 
-		frameSet = this->rsPipeline.wait_for_frames(10000);
+		frameSet = this->nextFrameset();
+		if (!frameSet) {
+			continue;
+		}
 
+		this->measureROI(frameSet);
 
-		frameSet = alignTo.process(frameSet);
+		frameSet = alignTo.process(alignInput.process(frameSet));
 		colorFrame = frameSet.get_color_frame();
 		depthFrame = frameSet.get_depth_frame();
 
+		// Same sampling as the start of the recording.
+		if (keepPreview && colorFrame && frame_count % max(1, this->options.minColorSamplingRatio) == 0) {
+			this->previewColorFrames.push(colorFrame.get_timestamp(), frame_to_mat(colorFrame));
+			previewColorMemory->set(static_cast<long long>(this->previewColorFrames.bytes()));
+		}
+		if (keepPreview && depthFrame && frame_count % max(1, this->options.minDepthSamplingRatio) == 0) {
+			this->previewDepthFrames.push(depthFrame.get_timestamp(), frame_to_mat(previewDepthFilters.process(depthFrame)));
+			previewDepthMemory->set(static_cast<long long>(this->previewDepthFrames.bytes()));
+		}
+		if (!previewTruncationReported && (this->previewColorFrames.truncated() || this->previewDepthFrames.truncated())) {
+			previewTruncationReported = true;
+			const FrameRingBuffer& truncated = this->previewColorFrames.truncated() ? this->previewColorFrames : this->previewDepthFrames;
+			std::cerr << "Preview pre-roll holds only " << truncated.heldSeconds() << " of "
+					  << this->options.previewPreRoll << " seconds within pre_roll_budget_mb, raise it or set pre_roll_jpeg." << endl;
+		}
+
 		if (this->videoController.update(colorFrame, depthFrame) == 0) {
 			break;
 		}
@@ -381,14 +872,36 @@ void VideoRecorder::recordVideo() {
 	rs2::frame_queue depthFramesQueue(2);
 	rs2::frame_queue colorFramesQueue(2);
 
-	// Prepare camera and let auto-exposure settle.
-	std::this_thread::sleep_for(std::chrono::seconds(5));
+	// Prepare camera and let auto-exposure settle, unless the recording continues straight from the preview.
+	bool fromPreview = !this->previewColorFrames.empty() || !this->previewDepthFrames.empty();
+
+	if (fromPreview) {
+		this->sessionMetadata.setField("preview_pre_roll_s", SessionMetadata::number(this->options.previewPreRoll));
+		this->sessionMetadata.setField("preview_pre_roll_frames", "{\"color\": " + SessionMetadata::number(static_cast<double>(this->previewColorFrames.size())) +
+									   ", \"depth\": " + SessionMetadata::number(static_cast<double>(this->previewDepthFrames.size())) + "}");
+	}
+	else if (this->exposureWarm) {
+		// The pipeline kept streaming since the last session, exposure never had to start over.
+		this->sessionMetadata.setField("exposure_warm", "true");
+		this->exposureWarm = false;
+	}
+	else {
+		ExposureSettler exposureSettler(this->options);
+		SettleResult settled = exposureSettler.settle([this]() { return this->nextFrameset(); }, this->enableRGB, this->enableDepth);
+
+		this->sessionMetadata.setField("exposure_settle_s", SessionMetadata::number(settled.seconds));
+		this->sessionMetadata.setField("exposure_converged", settled.converged ? "true" : "false");
+		this->sessionMetadata.setField("color_exposure_us", SessionMetadata::number(settled.colorExposure));
+		this->sessionMetadata.setField("depth_exposure_us", SessionMetadata::number(settled.depthExposure));
+	}
 
 	// Depth colorization and alignment.
-	rs2::align alignTo(RS2_STREAM_COLOR);
+	rs2::align alignTo(this->alignTarget());
+	rs2::filter alignInput = withoutInfrared();		// Infrared isn't aligned, align would still reproject it.
+	bool alignToDepth = this->alignTarget() == RS2_STREAM_DEPTH;
 
 	// Information tracking
-	int recordedFrameCount = 0;
+	std::atomic<int> recordedFrameCount{ 0 };
 	int maxFrames =  static_cast<int>(this->fullSessionLength * max(this->RGB_FPS, this->Depth_FPS));
 
 	// Calculate maximum amount of frames
@@ -403,8 +916,218 @@ void VideoRecorder::recordVideo() {
 	rs2::frame colorFrame;
 	rs2::frame depthFrame;
 
-	std::thread depthSavingThread(writeFrames, depthFramesQueue, "depth", this->depthDir, this->baseDir, this->videoCount, this->individualVideoLength, 6, this->minDepth, this->maxDepth);
-	std::thread colorSavingThread(writeFrames, colorFramesQueue, "color", this->colorDir, this->baseDir, this->videoCount, this->individualVideoLength, this->RGB_FPS, this->minDepth, this->maxDepth);
+	// Capture, writer and analytics threads on their own cores, before any of them starts.
+	this->placeThreads();
+
+	// Writer throughput and adaptive sampling of depth, color and preview.
+	WriterStatistics depthStatistics;
+	WriterStatistics colorStatistics;
+	LoadController loadController(this->options, max(this->RGB_FPS, this->Depth_FPS), &this->sessionMetadata);
+
+	// The sampled rates, published for the writers as the load controller changes them. A writer starts a segment at a new rate.
+	float depthWriterFps = this->Depth_FPS / loadController.depthSamplingRatio();
+	float colorWriterFps = this->RGB_FPS / loadController.colorSamplingRatio();
+	std::atomic<float> depthSampledFps{ depthWriterFps };
+	std::atomic<float> colorSampledFps{ colorWriterFps };
+
+	// One stream is aligned to the other (alignTarget()), both writers use that stream's resolution from outputResolution().
+	WriterSettings depthSettings = this->createWriterSettings("depth", this->depthDir, depthWriterFps, &depthStatistics);
+	WriterSettings colorSettings = this->createWriterSettings("color", this->colorDir, colorWriterFps, &colorStatistics);
+	depthSettings.sampledFps = &depthSampledFps;
+	colorSettings.sampledFps = &colorSampledFps;
+
+	// Motion trigger, writers only encode while the scene moves plus the pre- and post-roll.
+	ActivityGate activityGate;
+	rs2::depth_sensor depthSensor = this->rsPLProfile.get_device().first<rs2::depth_sensor>();
+	ActivityDetector activityDetector(&activityGate, this->baseDir + "activity_index.json",
+									  this->options.motionPreRoll, this->options.motionPostRoll, this->options.motionThreshold,
+									  this->options.motionDepthDelta, depthSensor.get_depth_scale(), this->options.motionColorDelta);
+
+	// Raw depth frames as the preview loop sees them, before filters and alignment.
+	this->depthQuality.configure(this->options.depthQualityStride, this->options.depthQualityBudgetUs, this->options.depthQualityInterval,
+								 depthSensor.get_depth_scale(), this->minDepth, this->maxDepth);
+
+	if (this->options.motionTrigger) {
+		for (WriterSettings* settings : { &depthSettings, &colorSettings }) {
+			settings->activityGate = &activityGate;
+			settings->preRollSeconds = this->options.motionPreRoll;
+			settings->idleFrameInterval = this->options.idleFrameInterval;
+		}
+	}
+
+	// Both writers report the frames they write, depth is paired with the closest color frame.
+	float pairingRetain = 3.0f + max(this->options.previewPreRoll, this->options.motionTrigger ? this->options.motionPreRoll : 0.0f);
+	FrameSynchronizer synchronizer(this->colorDir, this->options.pairingTolerance, pairingRetain, &this->sessionMetadata);
+	if (this->options.pairingIndex && this->enableRGB && this->enableDepth) {
+		depthSettings.synchronizer = &synchronizer;
+		colorSettings.synchronizer = &synchronizer;
+	}
+
+	// Without a capture loop of our own, alignment moves to the writers of the stream being aligned.
+	depthSettings.alignFrames = this->options.captureMode == "callback" && !alignToDepth;
+	colorSettings.alignFrames = this->options.captureMode == "callback" && alignToDepth;
+	this->sessionMetadata.setField("aligned_to", SessionMetadata::text(alignToDepth ? "depth" : "color"));
+	this->sessionMetadata.setField("output_width", SessionMetadata::number(colorSettings.resolution.width));
+	this->sessionMetadata.setField("output_height", SessionMetadata::number(colorSettings.resolution.height));
+
+	// Segment ranges and frame tables of every writer of the session.
+	SessionManifest manifest(this->baseDir);
+	depthSettings.manifest = &manifest;
+	colorSettings.manifest = &manifest;
+	this->sessionMetadata.setField("manifest", SessionMetadata::text("manifest.json"));
+
+	if (fromPreview) {
+		depthSettings.carryOver = &this->previewDepthFrames;
+		colorSettings.carryOver = &this->previewColorFrames;
+	}
+
+	// Both streams share the aligned frames' pixels, so one crop in outputResolution() fits them.
+	rs2::frame_queue contextFramesQueue(2);
+	bool writeContext = false;
+
+	if (this->options.roiCropRecording) {
+		cv::Rect crop = this->recordingCrop();
+		depthSettings.crop = crop;
+		colorSettings.crop = crop;
+		writeContext = this->options.contextInterval > 0;
+
+		std::cout << "Recording only " << crop.width << "x" << crop.height << " at " << crop.x << "," << crop.y << "." << endl;
+		this->sessionMetadata.setField("recording_crop", "{\"x\": " + SessionMetadata::number(crop.x) + ", \"y\": " + SessionMetadata::number(crop.y) +
+									   ", \"width\": " + SessionMetadata::number(crop.width) + ", \"height\": " + SessionMetadata::number(crop.height) + "}");
+	}
+
+	// Unfiltered depth next to the colorized videos, aligned like them (kept as it is when aligning to depth).
+	rs2::frame_queue rawDepthFramesQueue(2);
+	bool writeRawDepth = this->options.rawDepthArchive && this->enableDepth;
+
+	WriterSettings rawDepthSettings = depthSettings;
+	rawDepthSettings.imageType = "depth_raw";
+	rawDepthSettings.directory = this->rawDepthDir;
+	rawDepthSettings.statistics = nullptr;
+	rawDepthSettings.synchronizer = nullptr;
+	rawDepthSettings.carryOver = nullptr;
+
+	WriterSettings contextSettings = this->createWriterSettings("color", this->contextDir, this->RGB_FPS / max(1, this->options.contextInterval), nullptr);
+	contextSettings.manifest = &manifest;
+	contextSettings.alignFrames = colorSettings.alignFrames;
+
+	if (writeRawDepth) {
+		this->sessionMetadata.setField("raw_depth_archive", SessionMetadata::text("depth_raw"));
+	}
+	if (writeContext) {
+		this->sessionMetadata.setField("context_fps", SessionMetadata::number(contextSettings.fps));
+	}
+
+	// Left and right infrared, sampled with depth. Aligned to depth they share its crop, aligned to color no crop fits them.
+	InfraredWriter infraredWriters[2];
+	for (int i = 0; i < 2; ++i) {
+		InfraredWriter& infrared = infraredWriters[i];
+		infrared.index = i + 1;
+		infrared.enabled = this->recordsInfrared(infrared.index);
+		infrared.settings = this->createWriterSettings("infrared", i == 0 ? this->infraredLeftDir : this->infraredRightDir, depthWriterFps, &infrared.statistics);
+		infrared.settings.streamIndex = infrared.index;
+		infrared.settings.sampledFps = &depthSampledFps;
+		infrared.settings.fourcc = this->options.infraredFourcc;
+		infrared.settings.resolution = this->infraredResolution(infrared.index);
+		infrared.settings.crop = alignToDepth ? depthSettings.crop : cv::Rect();
+		infrared.settings.activityGate = depthSettings.activityGate;
+		infrared.settings.preRollSeconds = depthSettings.preRollSeconds;
+		infrared.settings.idleFrameInterval = depthSettings.idleFrameInterval;
+		infrared.settings.manifest = &manifest;
+		infrared.memory = this->memoryBudget.account(string(i == 0 ? "ir_left" : "ir_right") + " queue");
+	}
+	if (infraredWriters[0].enabled || infraredWriters[1].enabled) {
+		this->sessionMetadata.setField("infrared", SessionMetadata::text(this->options.infrared));
+		this->sessionMetadata.setField("infrared_fourcc", SessionMetadata::text(this->options.infraredFourcc));
+	}
+
+	// A thread per writer, or every writer's steps as stages of one graph on a shared pool.
+	// The rest stays off the graph: the preview has to draw on the thread that owns its window,
+	// telemetry samples on a clock rather than per frame, and the ROI series and proxy each
+	// write one file from a single queue, they would be one serial stage with nothing to steal.
+	bool graphExecutor = this->options.pipelineExecutor == "graph";
+	this->sessionMetadata.setField("pipeline_executor", SessionMetadata::text(graphExecutor ? "graph" : "threads"));
+
+	std::thread depthSavingThread;
+	std::thread colorSavingThread;
+	std::thread contextSavingThread;
+	std::thread rawDepthSavingThread;
+
+	vector<unique_ptr<StreamWriter>> streamWriters;
+	StageGraph stageGraph;
+	int depthStage = -1, colorStage = -1, contextStage = -1, rawDepthStage = -1;
+
+	if (graphExecutor) {
+		int workers = this->options.graphWorkers > 0 ? this->options.graphWorkers : max(2, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+		auto addWriter = [&](const WriterSettings& settings) {
+			streamWriters.emplace_back(new StreamWriter(settings));
+			return this->addWriterStages(stageGraph, streamWriters.back().get(), settings, workers);
+		};
+
+		depthStage = addWriter(depthSettings);
+		colorStage = addWriter(colorSettings);
+		if (writeContext) {
+			contextStage = addWriter(contextSettings);
+		}
+		if (writeRawDepth) {
+			rawDepthStage = addWriter(rawDepthSettings);
+		}
+		for (InfraredWriter& infrared : infraredWriters) {
+			if (infrared.enabled) {
+				infrared.stage = addWriter(infrared.settings);
+			}
+		}
+
+		stageGraph.setMemoryAccount(this->memoryBudget.account("stage graph"));
+		stageGraph.start(workers, this->options.threadPlacement ? this->placement.writer : ThreadPlacement());
+		std::cout << "Writing through a stage graph on " << workers << " worker threads." << endl;
+	}
+	else {
+		depthSavingThread = std::thread(writeFrames, depthFramesQueue, depthSettings);
+		colorSavingThread = std::thread(writeFrames, colorFramesQueue, colorSettings);
+		if (writeContext) {
+			contextSavingThread = std::thread(writeFrames, contextFramesQueue, contextSettings);
+		}
+		if (writeRawDepth) {
+			rawDepthSavingThread = std::thread(writeFrames, rawDepthFramesQueue, rawDepthSettings);
+		}
+		for (InfraredWriter& infrared : infraredWriters) {
+			if (infrared.enabled) {
+				infrared.thread = std::thread(writeFrames, infrared.queue, infrared.settings);
+			}
+		}
+	}
+
+	// Every raw depth frame, not just the archived ones.
+	this->startROITimeSeries();
+
+	// Temperatures and SDK errors, sampled off the capture thread.
+	if (this->options.telemetry && this->telemetry.start(this->rsPLProfile.get_device(), this->baseDir + "telemetry.bin", this->options.telemetryInterval)) {
+		this->sessionMetadata.setField("telemetry_file", SessionMetadata::text("telemetry.bin"));
+	}
+
+	// The motion sensor runs beside the pipeline, its samples never enter the capture loop.
+	bool imuStarted = false;
+	if (this->options.imu) {
+		rs2::sensor motionSensor;
+		if (!ImuRecorder::findMotionSensor(this->rsPLProfile.get_device(), motionSensor)) {
+			std::cout << "The camera has no motion sensor, not recording the IMU." << endl;
+		}
+		else if (this->imu.start(motionSensor, this->baseDir + "imu.bin", this->options.imuGyroFps, this->options.imuAccelFps,
+								 this->options.imuRingSamples, this->options.imuBatchMs)) {
+			imuStarted = true;
+			this->memoryBudget.account("imu ring", true)->set(static_cast<long long>(this->imu.ringBytes()));
+		}
+	}
+
+	// Review copy from the preview's blend, the preview keeps composing for it while hidden.
+	if (this->options.proxyStream && this->enableRGB && this->enableDepth &&
+		this->proxy.start(this->proxyDir, this->thumbnailDir, this->options.proxyHeight, this->options.proxyFps,
+						  this->options.thumbnailInterval, this->individualVideoLength, this->options.thumbnailQuality)) {
+		this->videoController.setProxyWriter(&this->proxy);
+		this->sessionMetadata.setField("proxy", "{\"directory\": " + SessionMetadata::text("proxy") + ", \"height\": " + SessionMetadata::number(this->options.proxyHeight) +
+									   ", \"fps\": " + SessionMetadata::number(this->options.proxyFps) + ", \"thumbnail_interval_s\": " + SessionMetadata::number(this->options.thumbnailInterval) + "}");
+	}
 
 	// Keep track of time in video.
 	std::chrono::duration<float> timeElapsed;
@@ -442,43 +1165,210 @@ void VideoRecorder::recordVideo() {
 	color_filter.set_option(RS2_OPTION_MIN_DISTANCE, min_depth);
 
 
+	// Everything the writers need from one frameset, called on the SDK's thread in callback mode and on this one otherwise.
+	bool callbackCapture = this->options.captureMode == "callback";
+	int previewFrameCount = 0;
+
+	// Writer queues report what they hold to the memory budget, the writers do the same as they take frames out.
+	MemoryAccount* depthQueueMemory = this->memoryBudget.account("depth queue");
+	MemoryAccount* colorQueueMemory = this->memoryBudget.account("color queue");
+	MemoryAccount* contextQueueMemory = this->memoryBudget.account("context queue");
+	MemoryAccount* rawDepthQueueMemory = this->memoryBudget.account("depth_raw queue");
+	unsigned long long memoryDrops = 0;
+	bool unreachableLimitReported = false;
+
+	auto enqueue = [&](const rs2::frame_queue& queue, int stage, const rs2::frame& frame, MemoryAccount* memory) {
+		if (graphExecutor) {
+			stageGraph.submit(stage, frame);
+			return;
+		}
+		queue.enqueue(frame);
+		memory->set(static_cast<long long>(queue.size()) * frameBytes(frame));
+	};
+
+	auto capture = [&](const rs2::frameset& capturedFrameSet) {
+		if (this->hasSessionTrigger && recordedFrameCount == 0) {
+			double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->sessionTrigger).count();
+			this->sessionMetadata.setField("session_start_latency_ms", SessionMetadata::number(latency));
+			std::cout << "First frameset " << latency << " ms after the session was started." << endl;
+		}
+
+		this->telemetry.noteFrame(capturedFrameSet.get_timestamp());
+		this->roiSeries.enqueue(capturedFrameSet.get_depth_frame());
+
+		// Over the frame memory budget: wait for the writers, drop the frameset, or only shed load (memory_policy).
+		// Under what the fixed accounts hold no frameset could be admitted again, such a limit only sheds load.
+		bool overBudget = this->memoryBudget.overBudget();
+		bool reachable = !overBudget || this->memoryBudget.limitReachable();
+		bool admit = true;
+		if (overBudget) {
+			this->memoryBudget.countOverBudget();
+			if (!reachable) {
+				if (!unreachableLimitReported) {
+					unreachableLimitReported = true;
+					std::cerr << "memory_budget_mb = " << this->options.memoryBudgetMb << " is below the " << this->memoryBudget.fixedUsage() / 1048576
+							  << " MB held by the SDK's queues and pre-rolls, shedding load instead of the " << this->options.memoryPolicy << " policy." << endl;
+					this->sessionMetadata.setField("memory_limit_unreachable", "true");
+				}
+			}
+			else if (this->options.memoryPolicy == "block" && !callbackCapture) {
+				admit = this->memoryBudget.waitForRoom(this->options.memoryBlockMs);
+			}
+			else if (this->options.memoryPolicy == "drop" || this->options.memoryPolicy == "block") {
+				// The SDK's thread is never held up, in callback mode block drops as well.
+				admit = false;
+			}
+		}
+		if (!admit) {
+			memoryDrops++;
+		}
+
+		bool keepColor = admit && recordedFrameCount % loadController.colorSamplingRatio() == 0;
+
+		if (admit && recordedFrameCount % loadController.depthSamplingRatio() == 0) {
+			if (callbackCapture) {
+				// Reference counted hand over, the depth writers align the frameset themselves.
+				enqueue(depthFramesQueue, depthStage, capturedFrameSet, depthQueueMemory);
+				if (writeRawDepth) {
+					enqueue(rawDepthFramesQueue, rawDepthStage, capturedFrameSet, rawDepthQueueMemory);
+				}
+				for (InfraredWriter& infrared : infraredWriters) {
+					if (infrared.enabled) {
+						enqueue(infrared.queue, infrared.stage, capturedFrameSet, infrared.memory);
+					}
+				}
+			}
+			else {
+				// Aligned to depth, the depth frame keeps its own pixels.
+				depthFrame = alignToDepth ? capturedFrameSet.get_depth_frame() : alignTo.process(alignInput.process(capturedFrameSet)).get_depth_frame();
+
+				enqueue(depthFramesQueue, depthStage, depthFrame, depthQueueMemory);
+				if (writeRawDepth) {
+					enqueue(rawDepthFramesQueue, rawDepthStage, depthFrame, rawDepthQueueMemory);
+				}
+				for (InfraredWriter& infrared : infraredWriters) {
+					rs2::frame infraredFrame = infrared.enabled ? capturedFrameSet.get_infrared_frame(infrared.index) : rs2::frame();
+					if (infraredFrame) {
+						enqueue(infrared.queue, infrared.stage, infraredFrame, infrared.memory);
+					}
+				}
+			}
+		}
+
+		if (!alignToDepth) {
+			// Alignment to color leaves the color frame as it is.
+			colorFrame = capturedFrameSet.get_color_frame();
+		}
+		else if (callbackCapture) {
+			// The color writers align the frameset to depth themselves.
+			colorFrame = capturedFrameSet;
+		}
+		else {
+			colorFrame = alignTo.process(alignInput.process(capturedFrameSet)).get_color_frame();
+		}
+
+		if (keepColor) {
+			enqueue(colorFramesQueue, colorStage, colorFrame, colorQueueMemory);
+		}
+
+		if (admit && writeContext && recordedFrameCount % this->options.contextInterval == 0) {
+			enqueue(contextFramesQueue, contextStage, colorFrame, contextQueueMemory);
+		}
+
+		std::chrono::duration<float> captureElapsed = Clock.now() - startTime;
+		if (graphExecutor) {
+			loadController.sampleOccupancy(stageGraph.occupancy(colorStage), stageGraph.occupancy(depthStage));
+		}
+		else {
+			loadController.sampleQueues(colorFramesQueue, depthFramesQueue);
+		}
+		loadController.sampleMemory(overBudget && (this->options.memoryPolicy == "shed" || !reachable));
+		loadController.update(captureElapsed.count(), recordedFrameCount, colorStatistics, depthStatistics);
+		depthSampledFps = this->Depth_FPS / loadController.depthSamplingRatio();
+		colorSampledFps = this->RGB_FPS / loadController.colorSamplingRatio();
+
+		// Updating time loop and frames
+		recordedFrameCount++;
+
+		// Debug printing
+		if (recordedFrameCount % 900 == 0) {
+			std::cout << recordedFrameCount << " at " << captureElapsed.count() << " seconds." << endl;
+
+			if (this->measurementCount > 0) {
+				std::cout << "ROI measurement takes " << this->measurementMicroseconds / this->measurementCount << " us per frame." << endl;
+			}
+		}
+	};
+
+	// The handler only hands frames on: its metadata changes wait for this thread to write them.
+	if (callbackCapture) {
+		this->sessionMetadata.setDeferred(true);
+		this->captureDispatcher.setHandler(capture);
+	}
+
 	// Record a video
 	while (true) {
 
 		timeElapsed = Clock.now() - startTime;
 
-		if (timeElapsed.count() >= this->fullSessionLength) {
+		if (timeElapsed.count() >= this->fullSessionLength || this->stopRequested) {
 			break;
 		}
 
 		try {
-			frameSet = this->rsPipeline.wait_for_frames(10000);
+			this->sessionMetadata.flushPending();
 
-			if (recordedFrameCount % 5 == 0) {
-				frameSet = alignTo.process(frameSet);
-				colorFrame = frameSet.get_color_frame();
-				depthFrame = frameSet.get_depth_frame();
+			// In callback mode this is the newest frameset the SDK thread has already handed to the writers.
+			frameSet = this->nextFrameset();
+			if (!frameSet) {
+				continue;
+			}
 
-				depthFramesQueue.enqueue(depthFrame);
-				colorFramesQueue.enqueue(colorFrame);
+			this->measureROI(frameSet);
+			if (this->options.depthQuality && this->enableDepth) {
+				this->depthQuality.update(frameSet.get_depth_frame(), &this->sessionMetadata);
 			}
-			else {
-				colorFrame = frameSet.get_color_frame();
-				colorFramesQueue.enqueue(colorFrame);
+
+			if (this->options.motionTrigger) {
+				activityDetector.update(frameSet);
+				this->videoController.setStatusText("activity", string(activityDetector.isActive() ? "Recording" : "Idle") +
+													", motion " + std::to_string(static_cast<int>(activityDetector.score() * 100.0f)) + "%");
 			}
 
-			this->videoController.update(colorFrame, depthFrame);
+			if (callbackCapture) {
+				// Only the preview is aligned on this thread.
+				rs2::frameset previewFrameSet = alignTo.process(alignInput.process(frameSet));
+				rs2::frame previewColor = previewFrameSet.get_color_frame();
+				rs2::frame previewDepth = previewFrameSet.get_depth_frame();
+				this->videoController.update(previewColor, previewDepth);
+			}
+			else {
+				int frameNumber = recordedFrameCount;
+				capture(frameSet);
 
-			// Updating time loop and frames
-			recordedFrameCount++;
+				if (frameNumber % loadController.previewInterval() == 0) {
+					this->videoController.update(colorFrame, depthFrame);
+				}
+			}
 
-			// Debug printing
-			if (recordedFrameCount % 900 == 0) {
-				std::cout << recordedFrameCount << " at " << timeElapsed.count() << " seconds." << endl;
+			if (++previewFrameCount % 30 == 0) {
+				if (this->options.telemetry) {
+					this->videoController.setStatusText("telemetry", this->telemetry.describe());
+				}
+				this->videoController.setStatusText("memory", this->memoryBudget.describe());
+				if (this->options.depthQuality && this->enableDepth) {
+					this->videoController.setStatusText("depth quality", this->depthQuality.describe());
+				}
+				if (graphExecutor) {
+					this->videoController.setStatusText("stages", stageGraph.describe());
+				}
 			}
 		}
 		catch (const rs2::error& e) {
 			std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+			if (this->options.telemetry) {
+				std::cerr << "Last camera telemetry: " << this->telemetry.describe() << endl;
+			}
 			std::cerr << "Camera did overheat with a temperature of: " << this->rsPipeline.get_active_profile().get_device().first<rs2::depth_sensor>().get_option(RS2_OPTION_ASIC_TEMPERATURE) << "C." << endl;
 			std::cerr << "Program has unexpectedly exited." << endl << "Try moving the sensor further from the incubator." << endl;
 			cv::destroyAllWindows();
@@ -486,12 +1376,86 @@ void VideoRecorder::recordVideo() {
 		}
 	}
 
+	// No frameset reaches the writer queues after this, the writers stop when their queues run dry.
+	this->captureDispatcher.clearHandler();
+	this->sessionMetadata.setDeferred(false);
+
 	cv::destroyAllWindows();
+
+	if (this->options.motionTrigger) {
+		activityDetector.finish();
+	}
+
+	this->roiSeries.stop();
+	this->telemetry.stop();
+	if (this->options.depthQuality && this->enableDepth) {
+		this->depthQuality.report(this->sessionMetadata);
+	}
+	if (imuStarted) {
+		this->imu.stop();
+		this->imu.report(this->sessionMetadata);
+		this->memoryBudget.account("imu ring")->set(0);
+		if (this->imu.dropped() > 0) {
+			std::cout << "IMU samples dropped: " << this->imu.dropped() << endl;
+		}
+	}
+	this->videoController.setProxyWriter(nullptr);
+	this->proxy.stop();
+	if (this->proxy.written() > 0) {
+		this->sessionMetadata.setField("proxy_frames", SessionMetadata::number(static_cast<double>(this->proxy.written())));
+		this->sessionMetadata.setField("thumbnails", SessionMetadata::number(this->proxy.thumbnails()));
+	}
+	if (this->roiSeries.written() > 0) {
+		this->sessionMetadata.setField("roi_series_records", SessionMetadata::number(static_cast<double>(this->roiSeries.written())));
+	}
+
 	std::cout << "Number of frames captured:" << recordedFrameCount << endl;
 	std::cout << "Number of max possible frames:" << maxFrames << endl;
 
-	colorSavingThread.join();
-	depthSavingThread.join();
+	if (graphExecutor) {
+		stageGraph.drain();
+		for (unique_ptr<StreamWriter>& writer : streamWriters) {
+			writer->writeCarryOver();
+			writer->close();
+		}
+		stageGraph.report(this->sessionMetadata);
+		stageGraph.stop();
+	}
+
+	if (colorSavingThread.joinable()) {
+		colorSavingThread.join();
+	}
+	if (depthSavingThread.joinable()) {
+		depthSavingThread.join();
+	}
+	if (contextSavingThread.joinable()) {
+		contextSavingThread.join();
+	}
+	if (rawDepthSavingThread.joinable()) {
+		rawDepthSavingThread.join();
+	}
+	for (InfraredWriter& infrared : infraredWriters) {
+		if (infrared.thread.joinable()) {
+			infrared.thread.join();
+		}
+		if (infrared.enabled) {
+			this->sessionMetadata.appendRecord("infrared_writers", { { "stream", SessionMetadata::text(infrared.index == 1 ? "ir_left" : "ir_right") },
+																	 { "frames", SessionMetadata::number(static_cast<double>(infrared.statistics.framesWritten.load())) },
+																	 { "busy_s", SessionMetadata::number(infrared.statistics.busyMicroseconds / 1e6) } });
+		}
+	}
+
+	if (depthSettings.synchronizer != nullptr) {
+		synchronizer.finish();
+	}
+	manifest.finish();
+
+	this->memoryBudget.report(this->sessionMetadata);
+	this->sessionMetadata.setField("memory_dropped_framesets", SessionMetadata::number(static_cast<double>(memoryDrops)));
+	std::cout << "Peak " << this->memoryBudget.describe() << endl;
+
+	this->sessionsRecorded++;
+	this->hasSessionTrigger = false;
 
 	return;
 }
\ No newline at end of file
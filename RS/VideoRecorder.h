@@ -1,8 +1,28 @@
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
 
 #include <librealsense2/rs.hpp>
 #include "ROIHolder.h"
 #include "VideoController.h"
+#include "RecorderOptions.h"
+#include "SessionMetadata.h"
+#include "StreamProfile.h"
+#include "WriterSettings.h"
+#include "ROIMeasurement.h"
+#include "DepthQualityMonitor.h"
+#include "ActivityDetector.h"
+#include "ROITimeSeries.h"
+#include "TelemetrySampler.h"
+#include "ImuRecorder.h"
+#include "ProxyWriter.h"
+#include "ThreadPlacement.h"
+#include "CaptureDispatcher.h"
+#include "MemoryBudget.h"
+#include "StageGraph.h"
+#include "StreamWriter.h"
 
 #ifndef VIDEORECORDER_H
 #define VIDEORECORDER_H
@@ -10,21 +30,40 @@
 using namespace std;
 using namespace rs2;
 
+// One infrared imager's writer for a session, index 1 is the left imager and 2 the right one.
+struct InfraredWriter {
+	int index = 0;
+	bool enabled = false;
+	rs2::frame_queue queue{ 2 };
+	WriterSettings settings;
+	WriterStatistics statistics;
+	MemoryAccount* memory = nullptr;
+	int stage = -1;
+	std::thread thread;
+};
+
 class VideoRecorder
 {
 	private:
 
-		const string parentDir = string("C:/Users/Neonatology Research/Documents/SLAPI data/VIDEO_RECORDINGS/");
+		const string parentDir = recordingsDirectory;
 		string baseDir;
 		string colorDir;
 		string depthDir;
+		string contextDir;
+		string rawDepthDir;
+		string infraredLeftDir;
+		string infraredRightDir;
+		string proxyDir;
+		string thumbnailDir;
 		ROIHolder depthROI;
 	
 		rs2::pipeline rsPipeline;
 		rs2::pipeline_profile rsPLProfile;
 
-		const float RGB_FPS = 30;
-		const float Depth_FPS = 30;
+		StreamProfile streamProfile;
+		float RGB_FPS = 30;
+		float Depth_FPS = 30;
 		float minDepth = 0.19f;
 		float maxDepth = 7.0f;
 		float individualVideoLength;
@@ -35,6 +74,30 @@ class VideoRecorder
 		bool enableDepth = true;
 
 		VideoController videoController;
+		RecorderOptions options;
+		SessionMetadata sessionMetadata;
+		MemoryBudget memoryBudget;
+		int sdkFramesQueueSize = 16;			// As the sensors report it, for every session's metadata.
+		ROIMeasurement roiMeasurement;
+		cv::Rect measurementROI;
+		double measurementMicroseconds = 0.0;
+		int measurementCount = 0;
+		ROITimeSeries roiSeries;
+		DepthQualityMonitor depthQuality;
+		FrameRingBuffer previewColorFrames;
+		FrameRingBuffer previewDepthFrames;
+		TelemetrySampler telemetry;
+		ImuRecorder imu;
+		ProxyWriter proxy;
+		RecorderPlacement placement;
+		CaptureDispatcher captureDispatcher;
+
+		// Sessions of a long running recorder, see RecorderDaemon.
+		std::atomic<bool> stopRequested{ false };
+		bool exposureWarm = false;
+		int sessionsRecorded = 0;
+		bool hasSessionTrigger = false;
+		std::chrono::steady_clock::time_point sessionTrigger;
 
 		bool verifyOptionSupport(rs2::sensor, rs2_option);
 		void calculateIndividualVidLength(float min);
@@ -43,16 +106,32 @@ class VideoRecorder
 		void createDirectories();
 		void setDirectories();
 		void startPipeline(rs2::config);
+		rs2::frameset nextFrameset();
 		void controlSensorSettings();
 		void writeIntrinsics();
 		void writeExtrinsics();
 		void saveIntrinsics(rs2_intrinsics intrinsics, string filename);
 		void saveExtrinsics(rs2_extrinsics extrinsics, string filename);
 		void writeDepthDeviceInformation();
+		void writeSessionInformation();
 		void setNewDepthROI();
 		void setDepthROIDefault(int width, int height);
+		void createROIMeasurement();
+		void updateMeasurementROI();
+		void measureROI(const rs2::frameset& frameSet);
+		void startROITimeSeries();
+		void placeThreads();
+		void setUpMemoryBudget();
+		int addWriterStages(StageGraph& graph, StreamWriter* writer, const WriterSettings& settings, int workers);
+		cv::Rect recordingCrop();
+		rs2_stream alignTarget() const;
+		cv::Size outputResolution();
+		bool recordsInfrared(int index) const;
+		cv::Size infraredResolution(int index);
+		void applyStreamProfile();
+		WriterSettings createWriterSettings(string imageType, string directory, float fps, WriterStatistics* statistics);
 
-		rs2::config createContext();
+		rs2::config createContext(int fps = 0);
 
 	public:
 		VideoRecorder(float individualVideoLength, float fullSessionLength, bool enableRGB, bool enableDepth);
@@ -60,6 +139,9 @@ class VideoRecorder
 		void recordVideo();
 		void stopPipeline();
 		void verifySetUp();
+		void startSession(float sessionMinutes, std::chrono::steady_clock::time_point trigger);
+		void idle(const std::function<bool()>& startNow, int idleFps);
+		void requestStop();
 };
 
 #endif // !
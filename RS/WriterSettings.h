@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <librealsense2/rs.hpp>
+#include "opencv2/opencv.hpp"
+#include "WriterStatistics.h"
+#include "ActivityGate.h"
+#include "FrameRingBuffer.h"
+#include "FrameSynchronizer.h"
+#include "ThreadPlacement.h"
+#include "SessionManifest.h"
+#include "MemoryBudget.h"
+
+#ifndef WRITERSETTINGS_H
+#define WRITERSETTINGS_H
+
+using namespace std;
+
+/*
+Everything a writer thread needs to know about the stream it saves.
+*/
+struct WriterSettings {
+	string imageType;					// "color", "depth" (filtered and colorized), "depth_raw" (Z16 as is) or "infrared" (Y8).
+	int streamIndex = 0;				// Of an infrared stream, 1 left and 2 right.
+	string directory;
+	string baseDirectory;
+	int videoCount = 1;
+	float individualVideoLength = 60.0f;
+	float fps = 30.0f;
+	float minDepth = 0.19f;
+	float maxDepth = 7.0f;
+	cv::Size resolution = cv::Size(1920, 1080);	// Of the stream frames are aligned to.
+	string fourcc = "mp4v";
+	string container = "video";			// "video" or "journal", see FrameJournal.
+	bool losslessDepthJournal = true;	// PNG instead of JPEG for depth in a journal.
+	int journalQuality = 90;
+	unsigned int queueTimeoutMs = 15000;	// Writer stops when no frame arrives for this long.
+	WriterStatistics* statistics = nullptr;
+	const std::atomic<float>* sampledFps = nullptr;	// Rate after the load controller's sampling, a change starts a segment at it.
+	cv::Rect crop;						// Encode only this part of the frame, empty keeps the whole frame.
+	bool alignFrames = false;			// Whole framesets arrive and are aligned to alignTarget here.
+	rs2_stream alignTarget = RS2_STREAM_COLOR;
+
+	// Motion triggered recording, without a gate every frame is written.
+	ActivityGate* activityGate = nullptr;
+	float preRollSeconds = 2.0f;
+	int idleFrameInterval = 0;			// Keep one idle frame out of N, 0 drops them all.
+	size_t preRollBudgetBytes = 0;		// 0 only limits the pre-roll by time.
+	bool compressPreRoll = false;
+	int preRollQuality = 90;
+
+	// Frames kept from the preview, written at the start of the first segment.
+	FrameRingBuffer* carryOver = nullptr;
+
+	// Told about every frame that goes into a segment, for the color/depth pairing index.
+	FrameSynchronizer* synchronizer = nullptr;
+
+	// Segments and the timestamp of every frame, for seeking without opening the videos.
+	SessionManifest* manifest = nullptr;
+
+	// Queue and pre-roll bytes are reported here.
+	MemoryBudget* memory = nullptr;
+
+	// Applied by the writer thread when it starts.
+	ThreadPlacement placement;
+};
+
+#endif // !
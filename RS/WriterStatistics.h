@@ -0,0 +1,16 @@
+#pragma once
+#include <atomic>
+
+#ifndef WRITERSTATISTICS_H
+#define WRITERSTATISTICS_H
+
+/*
+Counters published by a writer thread and read by the capture thread.
+*/
+struct WriterStatistics {
+	std::atomic<long long> busyMicroseconds{ 0 };	// Time spent filtering, converting and encoding.
+	std::atomic<long long> framesWritten{ 0 };
+	std::atomic<int> currentSegment{ 1 };
+};
+
+#endif // !